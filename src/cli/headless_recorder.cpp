@@ -18,6 +18,7 @@
 #include "headless_recorder.h"
 
 #include <QCoreApplication>
+#include <QDir>
 #include <QFile>
 #include <QFileInfo>
 #include <QJsonArray>
@@ -55,6 +56,9 @@ HeadlessRecorder::HeadlessRecorder(QObject* parent) : QObject(parent) {
   connect(&m_robot, &robot::Robot::signal_wifi_info_updated, this,
           &HeadlessRecorder::slot_wifi_info_updated);
 
+  connect(&m_measurements, &state::Measurements::signal_measurement_added,
+          &m_journal, &state::RecordingJournal::append_measurement);
+
   // Duration timer (single shot)
   m_duration_timer.setSingleShot(true);
   connect(&m_duration_timer, &QTimer::timeout, this,
@@ -77,6 +81,11 @@ void HeadlessRecorder::set_interval(double seconds) {
   m_interval_seconds = seconds;
 }
 
+void HeadlessRecorder::set_map_interval(double seconds) {
+  m_robot.set_map_min_interval(
+      std::chrono::milliseconds(qRound64(seconds * 1000.0)));
+}
+
 void HeadlessRecorder::set_url(const QString& url) { m_url = url; }
 
 void HeadlessRecorder::set_auth(const QString& username,
@@ -112,24 +121,26 @@ int HeadlessRecorder::run() {
 
   // Load existing measurements if provided
   if (!m_load_path.isEmpty()) {
-    QFile file(m_load_path);
-    if (file.open(QIODevice::ReadOnly)) {
-      auto doc = QJsonDocument::fromJson(file.readAll());
-      auto obj = doc.object();
-      if (obj.contains("measurements")) {
-        m_measurements.set_json(obj.value("measurements").toArray());
-      }
-      if (obj.contains("map")) {
-        m_robot_map.update_map_json(obj.value("map").toObject());
+    state::ProjectFile project;
+    if (project.load(m_load_path)) {
+      project.apply_measurements(m_measurements);
+      if (!project.map().isEmpty()) {
+        m_robot_map.update_map_json(project.map());
       }
+      m_wifis = project.wifis();
       out << "Loaded existing data from " << m_load_path << "\n";
       out.flush();
     } else {
-      out << "Warning: Could not open " << m_load_path << "\n";
+      out << "Warning: Could not open " << m_load_path << " ("
+          << project.error() << ")\n";
       out.flush();
     }
   }
 
+  if (!m_output_path.isEmpty()) {
+    recover_journal();
+  }
+
   // Build connection configuration from CLI args or QSettings
   robot::ConnectionConfiguration config;
 
@@ -233,6 +244,8 @@ void HeadlessRecorder::slot_connected() {
   out << " (interval: " << m_interval_seconds << "s)\n";
   out.flush();
 
+  start_journal();
+
   // Start wifi polling with the configured interval
   m_robot.slot_subscribe_wifi(m_interval_seconds);
 }
@@ -249,10 +262,14 @@ void HeadlessRecorder::slot_connection_error() {
 void HeadlessRecorder::slot_map_updated() {
   if (m_exiting) return;
 
-  // Update local robot map from the robot's SSE map data
-  const QString map_data = m_robot.get_map_data();
+  // Update local robot map from the robot's SSE map data. Only the robot
+  // position is needed for recording, the layers are not decoded.
+  const auto map_data = m_robot.get_map_data();
   if (!map_data.isEmpty()) {
-    m_robot_map.update_map_json(map_data);
+    m_robot_map.update_map_json_lazy(map_data);
+    if (m_robot_map.is_valid()) {
+      m_journal.set_map(map_data, m_robot_map.get_layers_hash());
+    }
   }
 }
 
@@ -308,23 +325,33 @@ void HeadlessRecorder::slot_duration_elapsed() {
 void HeadlessRecorder::save_and_exit(int code) {
   QTextStream out(stdout);
 
+  const auto map_statistics = m_robot.get_map_statistics();
+  if (map_statistics.received > 0) {
+    out << "Processed " << map_statistics.processed << " of "
+        << map_statistics.received << " map updates ("
+        << map_statistics.dropped << " superseded)\n";
+  }
+
   if (!m_output_path.isEmpty() && !m_measurements.get_measurements().empty()) {
-    QJsonObject root;
-    root["measurements"] = m_measurements.get_json();
-    root["map"] = m_robot_map.get_map_json();
-    root["version"] = 1;
-
-    QFile file(m_output_path);
-    if (file.open(QIODevice::WriteOnly)) {
-      file.write(QJsonDocument(root).toJson());
+    QString error;
+    // Parsing the map JSON is enough, the layers do not need to be decoded
+    const auto map =
+        QJsonDocument::fromJson(m_robot_map.get_map_source()).object();
+    if (state::ProjectFile::save(m_output_path, state::PROJECT_FORMAT_BINARY,
+                                 map, m_wifis, m_measurements, &error)) {
       out << "Saved " << m_measurements.get_measurements().size()
           << " measurements to " << m_output_path << "\n";
+      m_journal.remove();
     } else {
-      out << "Error: Could not write to " << m_output_path << "\n";
+      out << "Error: Could not write to " << m_output_path << " (" << error
+          << ")\n";
+      // Keep the journal, it still holds the recording
+      m_journal.flush();
       code = 1;
     }
   } else if (m_measurements.get_measurements().empty()) {
     out << "No measurements recorded.\n";
+    m_journal.remove();
   }
 
   out.flush();
@@ -333,4 +360,67 @@ void HeadlessRecorder::save_and_exit(int code) {
   QCoreApplication::exit(code);
 }
 
+void HeadlessRecorder::recover_journal() {
+  const auto journal_path =
+      state::RecordingJournal::journal_path(m_output_path);
+  if (!QFile::exists(journal_path)) {
+    return;
+  }
+
+  QTextStream out(stdout);
+  const auto recovered_path =
+      state::RecordingJournal::recovered_path(m_output_path);
+
+  state::Measurements measurements;
+  QJsonObject map;
+  std::optional<QJsonArray> wifis;
+  QString error;
+  if (!state::RecordingJournal::replay(journal_path, measurements, map, wifis,
+                                       &error) ||
+      !state::ProjectFile::save(recovered_path, state::PROJECT_FORMAT_BINARY,
+                                map, wifis, measurements, &error)) {
+    // Keep the journal under another name, it might still be recovered
+    // manually. The journal of the new recording would replace it otherwise.
+    const auto kept_path = state::RecordingJournal::move_aside(journal_path);
+    out << "Warning: Could not recover " << journal_path << " (" << error
+        << ")";
+    if (!kept_path.isEmpty()) {
+      out << ", kept it as " << kept_path;
+    }
+    out << "\n";
+    out.flush();
+    return;
+  }
+  out << "Recovered " << measurements.get_measurements().size()
+      << " measurements of an interrupted recording to " << recovered_path
+      << "\n";
+  out.flush();
+  QFile::remove(journal_path);
+}
+
+void HeadlessRecorder::start_journal() {
+  const auto journal_path =
+      state::RecordingJournal::journal_path(m_output_path);
+  if (!m_journal.open(journal_path)) {
+    QTextStream err(stderr);
+    err << "Warning: Could not create journal " << journal_path << "\n";
+    err.flush();
+    return;
+  }
+  // The journal has to be complete on its own, including loaded data
+  if (m_wifis) {
+    m_journal.set_wifis(*m_wifis);
+  }
+  if (m_robot_map.is_valid()) {
+    m_journal.set_map(m_robot_map.get_map_source(),
+                      m_robot_map.get_layers_hash());
+  }
+  for (const auto& m : m_measurements.get_measurements()) {
+    for (const auto value : m.data) {
+      m_journal.append_measurement(m.x, m.y, value, m.wifi_id);
+    }
+  }
+  m_journal.flush();
+}
+
 }  // namespace Valeronoi::cli
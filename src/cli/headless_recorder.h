@@ -22,9 +22,12 @@
 #include <QString>
 #include <QTimer>
 #include <QUrl>
+#include <optional>
 
 #include "../robot/robot.h"
 #include "../state/measurements.h"
+#include "../state/project_file.h"
+#include "../state/recording_journal.h"
 #include "../state/robot_map.h"
 
 namespace Valeronoi::cli {
@@ -38,6 +41,7 @@ class HeadlessRecorder : public QObject {
   void set_output(const QString& path);
   void set_duration(int seconds);
   void set_interval(double seconds);
+  void set_map_interval(double seconds);
   void set_url(const QString& url);
   void set_auth(const QString& username, const QString& password);
   void set_command(const QString& command);
@@ -57,9 +61,18 @@ class HeadlessRecorder : public QObject {
  private:
   void save_and_exit(int code);
 
+  // Saves a journal left behind by a previous run next to the output
+  void recover_journal();
+
+  void start_journal();
+
   Valeronoi::robot::Robot m_robot;
   Valeronoi::state::RobotMap m_robot_map;
   Valeronoi::state::Measurements m_measurements;
+  // Wifi table of a loaded file, written back unchanged
+  std::optional<QJsonArray> m_wifis;
+  // Measurements are journaled as they arrive, so a crash loses nothing
+  Valeronoi::state::RecordingJournal m_journal;
 
   QString m_output_path;
   QString m_load_path;
@@ -41,13 +41,22 @@ void FloorItem::set_floor_color(QColor color) {
 }
 
 void FloorItem::map_updated() {
-  m_floor_path.clear();
-  m_floor_path.setFillRule(Qt::WindingFill);
+  std::shared_ptr<const Valeronoi::state::Layer> floor_layer;
   if (m_robot_map.is_valid()) {
     const auto& map = m_robot_map.get_map();
     const auto floor = map.layers.find("floor");
     if (floor != map.layers.end()) {
-      for (const auto& rect : floor->second.rects) {
+      floor_layer = floor->second;
+    }
+  }
+  // Most updates only move the robot, the path is kept as long as the layer
+  // is the same
+  if (floor_layer != m_floor_layer) {
+    m_floor_layer = floor_layer;
+    m_floor_path.clear();
+    m_floor_path.setFillRule(Qt::WindingFill);
+    if (m_floor_layer) {
+      for (const auto& rect : m_floor_layer->rects) {
         m_floor_path.addRect(rect);
       }
     }
@@ -19,6 +19,7 @@
 #define VALERONOI_GUI_GRAPHICS_ITEM_FLOOR_ITEM_H
 
 #include <QPainterPath>
+#include <memory>
 
 #include "../../state/robot_map.h"
 #include "map_based_item.h"
@@ -41,6 +42,7 @@ class FloorItem : public MapBasedItem {
  private:
   QColor m_floor_color;
 
+  std::shared_ptr<const Valeronoi::state::Layer> m_floor_layer;
   QPainterPath m_floor_path;
 };
 
@@ -38,8 +38,9 @@ void MapItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option,
     painter->setRenderHints(
         QPainter::Antialiasing,
         false);  // Antialiasing the walls leads to a thin grid
-    if (!m_walls.empty()) {
-      painter->drawRects(m_walls.data(), static_cast<int>(m_walls.size()));
+    if (m_walls && !m_walls->rects.empty()) {
+      painter->drawRects(m_walls->rects.data(),
+                         static_cast<int>(m_walls->rects.size()));
     }
   } else {
     painter->setBrush(Qt::black);
@@ -57,12 +58,12 @@ void MapItem::set_wall_color(QColor color) {
 }
 
 void MapItem::map_updated() {
-  m_walls.clear();
+  m_walls.reset();
   if (m_robot_map.is_valid()) {
     const auto& map = m_robot_map.get_map();
     const auto walls = map.layers.find("wall");
     if (walls != map.layers.end()) {
-      m_walls = walls->second.rects;
+      m_walls = walls->second;
     }
   }
   MapBasedItem::map_updated();
@@ -25,7 +25,7 @@
 #endif
 
 #include <functional>
-#include <vector>
+#include <memory>
 
 #include "../../state/robot_map.h"
 #include "map_based_item.h"
@@ -51,7 +51,8 @@ class MapItem : public MapBasedItem {
  private:
   QFont m_font;
   QColor m_wall_color;
-  std::vector<QRect> m_walls;
+  // Shared with the map, so unchanged walls are not copied on every update
+  std::shared_ptr<const Valeronoi::state::Layer> m_walls;
   std::function<void(int, int)>
       m_relocate;  // This is a bit hacky, but since MapItem is not a QObject,
                    // we can't use signals/slots
@@ -18,14 +18,19 @@
 #include "measurement_item.h"
 
 #include <QPen>
+#include <QStyleOptionGraphicsItem>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "../../util/cell_clipper.h"
 
 constexpr int SCALE_FONT_SIZE{15};
 constexpr int SCALE_HISTOGRAM_HEIGHT{70};
 constexpr int SCALE_BAR_HEIGHT{30};
 constexpr int SCALE_WIDTH{200};
 constexpr int SCALE_MARGIN{5};
-constexpr int PATH_DISTANCE{35};
 constexpr QSize SCALE_SIZE{
     SCALE_WIDTH, SCALE_BAR_HEIGHT + SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT};
 
@@ -34,48 +39,228 @@ MeasurementItem::MeasurementItem(const Valeronoi::state::RobotMap& robot_map,
                                  QGraphicsItem* parent)
     : MapBasedItem(robot_map, parent), m_font("Source Code Pro") {
   m_font.setPixelSize(SCALE_FONT_SIZE);
+  // Only the exposed tiles are painted
+  setFlag(ItemUsesExtendedStyleOption);
+  QObject::connect(&m_tiles, &TileCache::signal_tile_ready, &m_tiles,
+                   [this]() { update(); });
 }
 
 void MeasurementItem::paint(QPainter* painter,
                             const QStyleOptionGraphicsItem* option,
                             QWidget* widget) {
-  (void)option;
-  (void)widget;
-  (void)painter;
   painter->setPen(Qt::transparent);
   if (m_display_mode == Valeronoi::state::DISPLAY_MODE::None ||
       m_color_map == nullptr || m_min >= m_max) {
     return;
   }
   if (m_robot_map.is_valid()) {
-    if (m_display_mode == Valeronoi::state::DISPLAY_MODE::Voronoi) {
-      // Rendering Voronoi segments with antialiasing leads to artifacts
-      painter->setRenderHints(QPainter::Antialiasing, false);
-      painter->setClipRect(MapBasedItem::boundingRect(), Qt::ReplaceClip);
-      if (m_restrict_path) {
-        painter->setClipPath(m_path, Qt::IntersectClip);
-      }
-      if (m_restrict_points) {
-        painter->setClipPath(m_points_path, Qt::IntersectClip);
+    if (m_display_mode == Valeronoi::state::DISPLAY_MODE::DataPoints ||
+        m_data_segments->preview) {
+      if (m_segment_index) {
+        // Exports paint everything
+        const auto area = widget != nullptr
+                              ? option->exposedRect.toAlignedRect()
+                              : m_segment_index->points.bounds();
+        std::vector<int> visible;
+        m_segment_index->points.query(area, visible);
+        for (const auto i : visible) {
+          const auto& p = m_data_segments->positions[i];
+          painter->setBrush(QColor::fromRgb(m_colors[i]));
+          painter->drawEllipse(p.x() - 2, p.y() - 2, 4, 4);
+        }
       }
-
-      for (const auto& p : m_data_segments) {
-        painter->setBrush(p.color);
-        painter->drawPolygon(p.polygon);
-      }
-    } else if (m_display_mode == Valeronoi::state::DISPLAY_MODE::DataPoints) {
-      for (const auto& p : m_data_segments) {
-        painter->setBrush(p.color);
-        painter->drawEllipse(p.x - 2, p.y - 2, 4, 4);
+    } else if (m_display_mode == Valeronoi::state::DISPLAY_MODE::Voronoi ||
+               Valeronoi::state::is_raster_mode(m_display_mode)) {
+      const auto bounds = MapBasedItem::boundingRect();
+      if (m_heatmap && widget != nullptr) {
+        m_tiles.draw(painter, option->exposedRect & bounds);
+      } else if (m_heatmap) {
+        // Exports are painted directly, so vector formats get vectors
+        painter->save();
+        paint_heatmap(*painter, *m_heatmap, bounds.toAlignedRect());
+        painter->restore();
       }
     }
 
     painter->setClipRect(boundingRect(), Qt::ReplaceClip);
     const auto& map = m_robot_map.get_map();
-    const auto base_y = map.size_y + SCALE_MARGIN;
-    if (!m_legend.isNull()) {
-      painter->drawPicture(QPoint(SCALE_MARGIN, base_y), m_legend);
+    const auto legend_rect =
+        QRectF(SCALE_MARGIN, map.size_y + SCALE_MARGIN,
+               SCALE_WIDTH + 2 * SCALE_MARGIN,
+               SCALE_SIZE.height() + 2 * SCALE_MARGIN);
+    if (widget == nullptr || option->exposedRect.intersects(legend_rect)) {
+      painter->save();
+      painter->translate(legend_rect.topLeft());
+      paint_legend(*painter);
+      painter->restore();
+    }
+  }
+}
+
+void MeasurementItem::paint_legend(QPainter& painter) const {
+  painter.setFont(m_font);
+  painter.setBrush(Qt::black);
+  painter.setPen(Qt::transparent);
+  painter.drawRect(0, 0, SCALE_WIDTH + 2 * SCALE_MARGIN,
+                   SCALE_SIZE.height() + 2 * SCALE_MARGIN);
+
+  if (m_histogram_max > 0) {
+    for (const auto& bar : m_histogram_bars) {
+      if (bar.count > 0) {
+        painter.setBrush(bar.color);
+        painter.drawRect(bar.rect);
+      }
+    }
+    painter.setBrush(Qt::transparent);
+    painter.setPen(QPen(Qt::white, 1));
+    painter.drawRect(SCALE_MARGIN, SCALE_MARGIN, SCALE_WIDTH,
+                     SCALE_HISTOGRAM_HEIGHT);
+  }
+
+  const auto bar_rect =
+      QRect(SCALE_MARGIN, 2 * SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT,
+            SCALE_WIDTH, SCALE_BAR_HEIGHT / 3);
+  // One pixel per column, stretched to the height of the bar
+  painter.drawImage(bar_rect, m_gradient);
+  painter.setBrush(Qt::transparent);
+  painter.setPen(QPen(Qt::white, 1));
+  painter.drawRect(bar_rect);
+  painter.drawText(
+      SCALE_MARGIN,
+      2 * SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT + SCALE_BAR_HEIGHT / 3,
+      SCALE_WIDTH / 2, (SCALE_BAR_HEIGHT / 3) * 2, Qt::AlignTop,
+      QString::number(m_min, 'f', 1).append(value_unit()));
+  painter.drawText(
+      SCALE_MARGIN + SCALE_WIDTH / 2,
+      2 * SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT + SCALE_BAR_HEIGHT / 3,
+      SCALE_WIDTH / 2, (SCALE_BAR_HEIGHT / 3) * 2,
+      Qt::AlignTop | Qt::AlignRight,
+      QString::number(m_max, 'f', 1).append(value_unit()));
+}
+
+void MeasurementItem::update_legend() {
+  if (!m_color_map || m_max <= m_min) {
+    m_histogram_bars.clear();
+    return;
+  }
+  if (m_gradient_color_map != m_color_map) {
+    m_gradient = QImage(SCALE_WIDTH, 1, QImage::Format_RGB32);
+    auto* line = reinterpret_cast<std::uint32_t*>(m_gradient.scanLine(0));
+    for (int x = 0; x < SCALE_WIDTH; x++) {
+      line[x] = m_color_map->get_rgb(static_cast<double>(x) / SCALE_WIDTH);
+    }
+    m_gradient_color_map = m_color_map;
+  }
+
+  // As long as the scale stays the same, only the bins whose count changed
+  // get a new bar. Each new extreme value moves all of them.
+  const bool relayout = m_histogram_bars.size() != m_histogram.size() ||
+                        m_bars_min != m_min || m_bars_max != m_max ||
+                        m_bars_histogram_max != m_histogram_max ||
+                        m_bars_color_map != m_color_map;
+  if (relayout) {
+    m_histogram_bars.assign(m_histogram.size(), HistogramBar());
+    m_bars_min = m_min;
+    m_bars_max = m_max;
+    m_bars_histogram_max = m_histogram_max;
+    m_bars_color_map = m_color_map;
+  }
+  const auto int_min = static_cast<int>(m_min);
+  const auto bar_width = static_cast<double>(SCALE_WIDTH) /
+                         static_cast<double>(m_histogram.size());
+  for (std::size_t i = 0; i < m_histogram.size(); i++) {
+    auto& bar = m_histogram_bars[i];
+    if (!relayout && bar.count == m_histogram[i]) {
+      continue;
     }
+    bar.count = m_histogram[i];
+    const auto height = m_histogram_max > 0
+                            ? SCALE_HISTOGRAM_HEIGHT *
+                                  static_cast<double>(bar.count) /
+                                  m_histogram_max
+                            : 0.0;
+    bar.rect = QRectF(SCALE_MARGIN + bar_width * static_cast<double>(i),
+                      SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT - height,
+                      bar_width, height);
+    bar.color = get_color(int_min + static_cast<int>(i));
+  }
+}
+
+void MeasurementItem::paint_heatmap(QPainter& painter, const Heatmap& heatmap,
+                                    const QRect& area) {
+  // Rendering Voronoi segments with antialiasing leads to artifacts
+  painter.setRenderHints(QPainter::Antialiasing, false);
+  painter.setPen(Qt::transparent);
+  painter.setClipRect(heatmap.bounds, Qt::IntersectClip);
+  if (heatmap.display_mode == Valeronoi::state::DISPLAY_MODE::Voronoi) {
+    // The segment generator already clipped the cells
+    std::vector<int> visible;
+    heatmap.index->parts.query(area, visible);
+    int brush_segment{-1};
+    for (const auto part : visible) {
+      const auto segment = heatmap.index->part_segments[part];
+      if (segment != brush_segment) {
+        painter.setBrush(QColor::fromRgb(heatmap.colors[segment]));
+        brush_segment = segment;
+      }
+      const auto polygon = heatmap.segments->part(part);
+      painter.drawPolygon(polygon.points, polygon.size);
+    }
+  } else {
+    if (heatmap.restrict_path) {
+      painter.setClipPath(heatmap.path, Qt::IntersectClip);
+    }
+    if (heatmap.restrict_points) {
+      painter.setClipPath(heatmap.points_path, Qt::IntersectClip);
+    }
+    painter.drawImage(heatmap.raster_rect, heatmap.raster_image);
+  }
+}
+
+void MeasurementItem::update_heatmap() {
+  // Previews are painted as data points
+  const bool voronoi =
+      m_display_mode == Valeronoi::state::DISPLAY_MODE::Voronoi &&
+      m_segment_index && !m_data_segments->preview;
+  const bool raster = Valeronoi::state::is_raster_mode(m_display_mode) &&
+                      m_raster && !m_raster_image.isNull() &&
+                      !m_data_segments->preview;
+  if ((!voronoi && !raster) || !m_color_map || m_min >= m_max) {
+    m_heatmap.reset();
+    m_tiles.invalidate({});
+    update();
+    return;
+  }
+  auto heatmap = std::make_shared<Heatmap>();
+  heatmap->display_mode = m_display_mode;
+  heatmap->bounds = MapBasedItem::boundingRect();
+  if (voronoi) {
+    heatmap->segments = m_data_segments;
+    heatmap->colors = m_colors;
+    heatmap->index = m_segment_index;
+  } else {
+    heatmap->raster_rect = QRectF(m_raster->x, m_raster->y,
+                                  m_raster->width * m_raster->pixel_size,
+                                  m_raster->height * m_raster->pixel_size);
+    heatmap->raster_image = m_raster_image;
+  }
+  heatmap->restrict_path = m_restrict_path;
+  heatmap->restrict_points = m_restrict_points;
+  heatmap->path = m_path;
+  heatmap->points_path = m_points_path;
+  m_heatmap = heatmap;
+  m_tiles.invalidate([heatmap = m_heatmap](QPainter& painter,
+                                           const QRect& area) {
+    paint_heatmap(painter, *heatmap, area);
+  });
+  update();
+}
+
+void MeasurementItem::map_updated() {
+  const auto bounds = m_map_bounds;
+  MapBasedItem::map_updated();
+  if (bounds != m_map_bounds) {
+    update_heatmap();
   }
 }
 
@@ -92,9 +277,7 @@ void MeasurementItem::set_color_map(
 }
 
 QColor MeasurementItem::color_value(double normalized_value) const {
-  auto color = m_color_map->get_color(normalized_value);
-  return {static_cast<int>(255 * color[0]), static_cast<int>(255 * color[1]),
-          static_cast<int>(255 * color[2])};
+  return QColor::fromRgb(m_color_map->get_rgb(normalized_value));
 }
 
 QColor MeasurementItem::get_color(double value) const {
@@ -105,109 +288,156 @@ QColor MeasurementItem::get_color(double value) const {
   return color_value(normalized);
 }
 
-void MeasurementItem::set_data_segments(const state::DataSegments& segments) {
+void MeasurementItem::set_data_segments(
+    const Valeronoi::state::DataSegmentsPtr& segments) {
   m_points_path.clear();
   m_points_path.setFillRule(Qt::WindingFill);
-  m_data_segments = segments;
+  m_data_segments =
+      segments ? segments
+               : std::make_shared<const Valeronoi::state::DataSegments>();
+  const auto& data = *m_data_segments;
   m_min = 0.0;
   m_max = -100.0;
-  m_histogram.clear();
-  m_histogram_max = 0;
-  for (const auto& s : m_data_segments) {
-    m_min = std::min(m_min, s.value);
-    m_max = std::max(m_max, s.value);
-    const auto int_value = static_cast<int>(s.value);
-    m_histogram[int_value] += 1;
-    m_histogram_max = std::max(m_histogram_max, m_histogram[int_value]);
-    m_points_path.addRect(s.x - PATH_DISTANCE, s.y - PATH_DISTANCE,
-                          2 * PATH_DISTANCE, 2 * PATH_DISTANCE);
+  for (const auto value : data.values) {
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+  }
+  for (const auto& p : data.positions) {
+    m_points_path.addRect(p.x() - Valeronoi::util::CLIP_POINT_DISTANCE,
+                          p.y() - Valeronoi::util::CLIP_POINT_DISTANCE,
+                          2 * Valeronoi::util::CLIP_POINT_DISTANCE,
+                          2 * Valeronoi::util::CLIP_POINT_DISTANCE);
   }
-  calculate_colors();
-}
 
-void MeasurementItem::calculate_colors() {
-  for (auto& s : m_data_segments) {
-    s.color = get_color(s.value);
-  }
-  if (m_color_map && m_max > m_min && m_robot_map.is_valid()) {
-    QPainter painter;
-    painter.begin(&m_legend);
-    painter.setFont(m_font);
-
-    painter.setBrush(Qt::black);
-    painter.setPen(Qt::transparent);
-    painter.drawRect(0, 0, SCALE_WIDTH + 2 * SCALE_MARGIN,
-                     SCALE_SIZE.height() + 2 * SCALE_MARGIN);
-
-    if (m_histogram_max > 0) {
-      painter.setPen(Qt::transparent);
-      const auto int_max = static_cast<int>(m_max);
-      const auto int_min = static_cast<int>(m_min);
-      const auto bar_width =
-          static_cast<double>(SCALE_WIDTH) / (int_max - int_min + 1);
-      std::for_each(
-          m_histogram.begin(), m_histogram.end(), [&](const auto values) {
-            const auto bin = values.first;
-            const auto count = values.second;
-            const auto height = SCALE_HISTOGRAM_HEIGHT *
-                                static_cast<double>(count) / m_histogram_max;
-            const auto x = SCALE_MARGIN + bar_width * (bin - int_min);
-            auto bin_rect =
-                QRectF(x, SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT - height,
-                       bar_width, height);
-            painter.setBrush(get_color(bin));
-            painter.drawRect(bin_rect);
-          });
-      painter.setBrush(Qt::transparent);
-      painter.setPen(QPen(Qt::white, 1));
-      painter.drawRect(SCALE_MARGIN, SCALE_MARGIN, SCALE_WIDTH,
-                       SCALE_HISTOGRAM_HEIGHT);
+  auto index = std::make_shared<SegmentIndex>();
+  std::vector<QRect> part_rects, point_rects;
+  point_rects.reserve(data.positions.size());
+  part_rects.reserve(static_cast<std::size_t>(data.part_count()));
+  index->part_segments.reserve(static_cast<std::size_t>(data.part_count()));
+  for (int i = 0; i < data.size(); i++) {
+    const auto& p = data.positions[i];
+    point_rects.emplace_back(p.x() - 2, p.y() - 2, 5, 5);
+    for (int part = data.first_part[i]; part < data.first_part[i + 1];
+         part++) {
+      part_rects.push_back(data.part(part).bounding_rect());
+      index->part_segments.push_back(i);
     }
+  }
+  index->parts = Valeronoi::util::RectIndex(std::move(part_rects));
+  index->points = Valeronoi::util::RectIndex(std::move(point_rects));
+  m_segment_index = index;
 
-    painter.setPen(Qt::transparent);
+  const bool variance =
+      m_display_mode == Valeronoi::state::DISPLAY_MODE::KrigingVariance &&
+      m_raster;
+  if (variance) {
+    // The legend shows the variance, not the measured values
+    m_min = 0.0;
+    m_max = 0.0;
+    for (const auto value : m_raster->values) {
+      if (!std::isnan(value)) {
+        m_max = std::max(m_max, static_cast<double>(value));
+      }
+    }
+  }
 
-    for (int x = 0; x < SCALE_WIDTH; x++) {
-      painter.setBrush(color_value(static_cast<double>(x) / SCALE_WIDTH));
-      painter.drawRect(x + SCALE_MARGIN,
-                       2 * SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT, 1,
-                       SCALE_BAR_HEIGHT / 3);
+  // One bin per whole unit, starting at static_cast<int>(m_min), so the bins
+  // line up with the bars of the legend
+  const auto int_min = static_cast<int>(m_min);
+  m_histogram.assign(static_cast<std::size_t>(std::max(
+                         static_cast<int>(m_max) - int_min + 1, 0)),
+                     0);
+  const auto count = [&](double value) {
+    m_histogram[static_cast<std::size_t>(static_cast<int>(value) - int_min)]++;
+  };
+  if (variance) {
+    for (const auto value : m_raster->values) {
+      if (!std::isnan(value)) {
+        count(value);
+      }
+    }
+  } else {
+    for (const auto value : data.values) {
+      count(value);
     }
-    painter.setBrush(Qt::transparent);
-    painter.setPen(QPen(Qt::white, 1));
-    painter.drawRect(SCALE_MARGIN, 2 * SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT,
-                     SCALE_WIDTH, SCALE_BAR_HEIGHT / 3);
-    painter.drawText(
-        SCALE_MARGIN,
-        2 * SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT + SCALE_BAR_HEIGHT / 3,
-        SCALE_WIDTH / 2, (SCALE_BAR_HEIGHT / 3) * 2, Qt::AlignTop,
-        QString::number(m_min, 'f', 1).append(" dBm"));
-    painter.drawText(
-        SCALE_MARGIN + SCALE_WIDTH / 2,
-        2 * SCALE_MARGIN + SCALE_HISTOGRAM_HEIGHT + SCALE_BAR_HEIGHT / 3,
-        SCALE_WIDTH / 2, (SCALE_BAR_HEIGHT / 3) * 2,
-        Qt::AlignTop | Qt::AlignRight,
-        QString::number(m_max, 'f', 1).append(" dBm"));
-
-    painter.end();
   }
-  update();
+  m_histogram_max =
+      m_histogram.empty()
+          ? 0
+          : *std::max_element(m_histogram.begin(), m_histogram.end());
+  calculate_colors();
+}
+
+QString MeasurementItem::value_unit() const {
+  return m_display_mode == Valeronoi::state::DISPLAY_MODE::KrigingVariance
+             ? QStringLiteral(" dB²")
+             : QStringLiteral(" dBm");
+}
+
+void MeasurementItem::set_raster(
+    const Valeronoi::state::InterpolatedRasterPtr& raster) {
+  m_raster = raster;
+  // The image is colored once the matching segments (and thus the value
+  // range) arrive
+}
+
+void MeasurementItem::calculate_raster_image() {
+  if (!m_raster || m_raster->values.empty() ||
+      !Valeronoi::state::is_raster_mode(m_display_mode) ||
+      !m_color_map || m_max <= m_min) {
+    m_raster_image = QImage();
+    return;
+  }
+  // Opaque colors and transparent NaN are the same premultiplied
+  m_raster_image = QImage(m_raster->width, m_raster->height,
+                          QImage::Format_ARGB32_Premultiplied);
+  const auto width = static_cast<std::size_t>(m_raster->width);
+  for (int y = 0; y < m_raster->height; y++) {
+    m_color_map->map_values(
+        m_raster->values.data() + static_cast<std::size_t>(y) * width,
+        reinterpret_cast<std::uint32_t*>(m_raster_image.scanLine(y)), width,
+        m_min, m_max);
+  }
+}
+
+void MeasurementItem::calculate_colors() {
+  const auto& values = m_data_segments->values;
+  if (m_color_map && m_max > m_min) {
+    m_colors.resize(values.size());
+    m_color_map->map_values(values.data(), m_colors.data(), values.size(),
+                            m_min, m_max);
+  } else {
+    m_colors.assign(values.size(), qRgb(0, 0, 0));
+  }
+  calculate_raster_image();
+  update_legend();
+  update_heatmap();
 }
 
 void MeasurementItem::set_restrict_path(bool enabled) {
-  m_restrict_path = enabled;
-  update();
+  if (enabled != m_restrict_path) {
+    m_restrict_path = enabled;
+    update_heatmap();
+  }
 }
 
 void MeasurementItem::set_restrict_path(const QPainterPath& path) {
+  // Called with every map update, usually with the same shared path, which
+  // compares cheaply
+  if (m_restrict_path && path == m_path) {
+    return;
+  }
   m_path = path;
   m_path.setFillRule(Qt::WindingFill);
   m_restrict_path = true;
-  update();
+  update_heatmap();
 }
 
 void MeasurementItem::set_restrict_points(bool enabled) {
-  m_restrict_points = enabled;
-  update();
+  if (enabled != m_restrict_points) {
+    m_restrict_points = enabled;
+    update_heatmap();
+  }
 }
 
 QRectF MeasurementItem::boundingRect() const {
@@ -19,14 +19,17 @@
 #define VALERONOI_GUI_GRAPHICS_ITEM_MEASUREMENT_ITEM_H
 
 #include <QFont>
-#include <QPicture>
-#include <unordered_map>
+#include <QImage>
+#include <memory>
+#include <vector>
 
 #include "../../state/measurements.h"
 #include "../../state/robot_map.h"
 #include "../../state/state.h"
 #include "../../util/colormap.h"
+#include "../../util/rect_index.h"
 #include "map_based_item.h"
+#include "tile_cache.h"
 
 namespace Valeronoi::gui::graphics_item {
 
@@ -38,7 +41,9 @@ class MeasurementItem : public MapBasedItem {
   void paint(QPainter* painter, const QStyleOptionGraphicsItem* option,
              QWidget* widget) override;
 
-  void set_data_segments(const Valeronoi::state::DataSegments& segments);
+  void set_data_segments(const Valeronoi::state::DataSegmentsPtr& segments);
+
+  void set_raster(const Valeronoi::state::InterpolatedRasterPtr& raster);
 
   void set_display_mode(Valeronoi::state::DISPLAY_MODE display_mode);
 
@@ -52,15 +57,58 @@ class MeasurementItem : public MapBasedItem {
 
   [[nodiscard]] QRectF boundingRect() const override;
 
+  void map_updated() override;
+
  private:
+  // Bounding boxes of the data segments, to only paint the visible ones
+  struct SegmentIndex {
+    // Clipped parts of the Voronoi cells, in the order of the segments, and
+    // the segment each of them belongs to
+    Valeronoi::util::RectIndex parts;
+    std::vector<int> part_segments;
+    // Data points, in the order of the segments
+    Valeronoi::util::RectIndex points;
+  };
+
+  // Everything the Voronoi cells or the raster are painted from. Immutable,
+  // so tiles can be rendered from it on worker threads.
+  struct Heatmap {
+    Valeronoi::state::DISPLAY_MODE display_mode;
+    QRectF bounds;
+    Valeronoi::state::DataSegmentsPtr segments;
+    std::vector<QRgb> colors;
+    std::shared_ptr<const SegmentIndex> index;
+    QRectF raster_rect;
+    QImage raster_image;
+    bool restrict_path, restrict_points;
+    QPainterPath path, points_path;
+  };
+
+  static void paint_heatmap(QPainter& painter, const Heatmap& heatmap,
+                            const QRect& area);
+
+  // Replaces the heatmap and drops all tiles rendered from the old one
+  void update_heatmap();
+
   void calculate_colors();
 
   [[nodiscard]] QColor get_color(double value) const;
 
   [[nodiscard]] QColor color_value(double normalized_value) const;
 
+  void calculate_raster_image();
+
+  [[nodiscard]] QString value_unit() const;
+
+  // Paints the legend with its top left corner at the origin
+  void paint_legend(QPainter& painter) const;
+
+  // Brings the gradient and the histogram bars up to date
+  void update_legend();
+
   double m_min{0.0}, m_max{0.0};
-  std::unordered_map<int, int> m_histogram;
+  // Counts per whole unit, starting at static_cast<int>(m_min)
+  std::vector<int> m_histogram;
   int m_histogram_max{0};
 
   const Valeronoi::util::RGBColorMap* m_color_map{nullptr};
@@ -68,12 +116,35 @@ class MeasurementItem : public MapBasedItem {
   Valeronoi::state::DISPLAY_MODE m_display_mode{
       Valeronoi::state::DISPLAY_MODE::Voronoi};
 
-  Valeronoi::state::DataSegments m_data_segments;
+  Valeronoi::state::DataSegmentsPtr m_data_segments{
+      std::make_shared<const Valeronoi::state::DataSegments>()};
+  // Color of each data segment
+  std::vector<QRgb> m_colors;
+  Valeronoi::state::InterpolatedRasterPtr m_raster;
+  QImage m_raster_image;
 
   bool m_restrict_path{true}, m_restrict_points{true};
   QPainterPath m_path, m_points_path;
   QFont m_font;
-  QPicture m_legend;
+
+  // The gradient of the legend, one pixel per column
+  QImage m_gradient;
+  const Valeronoi::util::RGBColorMap* m_gradient_color_map{nullptr};
+
+  struct HistogramBar {
+    QRectF rect;
+    QColor color;
+    int count{0};
+  };
+  // One bar per bin of m_histogram, laid out for the scale below
+  std::vector<HistogramBar> m_histogram_bars;
+  double m_bars_min{0.0}, m_bars_max{0.0};
+  int m_bars_histogram_max{0};
+  const Valeronoi::util::RGBColorMap* m_bars_color_map{nullptr};
+
+  std::shared_ptr<const SegmentIndex> m_segment_index;
+  std::shared_ptr<const Heatmap> m_heatmap;
+  TileCache m_tiles;
 };
 
 }  // namespace Valeronoi::gui::graphics_item
@@ -0,0 +1,155 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "tile_cache.h"
+
+#include <QPaintDevice>
+#include <QRegion>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+
+namespace Valeronoi::gui::graphics_item {
+
+TileCache::TileCache(QObject* parent) : QObject(parent) {
+  m_pool.setThreadPriority(QThread::LowPriority);
+}
+
+TileCache::~TileCache() {
+  m_pool.clear();
+  m_pool.waitForDone();
+}
+
+// Edge length of the tiles of a level in map units
+static int tile_size(int level) {
+  return level >= 0 ? TILE_SIZE >> level : TILE_SIZE << -level;
+}
+
+QRect TileCache::tile_rect(const TileKey& key) {
+  const int size = tile_size(key.level);
+  return {key.column * size, key.row * size, size, size};
+}
+
+void TileCache::invalidate(Renderer renderer) {
+  m_renderer = std::move(renderer);
+  // Running jobs finish, but their tiles are discarded
+  m_generation++;
+  m_pool.clear();
+  m_pending.clear();
+  m_tiles.clear();
+}
+
+void TileCache::draw(QPainter* painter, const QRectF& area) {
+  if (!m_renderer || area.isEmpty()) {
+    return;
+  }
+  const auto transform = painter->worldTransform();
+  const auto scale = std::hypot(transform.m11(), transform.m12()) *
+                     painter->device()->devicePixelRatioF();
+  if (scale <= 0.0) {
+    return;
+  }
+  // Tiles are only ever scaled down, by less than half
+  const int level =
+      std::clamp(static_cast<int>(std::ceil(std::log2(scale))),
+                 TILE_MIN_LEVEL, TILE_MAX_LEVEL);
+  const int size = tile_size(level);
+  const int column_start = static_cast<int>(std::floor(area.left() / size));
+  const int column_end = static_cast<int>(std::ceil(area.right() / size));
+  const int row_start = static_cast<int>(std::floor(area.top() / size));
+  const int row_end = static_cast<int>(std::ceil(area.bottom() / size));
+
+  m_frame++;
+  painter->save();
+  // Antialiased tile edges would leave visible seams
+  painter->setRenderHint(QPainter::Antialiasing, false);
+  QRegion missing;
+  for (int row = row_start; row < row_end; row++) {
+    for (int column = column_start; column < column_end; column++) {
+      const TileKey key{level, column, row};
+      const auto tile = m_tiles.find(key);
+      if (tile != m_tiles.end()) {
+        tile->second.last_used = m_frame;
+        painter->drawImage(QRectF(tile_rect(key)), tile->second.image);
+      } else {
+        missing += tile_rect(key);
+        request(key);
+      }
+    }
+  }
+  if (!missing.isEmpty()) {
+    painter->setClipRegion(missing, Qt::IntersectClip);
+    m_renderer(*painter, missing.boundingRect());
+  }
+  painter->restore();
+}
+
+void TileCache::request(const TileKey& key) {
+  if (!m_pending.insert(key).second) {
+    return;
+  }
+  m_pool.start([this, key, renderer = m_renderer,
+                generation = m_generation.load()]() {
+    if (generation != m_generation) {
+      return;
+    }
+    QImage image(TILE_SIZE, TILE_SIZE, QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    const auto area = tile_rect(key);
+    const auto scale = static_cast<qreal>(TILE_SIZE) / area.width();
+    painter.scale(scale, scale);
+    painter.translate(-area.topLeft());
+    painter.setClipRect(area);
+    renderer(painter, area);
+    painter.end();
+    QMetaObject::invokeMethod(
+        this,
+        [this, key, generation, image]() {
+          tile_rendered(key, generation, image);
+        },
+        Qt::QueuedConnection);
+  });
+}
+
+void TileCache::tile_rendered(const TileKey& key, quint64 generation,
+                              const QImage& image) {
+  if (generation != m_generation) {
+    return;
+  }
+  m_pending.erase(key);
+  m_tiles[key] = {image, m_frame};
+  // Drop the tiles that have not been visible for the longest time, but
+  // never the ones of the current frame
+  while (m_tiles.size() > TILE_CACHE_SIZE) {
+    auto oldest = m_tiles.end();
+    for (auto it = m_tiles.begin(); it != m_tiles.end(); ++it) {
+      if (it->second.last_used < m_frame &&
+          (oldest == m_tiles.end() ||
+           it->second.last_used < oldest->second.last_used)) {
+        oldest = it;
+      }
+    }
+    if (oldest == m_tiles.end()) {
+      break;
+    }
+    m_tiles.erase(oldest);
+  }
+  emit signal_tile_ready();
+}
+
+}  // namespace Valeronoi::gui::graphics_item
@@ -0,0 +1,101 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_GUI_GRAPHICS_ITEM_TILE_CACHE_H
+#define VALERONOI_GUI_GRAPHICS_ITEM_TILE_CACHE_H
+
+#include <QImage>
+#include <QObject>
+#include <QPainter>
+#include <QRect>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <set>
+#include <tuple>
+
+namespace Valeronoi::gui::graphics_item {
+
+// Edge length of a tile in device pixels
+constexpr int TILE_SIZE{256};
+// Zoom levels, a tile of level n covers TILE_SIZE / 2^n map units. Level 8
+// is more than the maximum zoom, and all levels have whole-numbered tiles.
+constexpr int TILE_MIN_LEVEL{-4};
+constexpr int TILE_MAX_LEVEL{8};
+// Tiles not visible in the last frame are dropped beyond this, 64 MiB
+constexpr std::size_t TILE_CACHE_SIZE{256};
+
+// Renders a layer into tiles per zoom level on worker threads, so repaints
+// while panning only blit images. Tiles not rendered yet are painted
+// directly until they are ready.
+class TileCache : public QObject {
+  Q_OBJECT
+ public:
+  // Paints the layer in map coordinates. area is the part that is needed, it
+  // is called from worker threads and has to be thread safe.
+  typedef std::function<void(QPainter& painter, const QRect& area)> Renderer;
+
+  explicit TileCache(QObject* parent = nullptr);
+
+  ~TileCache() override;
+
+  // Drops all tiles, everything is rendered with renderer from now on. An
+  // empty renderer paints nothing.
+  void invalidate(Renderer renderer);
+
+  // Paints area of the layer, with the transformation of painter
+  void draw(QPainter* painter, const QRectF& area);
+
+ signals:
+  // A tile was rendered, the layer should be repainted
+  void signal_tile_ready();
+
+ private:
+  struct TileKey {
+    int level, column, row;
+
+    bool operator<(const TileKey& other) const {
+      return std::tie(level, column, row) <
+             std::tie(other.level, other.column, other.row);
+    }
+  };
+
+  struct Tile {
+    QImage image;
+    quint64 last_used{0};
+  };
+
+  // Map area covered by a tile
+  static QRect tile_rect(const TileKey& key);
+
+  void request(const TileKey& key);
+
+  void tile_rendered(const TileKey& key, quint64 generation,
+                     const QImage& image);
+
+  Renderer m_renderer;
+  std::atomic<quint64> m_generation{0};
+  quint64 m_frame{0};
+  std::map<TileKey, Tile> m_tiles;
+  std::set<TileKey> m_pending;
+  QThreadPool m_pool;
+};
+
+}  // namespace Valeronoi::gui::graphics_item
+
+#endif
@@ -28,7 +28,9 @@ namespace Valeronoi::gui::widget {
 DisplayWidget::DisplayWidget(const Valeronoi::state::RobotMap& robot_map,
                              const Valeronoi::state::Measurements& measurements,
                              QWidget* parent)
-    : QGraphicsView(parent), m_measurements{measurements} {
+    : QGraphicsView(parent),
+      m_robot_map{robot_map},
+      m_measurements{measurements} {
   setScene(new QGraphicsScene(this));
   setTransformationAnchor(AnchorUnderMouse);
   setDragMode(ScrollHandDrag);
@@ -64,6 +66,24 @@ DisplayWidget::DisplayWidget(const Valeronoi::state::RobotMap& robot_map,
   m_antialiasing = settings.value("display/antialiasing", true).toBool();
   m_simplify = settings.value("display/simplify", 2).toInt();
 
+  // While recording, every measurement asks for a regeneration
+  m_generation_scheduler.set_delay(std::chrono::milliseconds(
+      settings
+          .value("display/generationDelay",
+                 static_cast<int>(Valeronoi::util::GENERATION_DELAY.count()))
+          .toInt()));
+  m_generation_scheduler.set_max_latency(std::chrono::milliseconds(
+      settings
+          .value("display/generationMaxLatency",
+                 static_cast<int>(
+                     Valeronoi::util::GENERATION_MAX_LATENCY.count()))
+          .toInt()));
+  m_segment_generator.set_max_latency(
+      m_generation_scheduler.get_max_latency());
+  connect(&m_generation_scheduler,
+          &Valeronoi::util::GenerationScheduler::signal_generate, this,
+          [=]() { generate(); });
+
 #ifdef QT_NO_OPENGL
   m_use_opengl = false;
 #endif
@@ -84,12 +104,23 @@ DisplayWidget::DisplayWidget(const Valeronoi::state::RobotMap& robot_map,
       tr("Scroll to zoom, click and drag to pan, and right-click for more "
          "actions"));
 
+  connect(&m_segment_generator,
+          &Valeronoi::util::SegmentGenerator::generated_raster, this,
+          [=](const Valeronoi::state::InterpolatedRasterPtr& raster) {
+            m_measurement_item->set_raster(raster);
+          });
   connect(&m_segment_generator,
           &Valeronoi::util::SegmentGenerator::generated_segments, this,
-          [=](const Valeronoi::state::DataSegments& segments) {
-            qDebug() << "Calculated new Voronoi segments";
+          [=](const Valeronoi::state::DataSegmentsPtr& segments) {
             m_measurement_item->set_data_segments(segments);
           });
+  connect(&m_segment_generator,
+          &Valeronoi::util::SegmentGenerator::generated_statistics, this,
+          [=](qint64 latency_ms, int restarts) {
+            qDebug().nospace() << "Calculated new Voronoi segments in "
+                               << latency_ms << " ms (" << restarts
+                               << " restarts)";
+          });
 
   slot_map_updated();
 }
@@ -174,16 +205,49 @@ void DisplayWidget::slot_map_updated() {
   m_entity_item->map_updated();
   m_measurement_item->map_updated();
 
+  if (m_robot_map.is_valid()) {
+    m_segment_generator.set_pixel_size(m_robot_map.get_map().pixel_size);
+  }
+
   m_floor_path = m_floor_item->get_floor_path();
   if (m_restrict_floor) {
     m_measurement_item->set_restrict_path(m_floor_path);
   } else {
     m_measurement_item->set_restrict_path(false);
   }
+  update_floor_mask();
   slot_update_map_rect();
 }
 
+void DisplayWidget::update_floor_mask() {
+  std::shared_ptr<const Valeronoi::state::Layer> mask;
+  if (m_restrict_floor && m_robot_map.is_valid()) {
+    const auto& layers = m_robot_map.get_map().layers;
+    if (const auto floor = layers.find("floor"); floor != layers.end()) {
+      mask = floor->second;
+    }
+  }
+  if (mask == m_floor_mask) {
+    return;
+  }
+  // Voronoi cells are clipped to the floor and interpolation skips
+  // everything off the floor, which has to be redone once the floor changes
+  m_floor_mask = mask;
+  m_segment_generator.set_mask(m_floor_mask);
+  if (m_display_mode == Valeronoi::state::DISPLAY_MODE::Voronoi ||
+      Valeronoi::state::is_raster_mode(m_display_mode)) {
+    // Mostly follows map updates, which arrive in bursts
+    m_generation_scheduler.request();
+  }
+}
+
 void DisplayWidget::slot_measurements_updated() {
+  m_generation_scheduler.request();
+}
+
+void DisplayWidget::regenerate() { m_generation_scheduler.request_now(); }
+
+void DisplayWidget::generate() {
   const auto& measurements = m_measurements.get_measurements();
   qDebug() << "Requesting generation of Voronoi segments";
   m_segment_generator.generate(measurements, m_display_mode, m_simplify,
@@ -197,7 +261,7 @@ void DisplayWidget::slot_set_display_mode(int display_mode) {
   }
   m_display_mode = static_cast<Valeronoi::state::DISPLAY_MODE>(display_mode);
   m_measurement_item->set_display_mode(m_display_mode);
-  slot_measurements_updated();
+  regenerate();
 }
 
 void DisplayWidget::set_opengl(bool enabled) {
@@ -246,12 +310,18 @@ void DisplayWidget::set_restrict_floor(bool enabled) {
   } else {
     m_measurement_item->set_restrict_path(false);
   }
+  update_floor_mask();
   update();
 }
 
 void DisplayWidget::set_restrict_path(bool enabled) {
+  const bool changed = enabled != m_restrict_path;
   m_restrict_path = enabled;
   m_measurement_item->set_restrict_points(m_restrict_path);
+  m_segment_generator.set_restrict_points(m_restrict_path);
+  if (changed && m_display_mode == Valeronoi::state::DISPLAY_MODE::Voronoi) {
+    regenerate();
+  }
   update();
 }
 
@@ -269,7 +339,7 @@ void DisplayWidget::slot_set_simplify(int value) {
     QSettings settings;
     m_simplify = new_value;
     settings.setValue("display/simplify", m_simplify);
-    slot_measurements_updated();
+    regenerate();
   }
 }
 
@@ -278,7 +348,7 @@ int DisplayWidget::get_wifi_id_filter() const { return m_wifi_id_filter; }
 void DisplayWidget::slot_set_wifi_id_filter(int wifi_id_filter) {
   if (m_wifi_id_filter != wifi_id_filter) {
     m_wifi_id_filter = wifi_id_filter;
-    slot_measurements_updated();
+    regenerate();
   }
 }
 
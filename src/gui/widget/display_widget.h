@@ -23,10 +23,12 @@
 #include <QPainter>
 #include <QWheelEvent>
 #include <QWidget>
+#include <memory>
 
 #include "../../state/measurements.h"
 #include "../../state/robot_map.h"
 #include "../../util/colormap.h"
+#include "../../util/generation_scheduler.h"
 #include "../../util/segment_generator.h"
 #include "../graphics_item/entity_item.h"
 #include "../graphics_item/floor_item.h"
@@ -90,6 +92,7 @@ class DisplayWidget : public QGraphicsView {
  public slots:
   void slot_map_updated();
 
+  // Regenerates once the measurements stop changing for a moment
   void slot_measurements_updated();
 
   void slot_set_display_mode(int display_mode);
@@ -107,16 +110,26 @@ class DisplayWidget : public QGraphicsView {
  private:
   void zoom_by(qreal factor);
 
+  // Hands the floor layer to the segment generator while restricted to it
+  void update_floor_mask();
+
+  // Regenerates right away, for changes made by the user
+  void regenerate();
+
+  void generate();
+
   QColor m_background_color, m_wall_color, m_floor_color;
   bool m_draw_floor{true}, m_draw_entities{true}, m_use_opengl{false},
       m_antialiasing{true}, m_restrict_floor{true}, m_restrict_path{true};
   int m_simplify{1}, m_wifi_id_filter{-1};
   const Valeronoi::util::RGBColorMap* m_color_map{nullptr};
   Valeronoi::util::SegmentGenerator m_segment_generator;
+  Valeronoi::util::GenerationScheduler m_generation_scheduler;
 
   Valeronoi::state::DISPLAY_MODE m_display_mode{
       Valeronoi::state::DISPLAY_MODE::Voronoi};
 
+  const Valeronoi::state::RobotMap& m_robot_map;
   const Valeronoi::state::Measurements& m_measurements;
 
   Valeronoi::gui::graphics_item::MapItem* m_map_item;
@@ -125,6 +138,7 @@ class DisplayWidget : public QGraphicsView {
   Valeronoi::gui::graphics_item::MeasurementItem* m_measurement_item;
 
   QPainterPath m_floor_path;
+  std::shared_ptr<const Valeronoi::state::Layer> m_floor_mask;
 };
 
 }  // namespace Valeronoi::gui::widget
@@ -22,6 +22,8 @@
 
 #include "cli/headless_recorder.h"
 #include "config.h"
+#include "state/project_file.h"
+#include "state/recording_journal.h"
 #include "state/state.h"
 #include "util/log_helper.h"
 #include "valeronoi.h"
@@ -31,7 +33,8 @@ int main(int argc, char** argv) {
   // Forces offscreen QPA platform so no display is required.
   bool headless_mode = false;
   for (int i = 1; i < argc; ++i) {
-    if (QString(argv[i]) == "--headless") {
+    const QString arg(argv[i]);
+    if (arg == "--headless" || arg == "--convert" || arg == "--recover") {
       headless_mode = true;
       qputenv("QT_QPA_PLATFORM", "offscreen");
       break;
@@ -75,7 +78,9 @@ int main(int argc, char** argv) {
   QFontDatabase::addApplicationFont(":/res/SourceCodePro-Regular.otf");
   QApplication::setWindowIcon(QIcon(":/res/valeronoi.png"));
 
-  qRegisterMetaType<Valeronoi::state::DataSegments>();
+  qRegisterMetaType<Valeronoi::state::DataSegmentsPtr>();
+  qRegisterMetaType<Valeronoi::state::InterpolatedRasterPtr>();
+  qRegisterMetaType<Valeronoi::state::DecodedMapPtr>();
 
   QCommandLineParser parser;
   parser.setApplicationDescription(
@@ -92,6 +97,11 @@ int main(int argc, char** argv) {
                                  "seconds");
   QCommandLineOption intervalOpt("interval", "Polling interval in seconds",
                                  "seconds", "5.0");
+  QCommandLineOption mapIntervalOpt(
+      "map-interval",
+      "Minimum time between processed map updates in seconds, map updates "
+      "arriving in between are superseded by the newest one",
+      "seconds", "0");
   QCommandLineOption urlOpt("url", "Robot Valetudo URL (e.g. http://robot:80)",
                             "url");
   QCommandLineOption authOpt("auth", "Enable HTTP basic auth");
@@ -109,10 +119,26 @@ int main(int argc, char** argv) {
       "return-home",
       "Send stop + home commands when duration elapsed or Ctrl+C is pressed");
 
+  // File conversion options
+  QCommandLineOption convertOpt(
+      "convert",
+      "Convert a .vwm file to the format given by --format and write it to "
+      "--output",
+      "file");
+  QCommandLineOption formatOpt("format",
+                               "File format for --convert (json, binary)",
+                               "format", "binary");
+  QCommandLineOption recoverOpt(
+      "recover",
+      "Replay the journal of an interrupted headless recording and write it "
+      "to --output",
+      "journal");
+
   parser.addOption(headlessOpt);
   parser.addOption(outputOpt);
   parser.addOption(durationOpt);
   parser.addOption(intervalOpt);
+  parser.addOption(mapIntervalOpt);
   parser.addOption(urlOpt);
   parser.addOption(authOpt);
   parser.addOption(userOpt);
@@ -120,9 +146,60 @@ int main(int argc, char** argv) {
   parser.addOption(commandOpt);
   parser.addOption(modeOpt);
   parser.addOption(returnHomeOpt);
+  parser.addOption(convertOpt);
+  parser.addOption(formatOpt);
+  parser.addOption(recoverOpt);
 
   parser.process(app);
 
+  // ---- File conversion ----
+  if (parser.isSet(convertOpt)) {
+    const auto format = parser.value(formatOpt).toLower();
+    if (format != "json" && format != "binary") {
+      fprintf(stderr, "Error: --format must be json or binary, got '%s'\n",
+              qPrintable(parser.value(formatOpt)));
+      return 1;
+    }
+    if (!parser.isSet(outputOpt)) {
+      fprintf(stderr, "Error: --convert requires --output\n");
+      return 1;
+    }
+    QString error;
+    if (!Valeronoi::state::ProjectFile::convert(
+            parser.value(convertOpt), parser.value(outputOpt),
+            format == "json" ? Valeronoi::state::PROJECT_FORMAT_JSON
+                             : Valeronoi::state::PROJECT_FORMAT_BINARY,
+            &error)) {
+      fprintf(stderr, "Error: Conversion failed: %s\n", qPrintable(error));
+      return 1;
+    }
+    return 0;
+  }
+
+  // ---- Journal recovery ----
+  if (parser.isSet(recoverOpt)) {
+    if (!parser.isSet(outputOpt)) {
+      fprintf(stderr, "Error: --recover requires --output\n");
+      return 1;
+    }
+    Valeronoi::state::Measurements measurements;
+    QJsonObject map;
+    std::optional<QJsonArray> wifis;
+    QString error;
+    if (!Valeronoi::state::RecordingJournal::replay(
+            parser.value(recoverOpt), measurements, map, wifis, &error) ||
+        !Valeronoi::state::ProjectFile::save(
+            parser.value(outputOpt), Valeronoi::state::PROJECT_FORMAT_BINARY,
+            map, wifis, measurements, &error)) {
+      fprintf(stderr, "Error: Recovery failed: %s\n", qPrintable(error));
+      return 1;
+    }
+    printf("Recovered %zu measurements to %s\n",
+           measurements.get_measurements().size(),
+           qPrintable(parser.value(outputOpt)));
+    return 0;
+  }
+
   // ---- Headless CLI mode ----
   if (parser.isSet(headlessOpt)) {
     Valeronoi::cli::HeadlessRecorder recorder;
@@ -156,6 +233,20 @@ int main(int argc, char** argv) {
       recorder.set_interval(interval);
     }
 
+    // Validate --map-interval: must be a non-negative number (0 = no limit)
+    {
+      bool ok = false;
+      const double map_interval = parser.value(mapIntervalOpt).toDouble(&ok);
+      if (!ok || map_interval < 0.0) {
+        fprintf(stderr,
+                "Error: --map-interval must be a non-negative number "
+                "(seconds), got '%s'\n",
+                qPrintable(parser.value(mapIntervalOpt)));
+        return 1;
+      }
+      recorder.set_map_interval(map_interval);
+    }
+
     if (parser.isSet(urlOpt)) {
       recorder.set_url(parser.value(urlOpt));
     }
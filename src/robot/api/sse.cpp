@@ -17,6 +17,8 @@
  */
 #include "sse.h"
 
+#include <algorithm>
+
 namespace Valeronoi::robot::api {
 
 SSEConnection::SSEConnection() {
@@ -27,6 +29,10 @@ SSEConnection::SSEConnection() {
   m_watchdog_timer.setSingleShot(true);
   connect(&m_watchdog_timer, &QTimer::timeout, this,
           &SSEConnection::slot_watchdog_timeout);
+
+  m_emit_timer.setSingleShot(true);
+  connect(&m_emit_timer, &QTimer::timeout, this,
+          &SSEConnection::slot_emit_data);
 }
 
 void SSEConnection::set_connection_configuration(
@@ -38,7 +44,13 @@ void SSEConnection::set_initial_url(const QUrl& url) { m_initial_url = url; }
 
 void SSEConnection::set_url(const QUrl& url) { m_url = url; }
 
-QString SSEConnection::current_data() const { return m_current_data; }
+void SSEConnection::set_min_interval(std::chrono::milliseconds interval) {
+  m_min_interval = interval;
+}
+
+QByteArray SSEConnection::current_data() const { return m_current_data; }
+
+SSEStatistics SSEConnection::statistics() const { return m_statistics; }
 
 void SSEConnection::slot_connect() {
   if (m_connected) {
@@ -47,8 +59,8 @@ void SSEConnection::slot_connect() {
 
   if (!m_initial_url.isEmpty()) {
     qDebug() << "Making initial request";
-    m_initial_current_data = "";
-    m_current_data = "";
+    m_initial_current_data.clear();
+    m_current_data.clear();
     QNetworkRequest request = prepare_request(m_initial_url);
 
     auto reply = m_qnam.get(request);
@@ -66,9 +78,7 @@ void SSEConnection::slot_connect() {
             });
     connect(reply, &QNetworkReply::finished, this, [=]() {
       if (!m_initial_current_data.isEmpty() && m_current_data.isEmpty()) {
-        m_current_data = m_initial_current_data;
-        m_watchdog_timer.start(WATCHDOG_TIMER);
-        emit signal_data_updated();
+        queue_data(m_initial_current_data);
       }
 
       reply->deleteLater();
@@ -85,38 +95,49 @@ void SSEConnection::slot_ready_read() {
     // Should not happen
     return;
   }
-  // m_reply->readAll returns chunked data, so we put it back together and
-  // parse it according to https://www.w3.org/TR/eventsource/
+  // m_reply->readAll returns chunked data, the parser puts it back together
   const auto buffer = m_reply->readAll();
   qDebug().nospace() << "Received SSE segment: size " << buffer.size();
-  QStringList lines = QString(buffer).split("\n");
-
-  for (const QString& raw_line : lines) {
-    QString line = raw_line.simplified();
-
-    switch (m_parser_state) {
-      case ParserState::IDLE: {
-        if (line.startsWith(":")) {
-          continue;
-        }
-        if (line.startsWith("event: ")) {
-          m_event_type = line.right(line.size() - 7);
-        } else if (line.startsWith("data: ") && m_event_type == m_event) {
-          m_data_buffer = line.right(line.size() - 6);
-          m_parser_state = ParserState::DATA;
-        }
-      } break;
-      case ParserState::DATA:
-        if (line.isEmpty()) {
-          m_parser_state = ParserState::IDLE;
-          m_current_data = m_data_buffer;
-          m_watchdog_timer.start(WATCHDOG_TIMER);
-          emit signal_data_updated();
-        } else {
-          m_data_buffer.append(line);
-        }
+  process(buffer);
+}
+
+void SSEConnection::process(const QByteArray& buffer) {
+  m_parser.feed(buffer, [this](const SSEEvent& event) {
+    if (event.type == m_event) {
+      queue_data(event.data);
     }
+  });
+}
+
+void SSEConnection::queue_data(const QByteArray& data) {
+  m_statistics.received++;
+  if (m_data_pending) {
+    m_statistics.dropped++;
   }
+  m_current_data = data;
+  m_data_pending = true;
+  m_watchdog_timer.start(WATCHDOG_TIMER);
+  if (m_emit_timer.isActive()) {
+    return;
+  }
+  // Even without a minimum interval the signal is deferred to the event loop,
+  // so all events that are already buffered are parsed before it is emitted
+  auto delay = std::chrono::milliseconds(0);
+  if (m_last_emit.isValid()) {
+    const auto elapsed = std::chrono::milliseconds(m_last_emit.elapsed());
+    delay = std::max(delay, m_min_interval - elapsed);
+  }
+  m_emit_timer.start(delay);
+}
+
+void SSEConnection::slot_emit_data() {
+  if (!m_data_pending) {
+    return;
+  }
+  m_data_pending = false;
+  m_statistics.processed++;
+  m_last_emit.start();
+  emit signal_data_updated();
 }
 
 void SSEConnection::slot_disconnect() {
@@ -127,6 +148,8 @@ void SSEConnection::slot_disconnect() {
   m_connected = false;
   m_reconnect_timer.stop();
   m_watchdog_timer.stop();
+  m_emit_timer.stop();
+  m_data_pending = false;
   if (m_reply) {
     m_reply->abort();
     m_reply = nullptr;
@@ -140,7 +163,7 @@ void SSEConnection::slot_stream_finished() {
     m_reply = nullptr;
   }
   if (m_connected) {
-    m_reconnect_timer.start(RECONNECT_TIMER);
+    m_reconnect_timer.start(m_parser.retry().value_or(RECONNECT_TIMER));
   }
 }
 
@@ -149,6 +172,10 @@ void SSEConnection::slot_make_request() {
     return;
   }
   QNetworkRequest request = prepare_request(m_url);
+  if (!m_parser.last_event_id().isEmpty()) {
+    request.setRawHeader("Last-Event-ID", m_parser.last_event_id());
+  }
+  m_parser.reset();
 
   m_reply = m_qnam.get(request);
   m_watchdog_timer.start(WATCHDOG_TIMER);
@@ -165,7 +192,9 @@ QNetworkRequest SSEConnection::prepare_request(const QUrl& url) const {
   return request;
 }
 
-void SSEConnection::set_event(const QString& event) { m_event = event; }
+void SSEConnection::set_event(const QString& event) {
+  m_event = event.toUtf8();
+}
 
 void SSEConnection::slot_watchdog_timeout() {
   if (!m_connected) {
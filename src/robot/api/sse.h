@@ -19,6 +19,7 @@
 #define VALERONOI_ROBOT_API_SSE_H
 
 #include <QByteArray>
+#include <QElapsedTimer>
 #include <QJsonDocument>
 #include <QList>
 #include <QNetworkAccessManager>
@@ -31,13 +32,21 @@
 #include <QUrl>
 
 #include "../connection_configuration.h"
+#include "sse_parser.h"
 
 namespace Valeronoi::robot::api {
 
 constexpr std::chrono::milliseconds RECONNECT_TIMER{2000};
 constexpr std::chrono::milliseconds WATCHDOG_TIMER{30000};
 
-enum class ParserState { IDLE = 0, DATA };
+struct SSEStatistics {
+  // Complete events of the subscribed type
+  quint64 received{0};
+  // Events that were handed on via signal_data_updated
+  quint64 processed{0};
+  // Events replaced by a newer one before they were handed on
+  quint64 dropped{0};
+};
 
 class SSEConnection : public QObject {
   Q_OBJECT
@@ -52,7 +61,17 @@ class SSEConnection : public QObject {
 
   void set_event(const QString& event);
 
-  [[nodiscard]] QString current_data() const;
+  // signal_data_updated is emitted at most once per interval. Events that
+  // arrive in between replace each other, only the newest one is handed on.
+  void set_min_interval(std::chrono::milliseconds interval);
+
+  // Parses a segment of the event stream and queues events of the subscribed
+  // type
+  void process(const QByteArray& buffer);
+
+  [[nodiscard]] QByteArray current_data() const;
+
+  [[nodiscard]] SSEStatistics statistics() const;
 
  public slots:
   void slot_connect();
@@ -71,15 +90,24 @@ class SSEConnection : public QObject {
 
   void slot_watchdog_timeout();
 
+  void slot_emit_data();
+
  private:
   QNetworkRequest prepare_request(const QUrl& url) const;
 
+  // Replaces the pending data and schedules signal_data_updated
+  void queue_data(const QByteArray& data);
+
   bool m_connected{false};
-  QString m_event, m_data_buffer, m_initial_current_data, m_current_data,
-      m_event_type;
-  ParserState m_parser_state{ParserState::IDLE};
+  QByteArray m_event, m_initial_current_data, m_current_data;
+  SSEParser m_parser;
   QTimer m_reconnect_timer;
   QTimer m_watchdog_timer;
+  QTimer m_emit_timer;
+  QElapsedTimer m_last_emit;
+  std::chrono::milliseconds m_min_interval{0};
+  bool m_data_pending{false};
+  SSEStatistics m_statistics;
   ConnectionConfiguration m_connection_configuration;
   QUrl m_initial_url, m_url;
   QNetworkReply* m_reply{nullptr};
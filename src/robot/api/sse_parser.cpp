@@ -0,0 +1,164 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "sse_parser.h"
+
+#include <cstring>
+#include <utility>
+
+namespace Valeronoi::robot::api {
+
+// Longer reconnection times are treated as invalid
+constexpr std::chrono::milliseconds::rep RETRY_MAX{24 * 60 * 60 * 1000};
+
+// Position of the first CR or LF in data at or after from, or -1
+static qsizetype find_line_end(QByteArrayView data, qsizetype from) {
+  const auto* begin = data.data() + from;
+  const auto length = static_cast<std::size_t>(data.size() - from);
+  const auto* lf = static_cast<const char*>(std::memchr(begin, '\n', length));
+  // A CR behind the first LF does not matter, Valetudo sends none anyway
+  const auto cr_length =
+      lf ? static_cast<std::size_t>(lf - begin) : length;
+  const auto* cr =
+      static_cast<const char*>(std::memchr(begin, '\r', cr_length));
+  const auto* end = cr ? cr : lf;
+  return end ? from + (end - begin) : -1;
+}
+
+void SSEParser::feed(QByteArrayView chunk, const EventHandler& on_event) {
+  if (m_buffer.isEmpty()) {
+    // Complete lines are parsed straight from the chunk, only the rest is
+    // copied
+    const auto consumed = parse_lines(chunk, on_event);
+    m_buffer.append(chunk.sliced(consumed));
+    return;
+  }
+  m_buffer.append(chunk);
+  const auto consumed = parse_lines(m_buffer, on_event);
+  m_buffer.remove(0, consumed);
+}
+
+qsizetype SSEParser::parse_lines(QByteArrayView data,
+                                 const EventHandler& on_event) {
+  qsizetype position{0};
+  while (position < data.size()) {
+    if (m_skip_lf) {
+      m_skip_lf = false;
+      if (data[position] == '\n') {
+        position++;
+        continue;
+      }
+    }
+    const auto end = find_line_end(data, position + m_scan_from);
+    if (end < 0) {
+      m_scan_from = data.size() - position;
+      return position;
+    }
+    m_scan_from = 0;
+    m_skip_lf = data[end] == '\r';
+    parse_line(data.sliced(position, end - position), on_event);
+    position = end + 1;
+  }
+  return position;
+}
+
+void SSEParser::parse_line(QByteArrayView line, const EventHandler& on_event) {
+  if (m_first_line) {
+    m_first_line = false;
+    if (line.startsWith("\xEF\xBB\xBF")) {
+      line = line.sliced(3);
+    }
+  }
+  if (line.isEmpty()) {
+    dispatch(on_event);
+    return;
+  }
+  if (line.front() == ':') {
+    // Comment, used as keep-alive
+    return;
+  }
+
+  QByteArrayView field{line}, value;
+  const auto colon = line.indexOf(':');
+  if (colon >= 0) {
+    field = line.first(colon);
+    value = line.sliced(colon + 1);
+    if (value.startsWith(' ')) {
+      value = value.sliced(1);
+    }
+  }
+
+  if (field == "data") {
+    if (m_has_data) {
+      m_data.append('\n');
+      m_data.append(value);
+    } else {
+      m_data = value.toByteArray();
+      m_has_data = true;
+    }
+  } else if (field == "event") {
+    m_event_type = value.toByteArray();
+  } else if (field == "id") {
+    if (value.indexOf('\0') < 0) {
+      m_last_event_id = value.toByteArray();
+    }
+  } else if (field == "retry") {
+    // Only plain ASCII digits are valid, anything else is ignored
+    std::chrono::milliseconds::rep retry{0};
+    for (const char c : value) {
+      if (c < '0' || c > '9' || retry > RETRY_MAX) {
+        return;
+      }
+      retry = retry * 10 + (c - '0');
+    }
+    if (!value.isEmpty() && retry <= RETRY_MAX) {
+      m_retry = std::chrono::milliseconds(retry);
+    }
+  }
+}
+
+void SSEParser::dispatch(const EventHandler& on_event) {
+  if (!m_has_data) {
+    m_event_type.clear();
+    return;
+  }
+  SSEEvent event;
+  event.type = m_event_type.isEmpty() ? QByteArray("message")
+                                      : std::exchange(m_event_type, {});
+  event.data = std::exchange(m_data, {});
+  event.id = m_last_event_id;
+  m_has_data = false;
+  on_event(event);
+}
+
+void SSEParser::reset() {
+  m_buffer.clear();
+  m_scan_from = 0;
+  m_skip_lf = false;
+  m_first_line = true;
+  m_event_type.clear();
+  m_data.clear();
+  m_has_data = false;
+}
+
+const QByteArray& SSEParser::last_event_id() const { return m_last_event_id; }
+
+std::optional<std::chrono::milliseconds> SSEParser::retry() const {
+  return m_retry;
+}
+
+}  // namespace Valeronoi::robot::api
@@ -0,0 +1,79 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_ROBOT_API_SSE_PARSER_H
+#define VALERONOI_ROBOT_API_SSE_PARSER_H
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <chrono>
+#include <functional>
+#include <optional>
+
+namespace Valeronoi::robot::api {
+
+struct SSEEvent {
+  QByteArray type;
+  QByteArray data;
+  QByteArray id;
+};
+
+// Incremental parser for text/event-stream as specified in
+// https://html.spec.whatwg.org/multipage/server-sent-events.html
+// Works on the raw bytes, lines may span any number of chunks. Only the
+// unfinished line at the end of a chunk is buffered.
+class SSEParser {
+ public:
+  typedef std::function<void(const SSEEvent& event)> EventHandler;
+
+  // Parses the next chunk of the stream and calls on_event for every event
+  // that is complete afterwards
+  void feed(QByteArrayView chunk, const EventHandler& on_event);
+
+  // Starts a new stream, e.g. after reconnecting. The last event ID and the
+  // reconnection time are kept.
+  void reset();
+
+  [[nodiscard]] const QByteArray& last_event_id() const;
+
+  // Reconnection time requested by the server, if any
+  [[nodiscard]] std::optional<std::chrono::milliseconds> retry() const;
+
+ private:
+  // Returns the number of bytes of data that were consumed
+  qsizetype parse_lines(QByteArrayView data, const EventHandler& on_event);
+
+  void parse_line(QByteArrayView line, const EventHandler& on_event);
+
+  void dispatch(const EventHandler& on_event);
+
+  // Unfinished line of the previous chunks
+  QByteArray m_buffer;
+  // Bytes at the start of m_buffer that are known to contain no line break
+  qsizetype m_scan_from{0};
+  // The previous line ended with CR, an LF directly after it belongs to it
+  bool m_skip_lf{false};
+  bool m_first_line{true};
+
+  QByteArray m_event_type, m_data, m_last_event_id;
+  bool m_has_data{false};
+  std::optional<std::chrono::milliseconds> m_retry;
+};
+
+}  // namespace Valeronoi::robot::api
+
+#endif
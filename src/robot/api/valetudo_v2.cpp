@@ -180,10 +180,18 @@ QNetworkReply* ValetudoAPI::request(const QString& verb, const QUrl& url,
 
 void ValetudoAPI::slot_map_updated() { emit signal_map_updated(); }
 
-QString ValetudoAPI::get_map_data() const {
+QByteArray ValetudoAPI::get_map_data() const {
   return m_map_connection.current_data();
 }
 
+void ValetudoAPI::set_map_min_interval(std::chrono::milliseconds interval) {
+  m_map_connection.set_min_interval(interval);
+}
+
+Valeronoi::robot::api::SSEStatistics ValetudoAPI::get_map_statistics() const {
+  return m_map_connection.statistics();
+}
+
 static QJsonDocument gen_document(const QString& action) {
   auto ret = QJsonDocument();
   auto object = QJsonObject();
@@ -58,7 +58,14 @@ class ValetudoAPI : public QObject {
                          bool disconnect_on_failure = false, bool gc = false,
                          const QByteArray* data = nullptr);
 
-  [[nodiscard]] QString get_map_data() const;
+  [[nodiscard]] QByteArray get_map_data() const;
+
+  // Map events arriving faster than this are coalesced, only the newest one
+  // is passed on
+  void set_map_min_interval(std::chrono::milliseconds interval);
+
+  [[nodiscard]] Valeronoi::robot::api::SSEStatistics get_map_statistics()
+      const;
 
   void send_command(Valeronoi::robot::BASIC_COMMANDS command);
 
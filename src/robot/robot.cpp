@@ -111,7 +111,15 @@ void Robot::slot_get_wifi() {
   }
 }
 
-QString Robot::get_map_data() const { return m_api.get_map_data(); }
+QByteArray Robot::get_map_data() const { return m_api.get_map_data(); }
+
+void Robot::set_map_min_interval(std::chrono::milliseconds interval) {
+  m_api.set_map_min_interval(interval);
+}
+
+Valeronoi::robot::api::SSEStatistics Robot::get_map_statistics() const {
+  return m_api.get_map_statistics();
+}
 
 void Robot::send_command(BASIC_COMMANDS command) {
   m_api.send_command(command);
@@ -48,7 +48,14 @@ class Robot : public QObject {
 
   [[nodiscard]] bool is_connecting() const;
 
-  [[nodiscard]] QString get_map_data() const;
+  [[nodiscard]] QByteArray get_map_data() const;
+
+  // Map events arriving faster than this are coalesced, only the newest one
+  // is passed on
+  void set_map_min_interval(std::chrono::milliseconds interval);
+
+  [[nodiscard]] Valeronoi::robot::api::SSEStatistics get_map_statistics()
+      const;
 
   void send_command(BASIC_COMMANDS command);
 
@@ -0,0 +1,547 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "map_parser.h"
+
+#include <QDebug>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <optional>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+namespace Valeronoi::state {
+
+static void parse_entity_points(const QJsonArray& pixels,
+                                std::vector<Point>& points, int* min_x,
+                                int* max_x, int* min_y, int* max_y) {
+  points.reserve(pixels.size() / 2);
+  for (qsizetype i = 0; i + 1 < pixels.size(); i += 2) {
+    int x = pixels[i].toInt();
+    int y = pixels[i + 1].toInt();
+    *min_x = std::min(*min_x, x);
+    *max_x = std::max(*max_x, x + 1);
+    *min_y = std::min(*min_y, y);
+    *max_y = std::max(*max_y, y + 1);
+    points.emplace_back(Point{x, y});
+  }
+}
+
+static void move_points(std::vector<Point>& points, int move_x, int move_y) {
+  for (auto& point : points) {
+    point.x += move_x;
+    point.y += move_y;
+  }
+}
+
+static std::uint64_t hash_combine(std::uint64_t hash, std::int64_t value) {
+  hash ^= static_cast<std::uint64_t>(value) + 0x9e3779b97f4a7c15ULL +
+          (hash << 6) + (hash >> 2);
+  return hash;
+}
+
+// Pixel data of all Valetudo layers that end up in one Layer
+struct LayerSource {
+  std::vector<QJsonArray> pixels;
+  std::uint64_t hash{0};
+};
+
+static std::uint64_t hash_source(const LayerSource& source, int map_version,
+                                 int pixel_size) {
+  auto hash = hash_combine(static_cast<std::uint64_t>(map_version), pixel_size);
+  for (const auto& pixels : source.pixels) {
+    hash = hash_combine(hash, pixels.size());
+    for (const auto&& value : pixels) {
+      hash = hash_combine(hash, value.toInteger());
+    }
+  }
+  return hash;
+}
+
+// Bounding box of the pixels, without merging them into rects
+static QRect source_bounds(const LayerSource& source, int map_version,
+                           int pixel_size) {
+  int min_x{std::numeric_limits<int>::max()},
+      max_x{std::numeric_limits<int>::min()},
+      min_y{std::numeric_limits<int>::max()},
+      max_y{std::numeric_limits<int>::min()};
+  const int values = map_version == 1 ? 2 : 3;
+  for (const auto& pixels : source.pixels) {
+    for (qsizetype i = 0; i + values - 1 < pixels.size(); i += values) {
+      const int x = pixels[i].toInt();
+      const int y = pixels[i + 1].toInt();
+      const int count = map_version == 1 ? 1 : pixels[i + 2].toInt();
+      if (count > 0) {
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x + count);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y + 1);
+      }
+    }
+  }
+  if (min_x > max_x) {
+    return {};
+  }
+  return {min_x * pixel_size, min_y * pixel_size,
+          (max_x - min_x) * pixel_size, (max_y - min_y) * pixel_size};
+}
+
+static std::shared_ptr<Layer> decode_layer(const LayerSource& source,
+                                           int map_version, int pixel_size) {
+  // Because we merge layers together, pixels/blocks may occur multiple times in
+  // a Layer. As layers are already a performance problem, we have to remove
+  // duplicates. We use a map of Y-coordinates to a vector of X-spans.
+  std::map<int, std::vector<std::pair<int, int>>> rows;
+  for (const auto& pixels : source.pixels) {
+    if (map_version == 1) {
+      for (qsizetype i = 0; i + 1 < pixels.size(); i += 2) {
+        const int x = pixels[i].toInt();
+        const int y = pixels[i + 1].toInt();
+        rows[y].emplace_back(x, x);
+      }
+    } else {
+      for (qsizetype i = 0; i + 2 < pixels.size(); i += 3) {
+        const int x = pixels[i].toInt();
+        const int y = pixels[i + 1].toInt();
+        const int count = pixels[i + 2].toInt();
+        if (count > 0) {
+          rows[y].emplace_back(x, x + count - 1);
+        }
+      }
+    }
+  }
+
+  auto layer = std::make_shared<Layer>();
+  layer->hash = source.hash;
+  auto& layer_rects = layer->rects;
+
+  // Spans of the previous row and the rect each of them ended up in. A span
+  // in the next row with the same start and end extends that rect downwards,
+  // so walls and the inside of rooms become a few tall rects instead of one
+  // rect per row.
+  struct OpenSpan {
+    int start, end;
+    std::size_t rect;
+  };
+  std::vector<OpenSpan> open, next_open;
+  std::size_t open_index{0};
+  int open_y{0};
+  const auto add_rect = [&](int y, int start, int end) {
+    // Spans and open spans are both sorted by start
+    while (open_index < open.size() && open[open_index].start < start) {
+      open_index++;
+    }
+    if (open_index < open.size() && open[open_index].start == start &&
+        open[open_index].end == end) {
+      auto& rect = layer_rects[open[open_index].rect];
+      rect.setHeight(rect.height() + pixel_size);
+      next_open.push_back(open[open_index]);
+      return;
+    }
+    layer_rects.emplace_back(start * pixel_size, y * pixel_size,
+                             (end - start + 1) * pixel_size, pixel_size);
+    next_open.push_back({start, end, layer_rects.size() - 1});
+  };
+  // Merge spans and create QRects
+  for (auto& [y, spans] : rows) {
+    if (spans.empty()) continue;
+    std::sort(spans.begin(), spans.end());
+    if (y != open_y + 1) {
+      open.clear();
+    }
+    open_index = 0;
+    next_open.clear();
+
+    int current_start = spans[0].first;
+    int current_end = spans[0].second;
+
+    for (size_t i = 1; i < spans.size(); ++i) {
+      if (spans[i].first <= current_end + 1) {
+        current_end = std::max(current_end, spans[i].second);
+      } else {
+        add_rect(y, current_start, current_end);
+        current_start = spans[i].first;
+        current_end = spans[i].second;
+      }
+    }
+    add_rect(y, current_start, current_end);
+    std::swap(open, next_open);
+    open_y = y;
+  }
+  layer_rects.shrink_to_fit();
+  for (const auto& rect : layer_rects) {
+    layer->bounds |= rect;
+  }
+  layer->grid = std::make_shared<const OccupancyGrid>(
+      layer_rects, layer->bounds, pixel_size);
+  return layer;
+}
+
+// Returns layer cropped at crop_x/crop_y, sharing it if it already is
+static std::shared_ptr<const Layer> crop_layer(
+    std::shared_ptr<const Layer> layer, int crop_x, int crop_y) {
+  if (layer->crop_x == crop_x && layer->crop_y == crop_y) {
+    return layer;
+  }
+  auto cropped = std::make_shared<Layer>(*layer);
+  for (auto& rect : cropped->rects) {
+    rect.translate(layer->crop_x - crop_x, layer->crop_y - crop_y);
+  }
+  cropped->crop_x = crop_x;
+  cropped->crop_y = crop_y;
+  return cropped;
+}
+
+// Groups the pixel data of the Valetudo layers by the Layer they end up in
+static std::unordered_map<std::string, LayerSource> collect_sources(
+    const QJsonArray& layers, int map_version) {
+  std::unordered_map<std::string, LayerSource> sources;
+  for (const auto&& layer : layers) {
+    const auto& layer_obj = layer.toObject();
+    auto layer_type = layer_obj["type"].toString().toStdString();
+    if (layer_type == "segment") {
+      layer_type = "floor";
+    }
+    if (layer_type != "floor" && layer_type != "wall") {
+      continue;
+    }
+    const int values = map_version == 1 ? 2 : 3;
+    const auto& pixels =
+        layer_obj[map_version == 1 ? "pixels" : "compressedPixels"].toArray();
+    if (pixels.size() < values || (pixels.size() % values) != 0) {
+      qDebug().nospace() << "Invalid layer, has " << pixels.size()
+                         << " points";
+      continue;
+    }
+    sources[layer_type].pixels.push_back(pixels);
+  }
+  return sources;
+}
+
+// Decodes the layers into map and returns their bounds. The robot moves with
+// every update, but the layers rarely change. Layers with the same content as
+// before are taken over from the previous map.
+static QRect decode_map_layers(const QJsonArray& layers, int map_version,
+                               const DecodedMap* previous, Map& map,
+                               int* reused) {
+  QRect bounds;
+  for (auto& [type, source] : collect_sources(layers, map_version)) {
+    source.hash = hash_source(source, map_version, map.pixel_size);
+    std::shared_ptr<const Layer> layer;
+    if (previous) {
+      const auto old_layer = previous->map.layers.find(type);
+      if (old_layer != previous->map.layers.end() &&
+          old_layer->second->hash == source.hash) {
+        layer = old_layer->second;
+        (*reused)++;
+      }
+    }
+    if (!layer) {
+      layer = decode_layer(source, map_version, map.pixel_size);
+    }
+    // Cropping only moves the rects, the bounds are never cropped
+    bounds |= layer->bounds;
+    map.layers[type] = std::move(layer);
+  }
+  return bounds;
+}
+
+// Bounds of the layers, without merging their pixels into rects
+static QRect layers_bounds(const QJsonArray& layers, int map_version,
+                           int pixel_size) {
+  QRect bounds;
+  for (const auto& [type, source] : collect_sources(layers, map_version)) {
+    bounds |= source_bounds(source, map_version, pixel_size);
+  }
+  return bounds;
+}
+
+// Finds the array of the top level "layers" key in the JSON text, so it can
+// be hashed or cut out without parsing it
+static bool find_layers(const QByteArray& json, qsizetype* begin,
+                        qsizetype* end) {
+  int depth{0};
+  bool layers_key{false}, layers_value{false};
+  qsizetype value_begin{-1};
+  for (qsizetype i = 0; i < json.size(); i++) {
+    const char c = json[i];
+    if (c == '"') {
+      const qsizetype start = ++i;
+      while (i < json.size() && json[i] != '"') {
+        i += json[i] == '\\' ? 2 : 1;
+      }
+      if (i >= json.size()) {
+        return false;
+      }
+      layers_key = depth == 1 &&
+                   QByteArrayView(json).sliced(start, i - start) == "layers";
+    } else if (depth == 1 && c == ':') {
+      layers_value = layers_key;
+    } else if (depth == 1 && c == ',') {
+      layers_value = false;
+    } else if (c == '[' || c == '{') {
+      if (depth == 1 && layers_value && c == '[') {
+        value_begin = i;
+      }
+      depth++;
+    } else if (c == ']' || c == '}') {
+      depth--;
+      if (depth == 1 && value_begin >= 0) {
+        *begin = value_begin;
+        *end = i + 1;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Adds the entities to map and crops it to the entities and the layer bounds
+static void generate_map(const QJsonObject& map_json, const QRect& bounds,
+                         Map& map) {
+  int min_x{std::numeric_limits<int>::max()},
+      max_x{std::numeric_limits<int>::min()},
+      min_y{std::numeric_limits<int>::max()},
+      max_y{std::numeric_limits<int>::min()};
+  if (!bounds.isEmpty()) {
+    min_x = bounds.left();
+    max_x = bounds.left() + bounds.width();
+    min_y = bounds.top();
+    max_y = bounds.top() + bounds.height();
+  }
+
+  for (const auto&& entity : map_json["entities"].toArray()) {
+    const auto& entity_obj = entity.toObject();
+    const auto entity_class = entity_obj["__class"].toString();
+    const auto entity_type = entity_obj["type"].toString();
+    const auto entity_metadata = entity_obj["metaData"].toObject();
+    const auto& points = entity_obj["points"].toArray();
+    if (entity_class == "PointMapEntity" && points.size() != 2) {
+      qDebug().nospace() << "Found PointMapEntity with not 2 points but "
+                         << points.size() << ", ignoring";
+      continue;
+    }
+    if (entity_type.endsWith("_position") && entity_class != "PointMapEntity") {
+      qDebug() << entity_type << "entity must be a PointMapEntity, but was"
+               << entity_class;
+      continue;
+    }
+    const auto entity_type_str = entity_type.toStdString();
+    Entity map_entity;
+    map_entity.type = entity_type_str;
+    map_entity.cls = entity_class.toStdString();
+    parse_entity_points(points, map_entity.points, &min_x, &max_x, &min_y,
+                        &max_y);
+    map_entity.angle =
+        (entity_metadata["angle"].toDouble() - 90.0) * M_PI / 180.0;
+
+    if (map_entity.type == "robot_position") {
+      // Insert robot position last to ensure the robot is drawn last
+      map.entities.push_back(map_entity);
+    } else {
+      map.entities.insert(map.entities.begin(), map_entity);
+    }
+  }
+
+  for (auto& layer : map.layers) {
+    layer.second = crop_layer(std::move(layer.second), min_x, min_y);
+  }
+
+  for (auto& entity : map.entities) {
+    move_points(entity.points, -min_x, -min_y);
+  }
+  map.size_x = max_x - min_x;
+  map.size_y = max_y - min_y;
+  map.crop_x = min_x;
+  map.crop_y = min_y;
+}
+
+MapParser::MapParser(QObject* parent) : QThread(parent) {}
+
+MapParser::~MapParser() {
+  m_mutex.lock();
+  m_abort = true;
+  m_condition.wakeOne();
+  m_mutex.unlock();
+
+  wait();
+}
+
+void MapParser::parse(const QByteArray& json, quint64 serial) {
+  QMutexLocker locker(&m_mutex);
+
+  m_json = json;
+  m_serial = serial;
+  m_pending = true;
+
+  if (!isRunning()) {
+    start(LowPriority);
+  } else {
+    m_condition.wakeOne();
+  }
+}
+
+void MapParser::run() {
+  while (true) {
+    m_mutex.lock();
+    if (!m_pending && !m_abort) {
+      m_condition.wait(&m_mutex);
+    }
+    if (m_abort) {
+      m_mutex.unlock();
+      return;
+    }
+    const auto json = m_json;
+    const auto serial = m_serial;
+    m_json.clear();
+    m_pending = false;
+    m_mutex.unlock();
+
+    const auto decoded = decode(json, m_previous);
+    if (m_abort) {
+      return;
+    }
+    if (decoded->valid) {
+      m_previous = decoded;
+    }
+    emit signal_parsed(decoded, serial);
+  }
+}
+
+// Decodes json_object with its layers passed separately. Without
+// decode_layers, only the bounds of the layers are needed, which are taken
+// from bounds if set.
+static std::shared_ptr<DecodedMap> decode_map(
+    const QJsonObject& json_object, const QJsonArray& layers,
+    const std::optional<QRect>& bounds, const DecodedMap* previous,
+    bool decode_layers) {
+  auto decoded = std::make_shared<DecodedMap>();
+  if (json_object["__class"].toString() != "ValetudoMap") {
+    decoded->error = MapParser::tr("Did not receive ValetudoMap");
+    return decoded;
+  }
+
+  const int map_version =
+      json_object["metaData"].toObject()["version"].toInt();
+  if (map_version < 1 || map_version > 2) {
+    decoded->error = MapParser::tr("Unknown map version");
+    return decoded;
+  }
+
+  decoded->json = json_object;
+  auto& map = decoded->map;
+  map.pixel_size = json_object["pixelSize"].toInt();
+  int reused{0};
+  if (decode_layers) {
+    decoded->layers_bounds =
+        decode_map_layers(layers, map_version, previous, map, &reused);
+  } else if (bounds) {
+    decoded->layers_bounds = *bounds;
+  } else {
+    decoded->layers_bounds =
+        layers_bounds(layers, map_version, map.pixel_size);
+  }
+  generate_map(json_object, decoded->layers_bounds, map);
+  decoded->valid = true;
+  decoded->layers_decoded = decode_layers;
+  if (decode_layers) {
+    qDebug() << "Generated map with size" << map.size_x << "x" << map.size_y
+             << "- cropped" << map.crop_x << "x" << map.crop_y << "- reused"
+             << reused << "of" << map.layers.size() << "layers";
+  }
+  return decoded;
+}
+
+DecodedMapPtr MapParser::decode(const QByteArray& json,
+                                const DecodedMapPtr& previous,
+                                bool decode_layers) {
+  if (json == "null") {
+    // Edge case, because QJsonDocument::fromJson also returns null if it
+    // detects a parsing error
+    auto decoded = std::make_shared<DecodedMap>();
+    decoded->error = tr("No map data");
+    return decoded;
+  }
+
+  // The layers make up almost all of the map. Without decode_layers they are
+  // cut out before parsing, and only parsed for their bounds if their text
+  // changed.
+  qsizetype layers_begin{0}, layers_end{0};
+  const bool has_layers = find_layers(json, &layers_begin, &layers_end);
+  const auto layers_text =
+      QByteArrayView(json).sliced(layers_begin, layers_end - layers_begin);
+  const std::uint64_t layers_hash = has_layers ? qHash(layers_text) : 0;
+  const bool cut_layers = has_layers && !decode_layers;
+
+  QJsonParseError error;
+  auto json_document = QJsonDocument::fromJson(
+      cut_layers ? json.left(layers_begin) + "[]" + json.mid(layers_end)
+                 : json,
+      &error);
+  if (json_document.isNull()) {
+    auto decoded = std::make_shared<DecodedMap>();
+    decoded->error = error.errorString();
+    return decoded;
+  }
+  if (json_document.isEmpty()) {
+    auto decoded = std::make_shared<DecodedMap>();
+    decoded->error = tr("No map data");
+    return decoded;
+  }
+  const auto json_object = json_document.object();
+
+  std::optional<QRect> bounds;
+  QJsonArray layers = json_object["layers"].toArray();
+  if (cut_layers) {
+    if (previous && previous->valid && previous->layers_hash == layers_hash &&
+        previous->map.pixel_size == json_object["pixelSize"].toInt()) {
+      bounds = previous->layers_bounds;
+    } else {
+      const auto layers_document =
+          QJsonDocument::fromJson(layers_text.toByteArray(), &error);
+      if (!layers_document.isArray()) {
+        auto decoded = std::make_shared<DecodedMap>();
+        decoded->error = error.errorString();
+        return decoded;
+      }
+      layers = layers_document.array();
+    }
+  }
+
+  auto decoded = decode_map(json_object, layers, bounds, previous.get(),
+                            decode_layers);
+  decoded->layers_hash = layers_hash;
+  if (cut_layers) {
+    decoded->source = json;
+  }
+  return decoded;
+}
+
+DecodedMapPtr MapParser::decode(const QJsonObject& json_object,
+                                const DecodedMapPtr& previous,
+                                bool decode_layers) {
+  return decode_map(json_object, json_object["layers"].toArray(), {},
+                    previous.get(), decode_layers);
+}
+
+}  // namespace Valeronoi::state
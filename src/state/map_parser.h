@@ -0,0 +1,105 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_STATE_MAP_PARSER_H
+#define VALERONOI_STATE_MAP_PARSER_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QMetaType>
+#include <QMutex>
+#include <QRect>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <memory>
+
+#include "state.h"
+
+namespace Valeronoi::state {
+
+// Result of decoding a ValetudoMap. It is never modified after decoding, so
+// it can be handed from the parser thread to the GUI thread as is.
+struct DecodedMap {
+  bool valid{false};
+  bool layers_decoded{false};
+  QString error;
+  // Without decoded layers, the layers of json are empty and source holds
+  // the complete JSON
+  QJsonObject json;
+  QByteArray source;
+  // Hash of the layers exactly as they appear in the JSON text, 0 if the map
+  // was not decoded from text
+  std::uint64_t layers_hash{0};
+  // Bounding box of all layers, before cropping
+  QRect layers_bounds;
+  Map map;
+};
+
+typedef std::shared_ptr<const DecodedMap> DecodedMapPtr;
+
+// Decodes ValetudoMap JSON on its own thread. If new data arrives while a map
+// is being decoded, only the most recent data is decoded next.
+class MapParser : public QThread {
+  Q_OBJECT
+ public:
+  explicit MapParser(QObject* parent = nullptr);
+
+  ~MapParser() override;
+
+  // Queues json for decoding, the result is delivered via signal_parsed.
+  // The serial is passed through so receivers can drop outdated results.
+  void parse(const QByteArray& json, quint64 serial);
+
+  // Layers that did not change since previous are shared with it. Without
+  // decode_layers, the map has no layers, but the same crop and entities as
+  // the complete map. The layers are then not parsed at all if their text is
+  // the same as that of previous.
+  static DecodedMapPtr decode(const QByteArray& json,
+                              const DecodedMapPtr& previous = {},
+                              bool decode_layers = true);
+
+  static DecodedMapPtr decode(const QJsonObject& json_object,
+                              const DecodedMapPtr& previous = {},
+                              bool decode_layers = true);
+
+ signals:
+  void signal_parsed(const Valeronoi::state::DecodedMapPtr& map,
+                     quint64 serial);
+
+ protected:
+  void run() override;
+
+ private:
+  std::atomic_bool m_abort{false};
+  bool m_pending{false};
+  QMutex m_mutex;
+  QWaitCondition m_condition;
+
+  QByteArray m_json;
+  quint64 m_serial{0};
+
+  // Last valid map, only used by the parser thread
+  DecodedMapPtr m_previous;
+};
+
+}  // namespace Valeronoi::state
+
+Q_DECLARE_METATYPE(Valeronoi::state::DecodedMapPtr)
+
+#endif
@@ -18,6 +18,7 @@
 #include "measurements.h"
 
 #include <limits>
+#include <utility>
 
 namespace Valeronoi::state {
 
@@ -25,9 +26,10 @@ void Measurements::set_map(const RobotMap& map) { m_map = &map; }
 
 void Measurements::slot_add_measurement(double signal, int wifi_id) {
   if (m_map != nullptr && m_map->is_valid()) {
-    if (auto robot_position = m_map->get_map().get_robot_position()) {
-      add_measurement(robot_position.value().x, robot_position.value().y,
-                      signal, wifi_id);
+    if (auto robot_position = m_map->get_robot_position()) {
+      const auto [x, y] = robot_position.value();
+      add_measurement(x, y, signal, wifi_id);
+      emit signal_measurement_added(x, y, signal, wifi_id);
       emit signal_measurements_updated();
     } else {
       qDebug() << "Could not find robot on map";
@@ -37,7 +39,7 @@ void Measurements::slot_add_measurement(double signal, int wifi_id) {
 
 QJsonArray Measurements::get_json() const {
   QJsonArray arr;
-  for (const auto& d : m_data) {
+  for (const auto& d : get_measurements()) {
     auto obj = QJsonObject();
     obj.insert("x", d.x);
     obj.insert("y", d.y);
@@ -53,12 +55,19 @@ QJsonArray Measurements::get_json() const {
 }
 
 void Measurements::reset() {
-  m_data.clear();
+  m_chunks.clear();
+  m_size = 0;
+  m_version++;
+  m_index.clear();
   emit signal_measurements_updated();
 }
 
 void Measurements::set_json(const QJsonArray& json) {
-  m_data.clear();
+  m_chunks.clear();
+  m_size = 0;
+  m_version++;
+  m_index.clear();
+  m_index.reserve(json.size());
   for (auto v : json) {
     const auto obj = v.toObject();
     int x = obj["x"].toInt();
@@ -74,40 +83,97 @@ void Measurements::set_json(const QJsonArray& json) {
   emit signal_measurements_updated();
 }
 
-void Measurements::add_measurement(int x, int y, double value, int wifi_id) {
-  for (auto& d : m_data) {
-    if (d.x == x && d.y == y && d.wifi_id == wifi_id) {
-      d.data.push_back(value);
-      double avg = 0;
-      for (const auto& m : d.data) {
-        avg += m;
+void Measurements::set_columns(const MeasurementColumns& columns) {
+  m_chunks.clear();
+  m_size = 0;
+  m_version++;
+  m_index.clear();
+  m_index.reserve(columns.places);
+  m_chunks.reserve((columns.places + MEASUREMENT_CHUNK_SIZE - 1) /
+                   MEASUREMENT_CHUNK_SIZE);
+  // The chunks are created here and not shared yet, so they are filled in
+  // place. Places are usually unique, duplicates are merged.
+  std::size_t offset{0};
+  for (std::size_t i = 0; i < columns.places; i++) {
+    const std::size_t count = columns.sample_count[i];
+    if (offset + count > columns.samples) {
+      qDebug() << "Measurement columns are truncated";
+      break;
+    }
+    const auto [it, inserted] = m_index.try_emplace(
+        MeasurementKey{columns.x[i], columns.y[i], columns.wifi_id[i]},
+        m_size);
+    if (inserted) {
+      if (m_size % MEASUREMENT_CHUNK_SIZE == 0) {
+        m_chunks.push_back(std::make_shared<RawMeasurements>());
+        m_chunks.back()->reserve(MEASUREMENT_CHUNK_SIZE);
       }
-      d.average = avg / d.data.size();
-      return;
+      Measurement m{};
+      m.x = columns.x[i];
+      m.y = columns.y[i];
+      m.wifi_id = columns.wifi_id[i];
+      m_chunks.back()->push_back(std::move(m));
+      m_size++;
+    }
+    auto& chunk = *m_chunks[it->second / MEASUREMENT_CHUNK_SIZE];
+    chunk[it->second % MEASUREMENT_CHUNK_SIZE].add_samples(
+        columns.sample_values + offset, count);
+    offset += count;
+  }
+  emit signal_measurements_updated();
+}
+
+void Measurements::add_measurement(int x, int y, double value, int wifi_id) {
+  const auto [it, inserted] =
+      m_index.try_emplace(MeasurementKey{x, y, wifi_id}, m_size);
+  const auto chunk_index = it->second / MEASUREMENT_CHUNK_SIZE;
+  if (inserted) {
+    if (chunk_index == m_chunks.size()) {
+      m_chunks.push_back(std::make_shared<RawMeasurements>());
+      m_chunks.back()->reserve(MEASUREMENT_CHUNK_SIZE);
     }
+    Measurement m{};
+    m.x = x;
+    m.y = y;
+    m.wifi_id = wifi_id;
+    detach_chunk(chunk_index).push_back(std::move(m));
+    m_size++;
+  }
+  detach_chunk(chunk_index)[it->second % MEASUREMENT_CHUNK_SIZE].add_sample(
+      value);
+  m_version++;
+}
+
+RawMeasurements& Measurements::detach_chunk(std::size_t index) {
+  auto& chunk = m_chunks[index];
+  if (chunk.use_count() > 1) {
+    auto copy = std::make_shared<RawMeasurements>();
+    copy->reserve(MEASUREMENT_CHUNK_SIZE);
+    copy->insert(copy->end(), chunk->begin(), chunk->end());
+    chunk = std::move(copy);
   }
-  m_data.push_back(Measurement{x, y, wifi_id, {value}, value});
+  return *chunk;
 }
 
 MeasurementStatistics Measurements::get_statistics() const {
   MeasurementStatistics ret{};
   ret.measurements = 0;
-  ret.unique_places = static_cast<int>(m_data.size());
+  ret.unique_places = static_cast<int>(m_size);
   ret.weakest = std::numeric_limits<double>::max();
   ret.strongest = -std::numeric_limits<double>::max();
   ret.unique_wifi_APs = 0;
-  if (m_data.empty()) {
+  if (m_size == 0) {
     ret.weakest = 0;
     ret.strongest = 0;
     return ret;
   }
   QVector<int> temp_wifi_count;
-  for (auto& m : m_data) {
+  for (const auto& m : get_measurements()) {
     if (!temp_wifi_count.contains(m.wifi_id)) {
       temp_wifi_count.push_back(m.wifi_id);
       ret.unique_wifi_APs++;
     }
-    for (auto& d : m.data) {
+    for (const auto& d : m.data) {
       ret.measurements++;
       ret.weakest = std::min(ret.weakest, d);
       ret.strongest = std::max(ret.strongest, d);
@@ -116,6 +182,11 @@ MeasurementStatistics Measurements::get_statistics() const {
   return ret;
 }
 
-const RawMeasurements& Measurements::get_measurements() const { return m_data; }
+MeasurementSnapshot Measurements::get_measurements() const {
+  return MeasurementSnapshot(
+      std::vector<std::shared_ptr<const RawMeasurements>>(m_chunks.begin(),
+                                                          m_chunks.end()),
+      MEASUREMENT_CHUNK_SIZE, m_size, m_version);
+}
 
 }  // namespace Valeronoi::state
@@ -23,6 +23,11 @@
 #include <QJsonObject>
 #include <QObject>
 #include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_map>
 #include <vector>
 
 #include "robot_map.h"
@@ -30,6 +35,36 @@
 
 namespace Valeronoi::state {
 
+constexpr std::size_t MEASUREMENT_CHUNK_SIZE{256};
+
+struct MeasurementKey {
+  int x, y, wifi_id;
+
+  bool operator==(const MeasurementKey& other) const {
+    return x == other.x && y == other.y && wifi_id == other.wifi_id;
+  }
+};
+
+struct MeasurementKeyHash {
+  std::size_t operator()(const MeasurementKey& key) const {
+    std::size_t h = std::hash<int>()(key.x);
+    h ^= std::hash<int>()(key.y) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= std::hash<int>()(key.wifi_id) + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+  }
+};
+
+// Column-wise view on measurements, e.g. from a memory mapped project file.
+// The samples of place i follow the samples of place i - 1.
+struct MeasurementColumns {
+  std::size_t places{0}, samples{0};
+  const qint32* x{nullptr};
+  const qint32* y{nullptr};
+  const qint32* wifi_id{nullptr};
+  const quint32* sample_count{nullptr};
+  const double* sample_values{nullptr};
+};
+
 class Measurements : public QObject {
   Q_OBJECT
  public:
@@ -37,9 +72,12 @@ class Measurements : public QObject {
 
   void set_json(const QJsonArray& json);
 
+  void set_columns(const MeasurementColumns& columns);
+
   void set_map(const RobotMap& map);
 
-  [[nodiscard]] const RawMeasurements& get_measurements() const;
+  // Cheap to take, shares all measurement data with this object
+  [[nodiscard]] MeasurementSnapshot get_measurements() const;
 
   [[nodiscard]] QJsonArray get_json() const;
 
@@ -50,15 +88,28 @@ class Measurements : public QObject {
  signals:
   void signal_measurements_updated();
 
+  // A single measurement recorded at the robot position
+  void signal_measurement_added(int x, int y, double value, int wifi_id);
+
  public slots:
   void slot_add_measurement(double signal, int wifi_id);
 
  private:
   void add_measurement(int x, int y, double value, int wifi_id);
 
+  // Returns the chunk at index for modification, cloning it first if it is
+  // still referenced by a snapshot
+  RawMeasurements& detach_chunk(std::size_t index);
+
   const RobotMap* m_map{nullptr};
 
-  std::vector<Measurement> m_data;
+  // Measurements are stored in chunks of MEASUREMENT_CHUNK_SIZE, so that
+  // modifying a shared snapshot only needs to copy a single chunk
+  std::vector<std::shared_ptr<RawMeasurements>> m_chunks;
+  std::size_t m_size{0};
+  std::uint64_t m_version{0};
+  // Index into m_chunks by place and access point
+  std::unordered_map<MeasurementKey, std::size_t, MeasurementKeyHash> m_index;
 };
 
 }  // namespace Valeronoi::state
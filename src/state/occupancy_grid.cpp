@@ -0,0 +1,95 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "occupancy_grid.h"
+
+#include <algorithm>
+#include <bitset>
+
+namespace Valeronoi::state {
+
+// Bits [first, last) of a word
+static std::uint64_t bit_range(int first, int last) {
+  const auto upper = last >= 64 ? ~std::uint64_t{0}
+                                : (std::uint64_t{1} << last) - 1;
+  return upper & ~((std::uint64_t{1} << first) - 1);
+}
+
+OccupancyGrid::OccupancyGrid(const std::vector<QRect>& rects,
+                             const QRect& bounds, int pixel_size)
+    : m_x{bounds.x()}, m_y{bounds.y()}, m_pixel_size{std::max(pixel_size, 1)} {
+  if (bounds.isEmpty()) {
+    return;
+  }
+  m_columns = (bounds.width() + m_pixel_size - 1) / m_pixel_size;
+  m_rows = (bounds.height() + m_pixel_size - 1) / m_pixel_size;
+  m_words_per_row = (static_cast<std::size_t>(m_columns) + 63) / 64;
+  m_bits.assign(m_words_per_row * static_cast<std::size_t>(m_rows), 0);
+
+  for (const auto& rect : rects) {
+    const int column_start = (rect.x() - m_x) / m_pixel_size;
+    const int column_end = std::min(
+        (rect.x() + rect.width() - m_x + m_pixel_size - 1) / m_pixel_size,
+        m_columns);
+    const int row_start = (rect.y() - m_y) / m_pixel_size;
+    const int row_end = std::min(
+        (rect.y() + rect.height() - m_y + m_pixel_size - 1) / m_pixel_size,
+        m_rows);
+    if (column_start < 0 || row_start < 0 || column_start >= column_end) {
+      continue;
+    }
+    for (int row = row_start; row < row_end; row++) {
+      auto* words = m_bits.data() + static_cast<std::size_t>(row) *
+                                        m_words_per_row;
+      // Whole words in the middle of a wide rect are set at once
+      for (int column = column_start; column < column_end;
+           column = (column / 64 + 1) * 64) {
+        const int last = std::min(column_end, (column / 64 + 1) * 64);
+        words[column / 64] |= bit_range(column % 64, last - column / 64 * 64);
+      }
+    }
+  }
+}
+
+int OccupancyGrid::count_row(int row, int column_start, int column_end) const {
+  column_start = std::max(column_start, 0);
+  column_end = std::min(column_end, m_columns);
+  if (row < 0 || row >= m_rows || column_start >= column_end) {
+    return 0;
+  }
+  const auto* words =
+      m_bits.data() + static_cast<std::size_t>(row) * m_words_per_row;
+  int count{0};
+  for (int column = column_start; column < column_end;
+       column = (column / 64 + 1) * 64) {
+    const int last = std::min(column_end, (column / 64 + 1) * 64);
+    const auto word =
+        words[column / 64] & bit_range(column % 64, last - column / 64 * 64);
+    count += static_cast<int>(std::bitset<64>(word).count());
+  }
+  return count;
+}
+
+std::size_t OccupancyGrid::count() const {
+  std::size_t count{0};
+  for (const auto word : m_bits) {
+    count += std::bitset<64>(word).count();
+  }
+  return count;
+}
+
+}  // namespace Valeronoi::state
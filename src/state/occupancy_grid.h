@@ -0,0 +1,83 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_STATE_OCCUPANCY_GRID_H
+#define VALERONOI_STATE_OCCUPANCY_GRID_H
+
+#include <QRect>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Valeronoi::state {
+
+// One bit per map pixel of a layer. Rows are packed into 64 bit words, so
+// point queries are a shift and a mask and rows can be scanned a word at a
+// time.
+class OccupancyGrid {
+ public:
+  OccupancyGrid() = default;
+
+  // rects and bounds in map units, aligned to pixel_size
+  OccupancyGrid(const std::vector<QRect>& rects, const QRect& bounds,
+                int pixel_size);
+
+  // Whether the map pixel containing (x, y) is set, in the coordinates of the
+  // rects the grid was built from
+  [[nodiscard]] bool contains(int x, int y) const {
+    if (x < m_x || y < m_y) {
+      return false;
+    }
+    const int column = (x - m_x) / m_pixel_size;
+    const int row = (y - m_y) / m_pixel_size;
+    return column < m_columns && row < m_rows && cell(column, row);
+  }
+
+  [[nodiscard]] bool cell(int column, int row) const {
+    const auto word = m_bits[static_cast<std::size_t>(row) * m_words_per_row +
+                             static_cast<std::size_t>(column) / 64];
+    return ((word >> (column % 64)) & 1u) != 0;
+  }
+
+  // Number of set cells in the columns [column_start, column_end) of row
+  [[nodiscard]] int count_row(int row, int column_start, int column_end) const;
+
+  // Number of set cells in the whole grid
+  [[nodiscard]] std::size_t count() const;
+
+  [[nodiscard]] int columns() const { return m_columns; }
+
+  [[nodiscard]] int rows() const { return m_rows; }
+
+  [[nodiscard]] int pixel_size() const { return m_pixel_size; }
+
+  // Map position of the first cell
+  [[nodiscard]] int x() const { return m_x; }
+
+  [[nodiscard]] int y() const { return m_y; }
+
+ private:
+  int m_x{0}, m_y{0};
+  int m_pixel_size{1};
+  int m_columns{0}, m_rows{0};
+  std::size_t m_words_per_row{0};
+  std::vector<std::uint64_t> m_bits;
+};
+
+}  // namespace Valeronoi::state
+
+#endif
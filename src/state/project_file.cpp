@@ -0,0 +1,347 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "project_file.h"
+
+#include <QCborValue>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+#include <utility>
+
+namespace Valeronoi::state {
+
+constexpr char BINARY_MAGIC[8] = {'V',  'W',  'M',    'B',
+                                  '\r', '\n', '\x1a', '\n'};
+constexpr qint64 HEADER_SIZE{16};
+constexpr qint64 CHUNK_ENTRY_SIZE{24};
+constexpr char CHUNK_MEASUREMENTS[4] = {'M', 'E', 'A', 'S'};
+constexpr char CHUNK_WIFIS[4] = {'W', 'I', 'F', 'I'};
+constexpr char CHUNK_MAP[4] = {'M', 'A', 'P', ' '};
+
+template <typename T>
+static void append_le(QByteArray& out, T value) {
+  const T le = qToLittleEndian(value);
+  out.append(reinterpret_cast<const char*>(&le), sizeof(T));
+}
+
+static qint64 align8(qint64 value) { return (value + 7) & ~qint64{7}; }
+
+bool ProjectFile::load(const QString& path) {
+  m_error.clear();
+  m_columns = MeasurementColumns();
+  m_file.close();
+  m_file.setFileName(path);
+  if (!m_file.open(QIODevice::ReadOnly)) {
+    m_error = tr("Could not open file");
+    return false;
+  }
+  const auto size = m_file.size();
+  if (size >= HEADER_SIZE) {
+    char magic[sizeof(BINARY_MAGIC)];
+    if (m_file.peek(magic, sizeof(magic)) ==
+            static_cast<qint64>(sizeof(magic)) &&
+        std::memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0) {
+      const auto* data = m_file.map(0, size);
+      if (data == nullptr) {
+        m_error = tr("Could not open file");
+        return false;
+      }
+      return load_binary(data, size);
+    }
+  }
+  const auto data = m_file.readAll();
+  m_file.close();
+  return load_json(data);
+}
+
+bool ProjectFile::load_json(const QByteArray& data) {
+  QJsonParseError error;
+  const auto json_document = QJsonDocument::fromJson(data, &error);
+  if (json_document.isNull() || json_document.isEmpty()) {
+    m_error = tr("Error parsing file:\n%1").arg(error.errorString());
+    return false;
+  }
+  const auto object = json_document.object();
+  m_version = object["version"].toInt();
+  if (m_version != PROJECT_FORMAT_JSON) {
+    m_error = tr("File is incompatible with this version");
+    return false;
+  }
+  if (!object["map"].isObject() || !object["measurements"].isArray()) {
+    m_error = tr("File is corrupted");
+    return false;
+  }
+  m_map = object["map"].toObject();
+  m_measurements_json = object["measurements"].toArray();
+  if (object.contains("wifis")) {
+    m_wifis = object["wifis"].toArray();
+  } else {
+    m_wifis.reset();
+  }
+  return true;
+}
+
+bool ProjectFile::load_binary(const uchar* data, qint64 size) {
+  m_version = qFromLittleEndian<quint32>(data + 8);
+  if (m_version != PROJECT_FORMAT_BINARY) {
+    m_error = tr("File is incompatible with this version");
+    return false;
+  }
+  const qint64 chunk_count = qFromLittleEndian<quint32>(data + 12);
+  if (HEADER_SIZE + chunk_count * CHUNK_ENTRY_SIZE > size) {
+    m_error = tr("File is corrupted");
+    return false;
+  }
+
+  bool has_map{false}, has_measurements{false};
+  m_wifis.reset();
+  for (qint64 i = 0; i < chunk_count; i++) {
+    const auto* entry = data + HEADER_SIZE + i * CHUNK_ENTRY_SIZE;
+    const auto offset =
+        static_cast<qint64>(qFromLittleEndian<quint64>(entry + 8));
+    const auto length =
+        static_cast<qint64>(qFromLittleEndian<quint64>(entry + 16));
+    if (offset < 0 || length < 0 || offset > size || length > size - offset) {
+      m_error = tr("File is corrupted");
+      return false;
+    }
+    const auto* chunk = data + offset;
+    const auto chunk_bytes = QByteArray::fromRawData(
+        reinterpret_cast<const char*>(chunk), static_cast<qsizetype>(length));
+
+    if (std::memcmp(entry, CHUNK_MAP, 4) == 0) {
+      QCborParserError error;
+      const auto map = QCborValue::fromCbor(chunk_bytes, &error);
+      if (error.error != QCborError::NoError || !map.isMap()) {
+        m_error = tr("File is corrupted");
+        return false;
+      }
+      m_map = map.toJsonValue().toObject();
+      has_map = true;
+    } else if (std::memcmp(entry, CHUNK_WIFIS, 4) == 0) {
+      QCborParserError error;
+      const auto wifis = QCborValue::fromCbor(chunk_bytes, &error);
+      if (error.error != QCborError::NoError || !wifis.isArray()) {
+        m_error = tr("File is corrupted");
+        return false;
+      }
+      m_wifis = wifis.toJsonValue().toArray();
+    } else if (std::memcmp(entry, CHUNK_MEASUREMENTS, 4) == 0) {
+      if (length < 16 || offset % 8 != 0) {
+        m_error = tr("File is corrupted");
+        return false;
+      }
+      const auto places = qFromLittleEndian<quint64>(chunk);
+      const auto samples = qFromLittleEndian<quint64>(chunk + 8);
+      // Checked separately to avoid overflows with corrupted counts
+      if (samples > static_cast<quint64>(length) / sizeof(double) ||
+          places > static_cast<quint64>(length) / (4 * sizeof(qint32)) ||
+          16 + samples * sizeof(double) + places * 4 * sizeof(qint32) >
+              static_cast<quint64>(length)) {
+        m_error = tr("File is corrupted");
+        return false;
+      }
+      const auto* samples_data = chunk + 16;
+      const auto* x_data = samples_data + samples * sizeof(double);
+      const auto* y_data = x_data + places * sizeof(qint32);
+      const auto* wifi_data = y_data + places * sizeof(qint32);
+      const auto* count_data = wifi_data + places * sizeof(qint32);
+
+      m_columns.places = places;
+      m_columns.samples = samples;
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+      // The mapping is page aligned and all columns are naturally aligned
+      // within the chunk, so they can be used in place
+      m_columns.sample_values = reinterpret_cast<const double*>(samples_data);
+      m_columns.x = reinterpret_cast<const qint32*>(x_data);
+      m_columns.y = reinterpret_cast<const qint32*>(y_data);
+      m_columns.wifi_id = reinterpret_cast<const qint32*>(wifi_data);
+      m_columns.sample_count = reinterpret_cast<const quint32*>(count_data);
+#else
+      m_samples.resize(samples);
+      m_x.resize(places);
+      m_y.resize(places);
+      m_wifi_id.resize(places);
+      m_sample_count.resize(places);
+      qFromLittleEndian<double>(samples_data, samples, m_samples.data());
+      qFromLittleEndian<qint32>(x_data, places, m_x.data());
+      qFromLittleEndian<qint32>(y_data, places, m_y.data());
+      qFromLittleEndian<qint32>(wifi_data, places, m_wifi_id.data());
+      qFromLittleEndian<quint32>(count_data, places, m_sample_count.data());
+      m_columns.sample_values = m_samples.data();
+      m_columns.x = m_x.data();
+      m_columns.y = m_y.data();
+      m_columns.wifi_id = m_wifi_id.data();
+      m_columns.sample_count = m_sample_count.data();
+#endif
+      has_measurements = true;
+    } else {
+      // Unknown chunks from newer versions are skipped
+    }
+  }
+
+  if (!has_map || !has_measurements) {
+    m_error = tr("File is corrupted");
+    return false;
+  }
+  return true;
+}
+
+QString ProjectFile::error() const { return m_error; }
+
+int ProjectFile::version() const { return m_version; }
+
+const QJsonObject& ProjectFile::map() const { return m_map; }
+
+const std::optional<QJsonArray>& ProjectFile::wifis() const { return m_wifis; }
+
+void ProjectFile::apply_measurements(Measurements& measurements) const {
+  if (m_version == PROJECT_FORMAT_BINARY) {
+    measurements.set_columns(m_columns);
+  } else {
+    measurements.set_json(m_measurements_json);
+  }
+}
+
+bool ProjectFile::save(const QString& path, int format, const QJsonObject& map,
+                       const std::optional<QJsonArray>& wifis,
+                       const Measurements& measurements, QString* error) {
+  QSaveFile file(path);
+  if (!file.open(QIODevice::WriteOnly)) {
+    if (error) {
+      *error = file.errorString();
+    }
+    return false;
+  }
+  bool ok;
+  if (format == PROJECT_FORMAT_JSON) {
+    ok = file.write(json_bytes(map, wifis, measurements)) >= 0;
+  } else {
+    ok = write_binary(file, map, wifis, measurements);
+  }
+  if (!ok || !file.commit()) {
+    if (error) {
+      *error = file.errorString();
+    }
+    return false;
+  }
+  return true;
+}
+
+bool ProjectFile::convert(const QString& input, const QString& output,
+                          int format, QString* error) {
+  ProjectFile project;
+  if (!project.load(input)) {
+    if (error) {
+      *error = project.error();
+    }
+    return false;
+  }
+  Measurements measurements;
+  project.apply_measurements(measurements);
+  return save(output, format, project.map(), project.wifis(), measurements,
+              error);
+}
+
+QByteArray ProjectFile::json_bytes(const QJsonObject& map,
+                                   const std::optional<QJsonArray>& wifis,
+                                   const Measurements& measurements) {
+  auto object = QJsonObject();
+  object.insert("map", map);
+  object.insert("measurements", measurements.get_json());
+  if (wifis) {
+    object.insert("wifis", *wifis);
+  }
+  object.insert("version", PROJECT_FORMAT_JSON);
+  return QJsonDocument(object).toJson(QJsonDocument::Compact);
+}
+
+bool ProjectFile::write_binary(QIODevice& device, const QJsonObject& map,
+                               const std::optional<QJsonArray>& wifis,
+                               const Measurements& measurements) {
+  const auto snapshot = measurements.get_measurements();
+  quint64 sample_count{0};
+  for (const auto& m : snapshot) {
+    sample_count += m.data.size();
+  }
+
+  // Columns are written one after another, each naturally aligned
+  QByteArray measurement_chunk;
+  measurement_chunk.reserve(static_cast<qsizetype>(
+      16 + sample_count * sizeof(double) + snapshot.size() * 16));
+  append_le<quint64>(measurement_chunk, snapshot.size());
+  append_le<quint64>(measurement_chunk, sample_count);
+  for (const auto& m : snapshot) {
+    for (const auto d : m.data) {
+      append_le<double>(measurement_chunk, d);
+    }
+  }
+  for (const auto& m : snapshot) {
+    append_le<qint32>(measurement_chunk, m.x);
+  }
+  for (const auto& m : snapshot) {
+    append_le<qint32>(measurement_chunk, m.y);
+  }
+  for (const auto& m : snapshot) {
+    append_le<qint32>(measurement_chunk, m.wifi_id);
+  }
+  for (const auto& m : snapshot) {
+    append_le<quint32>(measurement_chunk, static_cast<quint32>(m.data.size()));
+  }
+
+  std::vector<std::pair<const char*, QByteArray>> chunks;
+  chunks.emplace_back(CHUNK_MEASUREMENTS, std::move(measurement_chunk));
+  if (wifis) {
+    chunks.emplace_back(CHUNK_WIFIS,
+                        QCborValue::fromJsonValue(*wifis).toCbor());
+  }
+  chunks.emplace_back(CHUNK_MAP, QCborValue::fromJsonValue(map).toCbor());
+
+  QByteArray header;
+  header.append(BINARY_MAGIC, sizeof(BINARY_MAGIC));
+  append_le<quint32>(header, PROJECT_FORMAT_BINARY);
+  append_le<quint32>(header, static_cast<quint32>(chunks.size()));
+  qint64 offset = align8(HEADER_SIZE + static_cast<qint64>(chunks.size()) *
+                                           CHUNK_ENTRY_SIZE);
+  for (const auto& [id, content] : chunks) {
+    header.append(id, 4);
+    append_le<quint32>(header, 0);
+    append_le<quint64>(header, static_cast<quint64>(offset));
+    append_le<quint64>(header, static_cast<quint64>(content.size()));
+    offset = align8(offset + content.size());
+  }
+
+  const QByteArray padding(8, '\0');
+  if (device.write(header) != header.size() ||
+      device.write(padding.constData(),
+                   align8(header.size()) - header.size()) < 0) {
+    return false;
+  }
+  for (const auto& [id, content] : chunks) {
+    (void)id;
+    if (device.write(content) != content.size() ||
+        device.write(padding.constData(),
+                     align8(content.size()) - content.size()) < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace Valeronoi::state
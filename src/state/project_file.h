@@ -0,0 +1,113 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_STATE_PROJECT_FILE_H
+#define VALERONOI_STATE_PROJECT_FILE_H
+
+#include <QCoreApplication>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <optional>
+#include <vector>
+
+#include "measurements.h"
+
+namespace Valeronoi::state {
+
+// Version 1 files are a single JSON document. Version 2 files are a chunked
+// binary container (all values little endian, chunks 8-byte aligned):
+//
+//   char[8]  magic "VWMB\r\n\x1a\n"
+//   uint32   version
+//   uint32   chunk count
+//   chunk table: char[4] id, uint32 reserved, uint64 offset, uint64 size
+//
+// Chunks:
+//   "MEAS" uint64 places, uint64 samples, double samples[samples],
+//          int32 x[places], int32 y[places], int32 wifi_id[places],
+//          uint32 sample_count[places]
+//   "WIFI" CBOR encoded wifi table (as in version 1)
+//   "MAP " CBOR encoded ValetudoMap
+//
+// Measurement columns are used straight from the memory mapped file.
+constexpr int PROJECT_FORMAT_JSON{1};
+constexpr int PROJECT_FORMAT_BINARY{2};
+
+class ProjectFile {
+  Q_DECLARE_TR_FUNCTIONS(ProjectFile)
+ public:
+  ProjectFile() = default;
+
+  ProjectFile(const ProjectFile&) = delete;
+  ProjectFile& operator=(const ProjectFile&) = delete;
+
+  // Reads a project in either format. The file stays mapped until this
+  // object is destroyed.
+  bool load(const QString& path);
+
+  [[nodiscard]] QString error() const;
+
+  [[nodiscard]] int version() const;
+
+  [[nodiscard]] const QJsonObject& map() const;
+
+  [[nodiscard]] const std::optional<QJsonArray>& wifis() const;
+
+  // Replaces the contents of measurements with the loaded ones
+  void apply_measurements(Measurements& measurements) const;
+
+  static bool save(const QString& path, int format, const QJsonObject& map,
+                   const std::optional<QJsonArray>& wifis,
+                   const Measurements& measurements,
+                   QString* error = nullptr);
+
+  // Rewrites a project in the given format, e.g. for older versions
+  static bool convert(const QString& input, const QString& output,
+                      int format, QString* error = nullptr);
+
+ private:
+  bool load_json(const QByteArray& data);
+
+  bool load_binary(const uchar* data, qint64 size);
+
+  static QByteArray json_bytes(const QJsonObject& map,
+                               const std::optional<QJsonArray>& wifis,
+                               const Measurements& measurements);
+
+  static bool write_binary(QIODevice& device, const QJsonObject& map,
+                           const std::optional<QJsonArray>& wifis,
+                           const Measurements& measurements);
+
+  QString m_error;
+  int m_version{0};
+  QJsonObject m_map;
+  std::optional<QJsonArray> m_wifis;
+  QJsonArray m_measurements_json;
+
+  QFile m_file;
+  MeasurementColumns m_columns;
+  // Only used if the mapped columns can not be used directly
+  std::vector<double> m_samples;
+  std::vector<qint32> m_x, m_y, m_wifi_id;
+  std::vector<quint32> m_sample_count;
+};
+
+}  // namespace Valeronoi::state
+
+#endif
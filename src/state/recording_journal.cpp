@@ -0,0 +1,285 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "recording_journal.h"
+
+#include <QCborValue>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QtEndian>
+#include <cstring>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace Valeronoi::state {
+
+// File layout: char[8] magic, uint32 version, uint32 reserved, followed by
+// records of uint32 payload length, uint16 type, uint16 CRC-16 of the
+// payload and the payload itself. All values are little endian.
+constexpr char JOURNAL_MAGIC[8] = {'V',  'W',  'M',    'J',
+                                   '\r', '\n', '\x1a', '\n'};
+constexpr quint32 JOURNAL_VERSION{1};
+constexpr qsizetype JOURNAL_HEADER_SIZE{16};
+constexpr qsizetype RECORD_HEADER_SIZE{8};
+
+// int32 x, int32 y, int32 wifi_id, double value
+constexpr quint16 RECORD_MEASUREMENT{1};
+// CBOR encoded ValetudoMap, the last one wins
+constexpr quint16 RECORD_MAP{2};
+// CBOR encoded wifi table, the last one wins
+constexpr quint16 RECORD_WIFIS{3};
+
+constexpr qsizetype MEASUREMENT_RECORD_SIZE{20};
+
+template <typename T>
+static void append_le(QByteArray& out, T value) {
+  const T le = qToLittleEndian(value);
+  out.append(reinterpret_cast<const char*>(&le), sizeof(T));
+}
+
+RecordingJournal::RecordingJournal(QObject* parent) : QObject(parent) {
+  m_flush_timer.setInterval(JOURNAL_FLUSH_INTERVAL);
+  connect(&m_flush_timer, &QTimer::timeout, this,
+          &RecordingJournal::slot_flush_timeout);
+}
+
+RecordingJournal::~RecordingJournal() { flush(); }
+
+QString RecordingJournal::journal_path(const QString& output_path) {
+  return output_path + ".journal";
+}
+
+QString RecordingJournal::recovered_path(const QString& output_path) {
+  const QFileInfo info(output_path);
+  const auto base = info.completeBaseName() + "-recovered";
+  const auto suffix = info.suffix().isEmpty() ? QString() : "." + info.suffix();
+  auto path = info.dir().filePath(base + suffix);
+  for (int n = 2; QFile::exists(path); n++) {
+    path = info.dir().filePath(base + "-" + QString::number(n) + suffix);
+  }
+  return path;
+}
+
+QString RecordingJournal::move_aside(const QString& path) {
+  const auto base =
+      path + "." + QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss");
+  auto target = base;
+  for (int n = 2; QFile::exists(target); n++) {
+    target = base + "-" + QString::number(n);
+  }
+  return QFile::rename(path, target) ? target : QString();
+}
+
+bool RecordingJournal::open(const QString& path) {
+  m_flush_timer.stop();
+  m_file.close();
+  m_buffer.clear();
+  m_map_pending = false;
+  m_journaled_layers.reset();
+  if (QFile::exists(path)) {
+    const auto kept_path = move_aside(path);
+    if (kept_path.isEmpty()) {
+      qDebug() << "Could not move aside existing journal" << path;
+      return false;
+    }
+    qDebug() << "Moved existing journal" << path << "to" << kept_path;
+  }
+  m_file.setFileName(path);
+  if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    return false;
+  }
+  m_buffer.append(JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC));
+  append_le<quint32>(m_buffer, JOURNAL_VERSION);
+  append_le<quint32>(m_buffer, 0);
+  flush();
+  m_flush_timer.start();
+  return true;
+}
+
+bool RecordingJournal::is_open() const { return m_file.isOpen(); }
+
+void RecordingJournal::append_measurement(int x, int y, double value,
+                                          int wifi_id) {
+  QByteArray payload;
+  payload.reserve(MEASUREMENT_RECORD_SIZE);
+  append_le<qint32>(payload, x);
+  append_le<qint32>(payload, y);
+  append_le<qint32>(payload, wifi_id);
+  append_le<double>(payload, value);
+  append_record(RECORD_MEASUREMENT, payload);
+}
+
+void RecordingJournal::set_map(const QByteArray& json,
+                               std::uint64_t layers_hash) {
+  if (!is_open()) {
+    return;
+  }
+  // The robot moves with every map event, but the layers that make up the
+  // map rarely change. Only those are worth journaling.
+  if (m_journaled_layers == layers_hash) {
+    return;
+  }
+  m_journaled_layers = layers_hash;
+  m_pending_map = json;
+  m_map_pending = true;
+  if (!m_map_timer.isValid() ||
+      m_map_timer.elapsed() >= JOURNAL_MAP_INTERVAL.count()) {
+    write_map();
+  }
+}
+
+void RecordingJournal::set_wifis(const QJsonArray& wifis) {
+  append_record(RECORD_WIFIS, QCborValue::fromJsonValue(wifis).toCbor());
+}
+
+void RecordingJournal::write_map() {
+  m_map_pending = false;
+  m_map_timer.start();
+  append_record(RECORD_MAP,
+                QCborValue::fromJsonValue(
+                    QJsonDocument::fromJson(m_pending_map).object())
+                    .toCbor());
+  m_pending_map.clear();
+}
+
+void RecordingJournal::append_record(quint16 type, const QByteArray& payload) {
+  if (!is_open()) {
+    return;
+  }
+  append_le<quint32>(m_buffer, static_cast<quint32>(payload.size()));
+  append_le<quint16>(m_buffer, type);
+  append_le<quint16>(m_buffer, qChecksum(payload));
+  m_buffer.append(payload);
+  if (m_buffer.size() >= JOURNAL_MAX_BUFFER) {
+    flush();
+  }
+}
+
+void RecordingJournal::slot_flush_timeout() {
+  if (m_map_pending && m_map_timer.elapsed() >= JOURNAL_MAP_INTERVAL.count()) {
+    write_map();
+  }
+  flush();
+}
+
+void RecordingJournal::flush() {
+  if (!is_open() || m_buffer.isEmpty()) {
+    return;
+  }
+  if (m_file.write(m_buffer) != m_buffer.size()) {
+    qDebug() << "Could not write recording journal:" << m_file.errorString();
+  }
+  m_buffer.clear();
+  m_file.flush();
+#ifdef Q_OS_WIN
+  _commit(m_file.handle());
+#else
+  ::fsync(m_file.handle());
+#endif
+}
+
+void RecordingJournal::remove() {
+  m_flush_timer.stop();
+  m_buffer.clear();
+  if (!m_file.fileName().isEmpty()) {
+    m_file.close();
+    m_file.remove();
+  }
+}
+
+bool RecordingJournal::replay(const QString& path, Measurements& measurements,
+                              QJsonObject& map,
+                              std::optional<QJsonArray>& wifis,
+                              QString* error) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    if (error) {
+      *error = file.errorString();
+    }
+    return false;
+  }
+  const auto data = file.readAll();
+  if (data.size() < JOURNAL_HEADER_SIZE ||
+      std::memcmp(data.constData(), JOURNAL_MAGIC, sizeof(JOURNAL_MAGIC)) !=
+          0 ||
+      qFromLittleEndian<quint32>(data.constData() + 8) != JOURNAL_VERSION) {
+    if (error) {
+      *error = tr("Not a recording journal");
+    }
+    return false;
+  }
+
+  std::vector<qint32> x, y, wifi_id;
+  std::vector<double> values;
+  qsizetype position{JOURNAL_HEADER_SIZE};
+  while (position + RECORD_HEADER_SIZE <= data.size()) {
+    const auto* header = data.constData() + position;
+    const auto length = qFromLittleEndian<quint32>(header);
+    const auto type = qFromLittleEndian<quint16>(header + 4);
+    const auto checksum = qFromLittleEndian<quint16>(header + 6);
+    if (length > static_cast<quint64>(data.size() - position -
+                                      RECORD_HEADER_SIZE)) {
+      qDebug() << "Recording journal ends with an incomplete record";
+      break;
+    }
+    const auto payload = QByteArrayView(header + RECORD_HEADER_SIZE, length);
+    if (qChecksum(payload) != checksum) {
+      qDebug() << "Recording journal contains a damaged record";
+      break;
+    }
+    position += RECORD_HEADER_SIZE + length;
+
+    if (type == RECORD_MEASUREMENT &&
+        static_cast<qsizetype>(length) == MEASUREMENT_RECORD_SIZE) {
+      x.push_back(qFromLittleEndian<qint32>(payload.data()));
+      y.push_back(qFromLittleEndian<qint32>(payload.data() + 4));
+      wifi_id.push_back(qFromLittleEndian<qint32>(payload.data() + 8));
+      values.push_back(qFromLittleEndian<double>(payload.data() + 12));
+    } else if (type == RECORD_MAP) {
+      map = QCborValue::fromCbor(payload.toByteArray())
+                .toJsonValue()
+                .toObject();
+    } else if (type == RECORD_WIFIS) {
+      wifis = QCborValue::fromCbor(payload.toByteArray())
+                  .toJsonValue()
+                  .toArray();
+    }
+  }
+
+  // Every journaled sample is its own place, Measurements merges them again
+  const std::vector<quint32> sample_count(values.size(), 1);
+  MeasurementColumns columns;
+  columns.places = values.size();
+  columns.samples = values.size();
+  columns.x = x.data();
+  columns.y = y.data();
+  columns.wifi_id = wifi_id.data();
+  columns.sample_count = sample_count.data();
+  columns.sample_values = values.data();
+  measurements.set_columns(columns);
+  return true;
+}
+
+}  // namespace Valeronoi::state
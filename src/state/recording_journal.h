@@ -0,0 +1,110 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_STATE_RECORDING_JOURNAL_H
+#define VALERONOI_STATE_RECORDING_JOURNAL_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+
+#include "measurements.h"
+
+namespace Valeronoi::state {
+
+// Buffered records are written at least this often, followed by an fsync
+constexpr std::chrono::milliseconds JOURNAL_FLUSH_INTERVAL{2000};
+// Buffered records are written early once the buffer reaches this size
+constexpr qsizetype JOURNAL_MAX_BUFFER{64 * 1024};
+// Changed map layers are journaled at most this often
+constexpr std::chrono::milliseconds JOURNAL_MAP_INTERVAL{30000};
+
+// Append-only journal of a recording. Every record carries its own length
+// and checksum, so a torn write at the end of the file after a crash only
+// loses that last record.
+class RecordingJournal : public QObject {
+  Q_OBJECT
+ public:
+  explicit RecordingJournal(QObject* parent = nullptr);
+
+  ~RecordingJournal() override;
+
+  // Creates a new journal at path. An existing journal is moved aside first,
+  // it might hold a recording that could not be recovered. Fails instead of
+  // replacing it.
+  bool open(const QString& path);
+
+  [[nodiscard]] bool is_open() const;
+
+  void append_measurement(int x, int y, double value, int wifi_id);
+
+  // Only written if layers_hash changed, at most every JOURNAL_MAP_INTERVAL.
+  // The map JSON is not parsed until it is written.
+  void set_map(const QByteArray& json, std::uint64_t layers_hash);
+
+  void set_wifis(const QJsonArray& wifis);
+
+  // Writes all buffered records and syncs them to disk
+  void flush();
+
+  // Closes and deletes the journal, e.g. after the recording was saved
+  void remove();
+
+  // Reads all complete records of a journal
+  static bool replay(const QString& path, Measurements& measurements,
+                     QJsonObject& map, std::optional<QJsonArray>& wifis,
+                     QString* error = nullptr);
+
+  static QString journal_path(const QString& output_path);
+
+  // Where to save the recording recovered from the journal of output_path:
+  // <base>-recovered.<suffix>, or with -2, -3, ... appended if that exists,
+  // so an earlier recovery is never replaced
+  static QString recovered_path(const QString& output_path);
+
+  // Renames the journal at path to path.<timestamp>, so a new journal does
+  // not replace it. Returns the new path, or an empty string on failure.
+  static QString move_aside(const QString& path);
+
+ private slots:
+  void slot_flush_timeout();
+
+ private:
+  void append_record(quint16 type, const QByteArray& payload);
+
+  void write_map();
+
+  QFile m_file;
+  QByteArray m_buffer;
+  QTimer m_flush_timer;
+  QElapsedTimer m_map_timer;
+  QByteArray m_pending_map;
+  std::optional<std::uint64_t> m_journaled_layers;
+  bool m_map_pending{false};
+};
+
+}  // namespace Valeronoi::state
+
+#endif
@@ -24,6 +24,7 @@
 #include <QObject>
 #include <QString>
 
+#include "map_parser.h"
 #include "state.h"
 
 namespace Valeronoi::state {
@@ -33,31 +34,66 @@ class RobotMap : public QObject {
  public:
   explicit RobotMap(QObject* parent = nullptr);
 
-  void update_map_json(const QString& json);
+  void update_map_json(const QByteArray& json);
 
   void update_map_json(const QJsonObject& json_object);
 
+  // Only decodes what is needed to locate the robot, the layers are decoded
+  // on the first call of get_map() or get_map_json()
+  void update_map_json_lazy(const QByteArray& json);
+
+  // Decodes the map on a background thread. signal_map_updated is emitted
+  // once it is swapped in, unless a newer update or reset came first.
+  void update_map_json_async(const QByteArray& json);
+
   void reset();
 
   [[nodiscard]] bool is_valid() const;
 
   [[nodiscard]] QString error_msg() const;
 
+  // Only valid until the next update, do not keep references across events
   [[nodiscard]] const Map& get_map() const;
 
+  // Does not require the layers to be decoded
+  [[nodiscard]] std::optional<Point> get_robot_position() const;
+
   [[nodiscard]] const QJsonObject& get_map_json() const;
 
+  // The complete map JSON, without decoding the layers of a lazily updated
+  // map. Use it instead of get_map_json() where the layers are not needed.
+  [[nodiscard]] QByteArray get_map_source() const;
+
+  // False while the layers of a lazily updated map are not decoded yet
+  [[nodiscard]] bool has_decoded_layers() const;
+
+  // Changes with the layers of maps updated from JSON text, 0 otherwise
+  [[nodiscard]] std::uint64_t get_layers_hash() const;
+
  signals:
   void signal_map_updated();
 
+ private slots:
+  void slot_map_parsed(const Valeronoi::state::DecodedMapPtr& map,
+                       quint64 serial);
+
  private:
-  void generate_map();
+  // Takes over a decoded map. A map that failed to decode only sets the
+  // error, the last valid map and JSON are kept.
+  void apply(const DecodedMapPtr& map);
+
+  // Replaces a lazily updated map by the complete map
+  void decode_layers() const;
 
-  QJsonObject m_map_json{};
-  int m_map_version{0};
+  MapParser m_parser;
+  // Replaced by the complete map once the layers of a lazily updated map are
+  // needed
+  mutable DecodedMapPtr m_map;
+  // Last map with decoded layers, their layers are reused if unchanged
+  mutable DecodedMapPtr m_layers;
+  quint64 m_serial{0};
   bool m_valid{false};
   QString m_error;
-  Map m_map;
 };
 }  // namespace Valeronoi::state
 
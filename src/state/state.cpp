@@ -18,6 +18,7 @@
 #include "state.h"
 
 #include <algorithm>
+#include <utility>
 
 namespace Valeronoi::state {
 
@@ -31,4 +32,108 @@ std::optional<Point> Map::get_robot_position() const {
   return {res->points[0]};
 }
 
+CELL_TYPE Map::cell_type(int x, int y) const {
+  const auto wall = layers.find("wall");
+  if (wall != layers.end() && wall->second->contains(x, y)) {
+    return CELL_TYPE::Wall;
+  }
+  const auto floor = layers.find("floor");
+  if (floor != layers.end() && floor->second->contains(x, y)) {
+    return CELL_TYPE::Floor;
+  }
+  return CELL_TYPE::Unknown;
+}
+
+QRect PolygonView::bounding_rect() const {
+  if (size == 0) {
+    return {};
+  }
+  int left{points[0].x()}, right{left}, top{points[0].y()}, bottom{top};
+  for (int i = 1; i < size; i++) {
+    left = std::min(left, points[i].x());
+    right = std::max(right, points[i].x());
+    top = std::min(top, points[i].y());
+    bottom = std::max(bottom, points[i].y());
+  }
+  return QRect(QPoint(left, top), QPoint(right, bottom));
+}
+
+QPolygon PolygonView::to_polygon() const {
+  return QPolygon(QList<QPoint>(points, points + size));
+}
+
+void DataSegments::reserve(std::size_t segments) {
+  positions.reserve(segments);
+  values.reserve(segments);
+  first_part.reserve(segments + 1);
+}
+
+void DataSegments::add(int x, int y, double value,
+                       const std::vector<QPolygon>& parts) {
+  positions.emplace_back(x, y);
+  values.push_back(value);
+  for (const auto& polygon : parts) {
+    vertices.insert(vertices.end(), polygon.begin(), polygon.end());
+    first_vertex.push_back(static_cast<int>(vertices.size()));
+  }
+  first_part.push_back(part_count());
+}
+
+MeasurementSnapshot::MeasurementSnapshot(RawMeasurements measurements)
+    : m_chunk_size{std::max<std::size_t>(measurements.size(), 1)},
+      m_size{measurements.size()} {
+  m_chunks.push_back(
+      std::make_shared<const RawMeasurements>(std::move(measurements)));
+}
+
+MeasurementSnapshot::MeasurementSnapshot(
+    std::vector<std::shared_ptr<const RawMeasurements>> chunks,
+    std::size_t chunk_size, std::size_t size, std::uint64_t version)
+    : m_chunks{std::move(chunks)},
+      m_chunk_size{chunk_size},
+      m_size{size},
+      m_version{version} {}
+
+void Measurement::add_sample(double value) {
+  data.push_back(value);
+  // Summing in insertion order yields exactly the same average as re-summing
+  // the whole data vector, but in O(1)
+  sum += value;
+  const auto previous_average = data.size() == 1 ? value : average;
+  average = sum / static_cast<double>(data.size());
+  m2 += (value - previous_average) * (value - average);
+}
+
+void Measurement::add_samples(const double* values, std::size_t count) {
+  if (count == 0) {
+    return;
+  }
+  const auto previous_count = static_cast<double>(data.size());
+  const auto previous_average = data.empty() ? 0.0 : average;
+  data.insert(data.end(), values, values + count);
+  double batch_sum{0.0};
+  for (std::size_t i = 0; i < count; i++) {
+    sum += values[i];
+    batch_sum += values[i];
+  }
+  const auto batch_count = static_cast<double>(count);
+  const auto batch_average = batch_sum / batch_count;
+  double batch_m2{0.0};
+  for (std::size_t i = 0; i < count; i++) {
+    batch_m2 += (values[i] - batch_average) * (values[i] - batch_average);
+  }
+  average = sum / static_cast<double>(data.size());
+  // Combines both sets of aggregates (Chan et al.)
+  const auto delta = batch_average - previous_average;
+  m2 += batch_m2 + delta * delta * previous_count * batch_count /
+                       static_cast<double>(data.size());
+}
+
+double Measurement::variance() const {
+  if (data.size() < 2) {
+    return 0.0;
+  }
+  return m2 / static_cast<double>(data.size() - 1);
+}
+
 }  // namespace Valeronoi::state
@@ -22,12 +22,18 @@
 #include <QMetaType>
 #include <QPolygon>
 #include <QRect>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <iterator>
+#include <memory>
 #include <optional>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include "occupancy_grid.h"
+
 namespace Valeronoi::state {
 
 struct Point {
@@ -42,16 +48,36 @@ struct Entity {
 
 struct Layer {
   std::vector<QRect> rects;
+  // Bounding box of the rects before cropping
+  QRect bounds;
+  // Identifies the pixel data the layer was decoded from
+  std::uint64_t hash{0};
+  int crop_x{0}, crop_y{0};
+  // Built from the rects before cropping, so cropped copies share it
+  std::shared_ptr<const OccupancyGrid> grid;
+
+  // Whether the map pixel containing (x, y) belongs to the layer, in cropped
+  // map coordinates like the rects
+  [[nodiscard]] bool contains(int x, int y) const {
+    return grid && grid->contains(x + crop_x, y + crop_y);
+  }
 };
 
+enum class CELL_TYPE { Unknown = 0, Floor, Wall };
+
 struct Map {
   int pixel_size;
   int size_x, size_y;
   int crop_x, crop_y;
-  std::unordered_map<std::string, Layer> layers;
+  // Layers are immutable and shared between maps as long as they do not
+  // change
+  std::unordered_map<std::string, std::shared_ptr<const Layer>> layers;
   std::vector<Entity> entities;
 
   std::optional<Point> get_robot_position() const;
+
+  // Walls take precedence over floor, in cropped map coordinates
+  [[nodiscard]] CELL_TYPE cell_type(int x, int y) const;
 };
 
 struct Measurement {
@@ -59,10 +85,102 @@ struct Measurement {
   int wifi_id;
   std::vector<double> data;
   double average;
+  // Running aggregates, kept up to date by add_sample()
+  double sum{0.0};
+  double m2{0.0};  // Welford: sum of squared differences from the mean
+
+  void add_sample(double value);
+
+  // Same result as calling add_sample() for each value, up to rounding of
+  // the variance
+  void add_samples(const double* values, std::size_t count);
+
+  [[nodiscard]] double variance() const;
 };
 
 typedef std::vector<Measurement> RawMeasurements;
 
+// Immutable, reference counted view of a set of measurements. Copies only
+// share the underlying chunks, so snapshots can be handed to other threads
+// without copying any sample arrays. Measurements clones a chunk before
+// modifying it while a snapshot still refers to it.
+class MeasurementSnapshot {
+ public:
+  class const_iterator {
+   public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef Measurement value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const Measurement* pointer;
+    typedef const Measurement& reference;
+
+    const_iterator(const MeasurementSnapshot* snapshot, std::size_t index)
+        : m_snapshot{snapshot}, m_index{index} {}
+
+    reference operator*() const { return (*m_snapshot)[m_index]; }
+    pointer operator->() const { return &(*m_snapshot)[m_index]; }
+    const_iterator& operator++() {
+      m_index++;
+      return *this;
+    }
+    bool operator==(const const_iterator& other) const {
+      return m_index == other.m_index;
+    }
+    bool operator!=(const const_iterator& other) const {
+      return m_index != other.m_index;
+    }
+
+   private:
+    const MeasurementSnapshot* m_snapshot;
+    std::size_t m_index;
+  };
+
+  MeasurementSnapshot() = default;
+
+  explicit MeasurementSnapshot(RawMeasurements measurements);
+
+  MeasurementSnapshot(
+      std::vector<std::shared_ptr<const RawMeasurements>> chunks,
+      std::size_t chunk_size, std::size_t size, std::uint64_t version);
+
+  [[nodiscard]] std::size_t size() const { return m_size; }
+
+  [[nodiscard]] bool empty() const { return m_size == 0; }
+
+  // Increases with every modification of the measurements it was taken from
+  [[nodiscard]] std::uint64_t version() const { return m_version; }
+
+  // True if both snapshots hold the same data. Chunks are copied before they
+  // are modified while a snapshot references them, so comparing them is
+  // enough.
+  [[nodiscard]] bool shares_data(const MeasurementSnapshot& other) const {
+    return m_size == other.m_size && m_chunks == other.m_chunks;
+  }
+
+  [[nodiscard]] std::size_t chunk_count() const { return m_chunks.size(); }
+
+  // A chunk is only replaced when its measurements change, so snapshots that
+  // share it agree on all of them
+  [[nodiscard]] const std::shared_ptr<const RawMeasurements>& chunk(
+      std::size_t index) const {
+    return m_chunks[index];
+  }
+
+  const Measurement& operator[](std::size_t index) const {
+    return (*m_chunks[index / m_chunk_size])[index % m_chunk_size];
+  }
+
+  [[nodiscard]] const_iterator begin() const { return {this, 0}; }
+
+  [[nodiscard]] const_iterator end() const { return {this, m_size}; }
+
+ private:
+  std::vector<std::shared_ptr<const RawMeasurements>> m_chunks;
+  std::size_t m_chunk_size{1};
+  std::size_t m_size{0};
+  std::uint64_t m_version{0};
+};
+
 struct MeasurementStatistics {
   int measurements, unique_places, unique_wifi_APs;
   double strongest, weakest;
@@ -71,17 +189,79 @@ struct MeasurementStatistics {
 enum class DISPLAY_MODE {
   Voronoi = 0,
   DataPoints = 1,
-  None = 2
+  Interpolated = 2,
+  Kriging = 3,
+  KrigingVariance = 4,
+  None = 5
 };  // Keep in sync with valeronoi.ui
 
-struct DataSegment {
+// Display modes that show an InterpolatedRaster instead of segments
+inline bool is_raster_mode(DISPLAY_MODE display_mode) {
+  return display_mode == DISPLAY_MODE::Interpolated ||
+         display_mode == DISPLAY_MODE::Kriging ||
+         display_mode == DISPLAY_MODE::KrigingVariance;
+}
+
+// A polygon inside the vertex array of DataSegments, only valid as long as
+// the segments are
+struct PolygonView {
+  const QPoint* points{nullptr};
+  int size{0};
+
+  [[nodiscard]] QRect bounding_rect() const;
+
+  [[nodiscard]] QPolygon to_polygon() const;
+};
+
+// The data segments of one generator run in flat arrays. Segment i is the
+// value values[i] measured at positions[i]. It is painted as the parts
+// first_part[i] up to first_part[i + 1], and part j consists of the vertices
+// first_vertex[j] up to first_vertex[j + 1].
+struct DataSegments {
+  std::vector<QPoint> positions;
+  std::vector<double> values;
+  std::vector<int> first_part{0};
+  std::vector<int> first_vertex{0};
+  std::vector<QPoint> vertices;
+  // A quick first result of a slow display mode without any parts, painted
+  // as data points until the real one arrives
+  bool preview{false};
+
+  void reserve(std::size_t segments);
+
+  // Parts are the clipped polygons of a Voronoi cell, segments without parts
+  // still count for the legend
+  void add(int x, int y, double value,
+           const std::vector<QPolygon>& parts = {});
+
+  [[nodiscard]] int size() const { return static_cast<int>(values.size()); }
+
+  [[nodiscard]] bool empty() const { return values.empty(); }
+
+  [[nodiscard]] int part_count() const {
+    return static_cast<int>(first_vertex.size()) - 1;
+  }
+
+  [[nodiscard]] PolygonView part(int j) const {
+    return {vertices.data() + first_vertex[j],
+            first_vertex[j + 1] - first_vertex[j]};
+  }
+};
+
+// Shared between the generator, its cache and the renderer, never copied
+typedef std::shared_ptr<const DataSegments> DataSegmentsPtr;
+
+// Signal strength interpolated on a regular grid in map coordinates
+struct InterpolatedRaster {
+  // Map position of the top left corner
   int x{0}, y{0};
-  double value{0.0};
-  QPolygon polygon;
-  QColor color;
+  int pixel_size{1};
+  int width{0}, height{0};
+  // Row major, NaN where no measurement is close enough
+  std::vector<float> values;
 };
 
-typedef QList<Valeronoi::state::DataSegment> DataSegments;
+typedef std::shared_ptr<const InterpolatedRaster> InterpolatedRasterPtr;
 
 }  // namespace Valeronoi::state
 
@@ -89,6 +269,7 @@ typedef QList<Valeronoi::state::DataSegment> DataSegments;
 // To make cppcheck happy
 #define Q_DECLARE_METATYPE(TYPE)  // TYPE
 #endif
-Q_DECLARE_METATYPE(Valeronoi::state::DataSegments)
+Q_DECLARE_METATYPE(Valeronoi::state::DataSegmentsPtr)
+Q_DECLARE_METATYPE(Valeronoi::state::InterpolatedRasterPtr)
 
 #endif
@@ -0,0 +1,164 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "cell_clipper.h"
+
+#include <QPointF>
+#include <QRegion>
+#include <algorithm>
+#include <cmath>
+
+namespace Valeronoi::util {
+
+// Keeps the part of a convex polygon on one side of an axis parallel line
+static void clip_edge(const std::vector<QPointF>& in, std::vector<QPointF>& out,
+                      bool vertical, double bound, bool keep_greater) {
+  out.clear();
+  const auto coordinate = [vertical](const QPointF& p) {
+    return vertical ? p.x() : p.y();
+  };
+  const auto inside = [&](const QPointF& p) {
+    return keep_greater ? coordinate(p) >= bound : coordinate(p) <= bound;
+  };
+  for (std::size_t i = 0; i < in.size(); i++) {
+    const auto& previous = in[(i + in.size() - 1) % in.size()];
+    const auto& current = in[i];
+    const bool current_inside = inside(current);
+    if (current_inside != inside(previous)) {
+      const auto t = (bound - coordinate(previous)) /
+                     (coordinate(current) - coordinate(previous));
+      out.push_back(previous + (current - previous) * t);
+    }
+    if (current_inside) {
+      out.push_back(current);
+    }
+  }
+}
+
+static long long twice_area(const QPolygon& polygon) {
+  long long area{0};
+  for (int i = 0; i < polygon.size(); i++) {
+    const auto& a = polygon[i];
+    const auto& b = polygon[(i + 1) % polygon.size()];
+    area += static_cast<long long>(a.x()) * b.y() -
+            static_cast<long long>(b.x()) * a.y();
+  }
+  return area;
+}
+
+// Sutherland-Hodgman against a rect covering [x, x + width) like the layers
+static QPolygon clip_convex(const QPolygon& cell, const QRect& rect) {
+  std::vector<QPointF> points(cell.begin(), cell.end()), clipped;
+  clip_edge(points, clipped, true, rect.x(), true);
+  clip_edge(clipped, points, true, rect.x() + rect.width(), false);
+  clip_edge(points, clipped, false, rect.y(), true);
+  clip_edge(clipped, points, false, rect.y() + rect.height(), false);
+
+  QPolygon polygon;
+  polygon.reserve(static_cast<qsizetype>(points.size()));
+  for (const auto& p : points) {
+    const auto point = p.toPoint();
+    if (polygon.isEmpty() || polygon.last() != point) {
+      polygon << point;
+    }
+  }
+  if (polygon.size() > 1 && polygon.first() == polygon.last()) {
+    polygon.removeLast();
+  }
+  // Cells touching the rect only at an edge or a corner
+  if (polygon.size() < 3 || twice_area(polygon) == 0) {
+    return {};
+  }
+  return polygon;
+}
+
+static std::vector<QRect> point_squares(const std::vector<QPoint>& sites,
+                                        int point_distance) {
+  std::vector<QRect> squares;
+  if (point_distance > 0) {
+    squares.reserve(sites.size());
+    for (const auto& site : sites) {
+      squares.emplace_back(site.x() - point_distance,
+                           site.y() - point_distance, 2 * point_distance,
+                           2 * point_distance);
+    }
+  }
+  return squares;
+}
+
+CellClipper::CellClipper(const Valeronoi::state::Layer* floor,
+                         const std::vector<QPoint>& sites, int point_distance)
+    : m_restrict_floor{floor != nullptr},
+      m_restrict_points{point_distance > 0},
+      m_point_distance{std::max(point_distance, 0)},
+      m_floor{floor ? floor->rects : std::vector<QRect>{}},
+      m_points{point_squares(sites, point_distance)} {}
+
+bool CellClipper::restricted() const {
+  return m_restrict_floor || m_restrict_points;
+}
+
+int CellClipper::reach() const {
+  // A point of the cell of a site is closer to it than to any other site.
+  // If it lies within the square of another site, it is at most
+  // sqrt(2) * distance away from both.
+  return static_cast<int>(
+      std::ceil(m_point_distance * (1.0 + std::sqrt(2.0))));
+}
+
+std::vector<QPolygon> CellClipper::clip(const QPolygon& cell,
+                                        const QPoint& site) const {
+  if (!restricted()) {
+    return {cell};
+  }
+  std::vector<QPolygon> parts;
+  auto area = cell.boundingRect();
+  QRegion points;
+  std::vector<int> indices;
+  if (m_restrict_points) {
+    const int radius =
+        static_cast<int>(std::ceil(m_point_distance * std::sqrt(2.0)));
+    area &= QRect(site.x() - radius, site.y() - radius, 2 * radius + 1,
+                  2 * radius + 1);
+    m_points.query(area, indices);
+    for (const auto index : indices) {
+      points += m_points.rect(index);
+    }
+  }
+  const auto clip_region = [&](const QRegion& region) {
+    for (const auto& rect : region) {
+      auto part = clip_convex(cell, rect);
+      if (!part.isEmpty()) {
+        parts.push_back(std::move(part));
+      }
+    }
+  };
+  if (m_restrict_floor) {
+    // Floor rects are disjoint, so are the parts clipped against them
+    m_floor.query(area, indices);
+    for (const auto index : indices) {
+      const auto& rect = m_floor.rect(index);
+      clip_region(m_restrict_points ? points.intersected(rect)
+                                    : QRegion(rect));
+    }
+  } else {
+    clip_region(points);
+  }
+  return parts;
+}
+
+}  // namespace Valeronoi::util
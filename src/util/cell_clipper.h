@@ -0,0 +1,63 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_UTIL_CELL_CLIPPER_H
+#define VALERONOI_UTIL_CELL_CLIPPER_H
+
+#include <QPoint>
+#include <QPolygon>
+#include <QRect>
+#include <vector>
+
+#include "../state/state.h"
+#include "rect_index.h"
+
+namespace Valeronoi::util {
+
+// Cells are restricted to squares of twice this size around the measurements
+constexpr int CLIP_POINT_DISTANCE{35};
+
+// Clips convex Voronoi cells against the floor and against the surroundings
+// of the sites, so they can be painted without clip paths. The region is
+// indexed once, each cell then only looks at the rects near it.
+class CellClipper {
+ public:
+  // floor in the coordinates of the sites, nullptr to not restrict to the
+  // floor. point_distance <= 0 does not restrict to the surroundings of the
+  // sites.
+  CellClipper(const Valeronoi::state::Layer* floor,
+              const std::vector<QPoint>& sites, int point_distance);
+
+  // Whether clip() returns anything but the cell itself
+  [[nodiscard]] bool restricted() const;
+
+  // A site only changes the clipped cells of sites within this distance
+  [[nodiscard]] int reach() const;
+
+  // Disjoint convex parts of the cell of site that lie within the region
+  [[nodiscard]] std::vector<QPolygon> clip(const QPolygon& cell,
+                                           const QPoint& site) const;
+
+ private:
+  bool m_restrict_floor, m_restrict_points;
+  int m_point_distance;
+  RectIndex m_floor, m_points;
+};
+
+}  // namespace Valeronoi::util
+
+#endif
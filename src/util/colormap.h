@@ -18,20 +18,38 @@
 #ifndef VALERONOI_UTIL_COLORMAP_H
 #define VALERONOI_UTIL_COLORMAP_H
 
+#include <algorithm>
 #include <array>
+#include <cassert>
 #include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
 namespace Valeronoi::util {
+
+// Entries of the lookup table every color map builds on construction
+constexpr std::size_t COLORMAP_LUT_SIZE{1024};
+
 template <typename T, int components>
 class ColorMap {
+  static_assert(components == 3 || components == 4,
+                "Colors are packed as RGB or RGBA");
+
  public:
   ColorMap(const char* name, std::vector<std::array<T, components>> colors)
       : colormap_name{name}, colormap_colors{std::move(colors)} {
     if (colormap_colors.size() == 0) {
       throw std::runtime_error("Can not initialize ColorMap without colors");
     }
+    // Color maps are loaded at runtime, so the table is built here once
+    colormap_lut.resize(COLORMAP_LUT_SIZE);
+    for (std::size_t i = 0; i < COLORMAP_LUT_SIZE; i++) {
+      colormap_lut[i] =
+          pack(get_color(static_cast<T>(i) / (COLORMAP_LUT_SIZE - 1)));
+    }
   }
 
   [[nodiscard]] std::string name() const { return colormap_name; }
@@ -61,9 +79,50 @@ class ColorMap {
     return ret;
   }
 
+  // Color of f from the lookup table, packed as 0xAARRGGBB like QRgb
+  [[nodiscard]] std::uint32_t get_rgb(T f) const {
+    if (!(f > 0)) return colormap_lut.front();
+    if (f >= 1) return colormap_lut.back();
+    return colormap_lut[static_cast<std::size_t>(
+        f * (COLORMAP_LUT_SIZE - 1) + 0.5)];
+  }
+
+  // Maps count values from [min, max] to packed colors like get_rgb(). NaN
+  // becomes transparent. Branch free apart from the NaN check, so the loop
+  // vectorizes.
+  template <typename V>
+  void map_values(const V* values, std::uint32_t* colors, std::size_t count,
+                  double min, double max) const {
+    const double scale =
+        max > min ? static_cast<double>(COLORMAP_LUT_SIZE - 1) / (max - min)
+                  : 0.0;
+    constexpr double last{static_cast<double>(COLORMAP_LUT_SIZE - 1)};
+    const std::uint32_t* lut = colormap_lut.data();
+    for (std::size_t i = 0; i < count; i++) {
+      const auto value = static_cast<double>(values[i]);
+      const double position =
+          std::clamp((value - min) * scale + 0.5, 0.0, last);
+      colors[i] = std::isnan(value)
+                      ? 0u
+                      : lut[static_cast<std::size_t>(position)];
+    }
+  }
+
  private:
+  static std::uint32_t pack(const std::array<T, components>& color) {
+    std::uint32_t rgb{components == 4 ? 0u : 0xff000000u};
+    for (std::size_t i = 0; i < components; i++) {
+      const auto value = std::clamp(static_cast<int>(255 * color[i]), 0, 255);
+      // RGB first, then the optional alpha on top
+      const auto shift = i < 3 ? 16 - 8 * i : 24;
+      rgb |= static_cast<std::uint32_t>(value) << shift;
+    }
+    return rgb;
+  }
+
   std::string colormap_name;
   std::vector<std::array<T, components>> colormap_colors;
+  std::vector<std::uint32_t> colormap_lut;
 };
 
 typedef ColorMap<double, 3> RGBColorMap;
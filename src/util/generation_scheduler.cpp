@@ -0,0 +1,61 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "generation_scheduler.h"
+
+#include <algorithm>
+
+namespace Valeronoi::util {
+
+GenerationScheduler::GenerationScheduler(QObject* parent) : QObject(parent) {
+  m_timer.setSingleShot(true);
+  connect(&m_timer, &QTimer::timeout, this,
+          &GenerationScheduler::slot_timeout);
+}
+
+void GenerationScheduler::set_delay(std::chrono::milliseconds delay) {
+  m_delay = std::max(delay, std::chrono::milliseconds(0));
+}
+
+void GenerationScheduler::set_max_latency(
+    std::chrono::milliseconds max_latency) {
+  m_max_latency = std::max(max_latency, std::chrono::milliseconds(0));
+}
+
+std::chrono::milliseconds GenerationScheduler::get_max_latency() const {
+  return m_max_latency;
+}
+
+void GenerationScheduler::request() {
+  if (!m_timer.isActive()) {
+    m_pending_since.start();
+  }
+  const auto remaining = m_max_latency.count() - m_pending_since.elapsed();
+  m_timer.start(std::chrono::milliseconds(
+      std::clamp<qint64>(remaining, 0, m_delay.count())));
+}
+
+void GenerationScheduler::request_now() {
+  m_timer.stop();
+  emit signal_generate();
+}
+
+bool GenerationScheduler::is_pending() const { return m_timer.isActive(); }
+
+void GenerationScheduler::slot_timeout() { emit signal_generate(); }
+
+}  // namespace Valeronoi::util
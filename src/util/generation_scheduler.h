@@ -0,0 +1,72 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_UTIL_GENERATION_SCHEDULER_H
+#define VALERONOI_UTIL_GENERATION_SCHEDULER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <chrono>
+
+namespace Valeronoi::util {
+
+// Requests arriving within this time of each other are coalesced
+constexpr std::chrono::milliseconds GENERATION_DELAY{250};
+// No request waits longer than this, even if new ones keep arriving
+constexpr std::chrono::milliseconds GENERATION_MAX_LATENCY{2000};
+
+// Coalesces regeneration requests, e.g. one per measurement while
+// recording, into fewer calls to the segment generator. A request is passed
+// on once no new one arrived for the delay, but at the latest after the
+// maximum latency.
+class GenerationScheduler : public QObject {
+  Q_OBJECT
+ public:
+  explicit GenerationScheduler(QObject* parent = nullptr);
+
+  void set_delay(std::chrono::milliseconds delay);
+
+  void set_max_latency(std::chrono::milliseconds max_latency);
+
+  [[nodiscard]] std::chrono::milliseconds get_max_latency() const;
+
+  void request();
+
+  // Passes the request on right away, e.g. after the user changed a setting,
+  // and drops the pending one
+  void request_now();
+
+  [[nodiscard]] bool is_pending() const;
+
+ signals:
+  void signal_generate();
+
+ private slots:
+  void slot_timeout();
+
+ private:
+  QTimer m_timer;
+  // Since the oldest request that was not passed on yet
+  QElapsedTimer m_pending_since;
+  std::chrono::milliseconds m_delay{GENERATION_DELAY};
+  std::chrono::milliseconds m_max_latency{GENERATION_MAX_LATENCY};
+};
+
+}  // namespace Valeronoi::util
+
+#endif
@@ -0,0 +1,766 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "interpolation.h"
+
+#include <QSemaphore>
+#include <QThreadPool>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <tuple>
+#include <vector>
+
+namespace Valeronoi::util {
+
+// The kernel accumulates this many independent partial sums, which lets the
+// compiler vectorize it without reassociating floating point additions
+constexpr std::size_t KERNEL_LANES{8};
+// Padding sites are placed this far away, so they never get any weight
+constexpr float FAR_AWAY{1e15f};
+
+static int floor_div(int value, int divisor) {
+  return value >= 0 ? value / divisor : -((-value + divisor - 1) / divisor);
+}
+
+namespace {
+
+// Uniform grid with a cell size of INTERPOLATION_RADIUS. Sites are sorted by
+// cell, so the sites of a cell are stored contiguously.
+struct SiteGrid {
+  int x{0}, y{0};
+  int x_max{0}, y_max{0};
+  int columns{0}, rows{0};
+  std::vector<std::uint32_t> cell_start;
+  std::vector<float> site_x, site_y, site_value;
+
+  explicit SiteGrid(const Valeronoi::state::MeasurementSnapshot& measurements);
+
+  [[nodiscard]] int column(int map_x) const {
+    return std::clamp((map_x - x) / INTERPOLATION_RADIUS, 0, columns - 1);
+  }
+
+  [[nodiscard]] int row(int map_y) const {
+    return std::clamp((map_y - y) / INTERPOLATION_RADIUS, 0, rows - 1);
+  }
+};
+
+// Sites that can influence a tile, padded to a multiple of KERNEL_LANES
+struct TileSites {
+  std::vector<float> x, y, value;
+
+  void clear() {
+    x.clear();
+    y.clear();
+    value.clear();
+  }
+
+  void pad() {
+    while (x.size() % KERNEL_LANES != 0) {
+      x.push_back(FAR_AWAY);
+      y.push_back(FAR_AWAY);
+      value.push_back(0.0f);
+    }
+  }
+};
+
+}  // namespace
+
+SiteGrid::SiteGrid(const Valeronoi::state::MeasurementSnapshot& measurements) {
+  bool first{true};
+  for (const auto& m : measurements) {
+    if (first) {
+      x = x_max = m.x;
+      y = y_max = m.y;
+      first = false;
+    } else {
+      x = std::min(x, m.x);
+      x_max = std::max(x_max, m.x);
+      y = std::min(y, m.y);
+      y_max = std::max(y_max, m.y);
+    }
+  }
+  columns = (x_max - x) / INTERPOLATION_RADIUS + 1;
+  rows = (y_max - y) / INTERPOLATION_RADIUS + 1;
+
+  // Counting sort of the sites by cell
+  std::vector<std::uint32_t> cells;
+  cells.reserve(measurements.size());
+  cell_start.assign(static_cast<std::size_t>(columns) * rows + 1, 0);
+  for (const auto& m : measurements) {
+    const auto cell =
+        static_cast<std::uint32_t>(row(m.y) * columns + column(m.x));
+    cells.push_back(cell);
+    cell_start[cell + 1]++;
+  }
+  for (std::size_t i = 1; i < cell_start.size(); i++) {
+    cell_start[i] += cell_start[i - 1];
+  }
+  site_x.resize(measurements.size());
+  site_y.resize(measurements.size());
+  site_value.resize(measurements.size());
+  auto next = cell_start;
+  std::size_t i{0};
+  for (const auto& m : measurements) {
+    const auto index = next[cells[i++]]++;
+    site_x[index] = static_cast<float>(m.x);
+    site_y[index] = static_cast<float>(m.y);
+    site_value[index] = static_cast<float>(m.average);
+  }
+}
+
+// Weighted average of all sites for the pixel at (px, py). The weight
+// (1 - d^2 / r^2)^2 / d^2 behaves like inverse distance weighting close to a
+// site and falls off smoothly to zero at the radius, so there are no edges
+// where a site enters or leaves the neighbourhood.
+static float interpolate_pixel(const TileSites& sites, float px, float py) {
+  constexpr float r2 =
+      static_cast<float>(INTERPOLATION_RADIUS * INTERPOLATION_RADIUS);
+  constexpr float inv_r2 = 1.0f / r2;
+  float sum_weights[KERNEL_LANES] = {};
+  float sum_values[KERNEL_LANES] = {};
+  const float* x = sites.x.data();
+  const float* y = sites.y.data();
+  const float* value = sites.value.data();
+  for (std::size_t i = 0; i < sites.x.size(); i += KERNEL_LANES) {
+    for (std::size_t lane = 0; lane < KERNEL_LANES; lane++) {
+      const float dx = x[i + lane] - px;
+      const float dy = y[i + lane] - py;
+      const float d2 = dx * dx + dy * dy;
+      const float falloff = std::max(r2 - d2, 0.0f) * inv_r2;
+      // Adding one map unit avoids the singularity at the site itself
+      const float weight = falloff * falloff / (d2 + 1.0f);
+      sum_weights[lane] += weight;
+      sum_values[lane] += weight * value[i + lane];
+    }
+  }
+  float weights{0.0f}, values{0.0f};
+  for (std::size_t lane = 0; lane < KERNEL_LANES; lane++) {
+    weights += sum_weights[lane];
+    values += sum_values[lane];
+  }
+  return weights > 0.0f ? values / weights
+                        : std::numeric_limits<float>::quiet_NaN();
+}
+
+namespace {
+
+// Pixel range of a tile and its map area extended by the radius
+struct Tile {
+  int column_start, column_end, row_start, row_end;
+  int x_min, x_max, y_min, y_max;
+
+  Tile(const Valeronoi::state::InterpolatedRaster& raster, int tile) {
+    const int tiles_x = (raster.width + INTERPOLATION_TILE_SIZE - 1) /
+                        INTERPOLATION_TILE_SIZE;
+    column_start = (tile % tiles_x) * INTERPOLATION_TILE_SIZE;
+    row_start = (tile / tiles_x) * INTERPOLATION_TILE_SIZE;
+    column_end = std::min(column_start + INTERPOLATION_TILE_SIZE, raster.width);
+    row_end = std::min(row_start + INTERPOLATION_TILE_SIZE, raster.height);
+    x_min = raster.x + column_start * raster.pixel_size - INTERPOLATION_RADIUS;
+    x_max = raster.x + column_end * raster.pixel_size + INTERPOLATION_RADIUS;
+    y_min = raster.y + row_start * raster.pixel_size - INTERPOLATION_RADIUS;
+    y_max = raster.y + row_end * raster.pixel_size + INTERPOLATION_RADIUS;
+  }
+};
+
+}  // namespace
+
+static float pixel_center(int origin, int index, int pixel_size) {
+  return static_cast<float>(origin) +
+         (static_cast<float>(index) + 0.5f) * static_cast<float>(pixel_size);
+}
+
+// Collects all sites within the extended map area of the tile
+static void gather_sites(const SiteGrid& grid, const Tile& tile,
+                         TileSites& sites) {
+  sites.clear();
+  const int first_column = grid.column(tile.x_min);
+  const int last_column = grid.column(tile.x_max);
+  for (int row = grid.row(tile.y_min); row <= grid.row(tile.y_max); row++) {
+    // Cells of a row are adjacent, so their sites are one contiguous range
+    const auto begin = grid.cell_start[row * grid.columns + first_column];
+    const auto end = grid.cell_start[row * grid.columns + last_column + 1];
+    for (auto i = begin; i < end; i++) {
+      const auto site_x = grid.site_x[i];
+      const auto site_y = grid.site_y[i];
+      if (site_x >= static_cast<float>(tile.x_min) &&
+          site_x <= static_cast<float>(tile.x_max) &&
+          site_y >= static_cast<float>(tile.y_min) &&
+          site_y <= static_cast<float>(tile.y_max)) {
+        sites.x.push_back(site_x);
+        sites.y.push_back(site_y);
+        sites.value.push_back(grid.site_value[i]);
+      }
+    }
+  }
+}
+
+// Whether the center of a pixel lies outside of the mask
+static bool masked(const Valeronoi::state::Layer* mask, float px, float py) {
+  return mask != nullptr &&
+         !mask->contains(static_cast<int>(std::floor(px)),
+                         static_cast<int>(std::floor(py)));
+}
+
+// Whether all pixels of the tile lie outside of the mask
+static bool tile_masked(const Valeronoi::state::Layer* mask,
+                        const Valeronoi::state::InterpolatedRaster& raster,
+                        const Tile& tile) {
+  if (mask == nullptr) {
+    return false;
+  }
+  for (int row = tile.row_start; row < tile.row_end; row++) {
+    const auto py = pixel_center(raster.y, row, raster.pixel_size);
+    for (int column = tile.column_start; column < tile.column_end;
+         column++) {
+      if (!masked(mask, pixel_center(raster.x, column, raster.pixel_size),
+                  py)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static void fill_tile(Valeronoi::state::InterpolatedRaster& raster,
+                      const Tile& tile, float value) {
+  for (int row = tile.row_start; row < tile.row_end; row++) {
+    auto* out = raster.values.data() +
+                static_cast<std::size_t>(row) * raster.width;
+    std::fill(out + tile.column_start, out + tile.column_end, value);
+  }
+}
+
+static void interpolate_tile(const SiteGrid& grid,
+                             const Valeronoi::state::Layer* mask,
+                             Valeronoi::state::InterpolatedRaster& raster,
+                             int index, TileSites& sites) {
+  const Tile tile(raster, index);
+  if (tile_masked(mask, raster, tile)) {
+    fill_tile(raster, tile, std::numeric_limits<float>::quiet_NaN());
+    return;
+  }
+  gather_sites(grid, tile, sites);
+  if (sites.x.empty()) {
+    fill_tile(raster, tile, std::numeric_limits<float>::quiet_NaN());
+    return;
+  }
+  sites.pad();
+
+  for (int row = tile.row_start; row < tile.row_end; row++) {
+    auto* out = raster.values.data() +
+                static_cast<std::size_t>(row) * raster.width;
+    const auto py = pixel_center(raster.y, row, raster.pixel_size);
+    for (int column = tile.column_start; column < tile.column_end;
+         column++) {
+      const auto px = pixel_center(raster.x, column, raster.pixel_size);
+      out[column] = masked(mask, px, py)
+                        ? std::numeric_limits<float>::quiet_NaN()
+                        : interpolate_pixel(sites, px, py);
+    }
+  }
+}
+
+// Creates an empty raster covering all sites and their surrounding radius
+static std::shared_ptr<Valeronoi::state::InterpolatedRaster> make_raster(
+    const SiteGrid& grid, int pixel_size) {
+  auto raster = std::make_shared<Valeronoi::state::InterpolatedRaster>();
+  raster->pixel_size = pixel_size;
+  raster->x = floor_div(grid.x - INTERPOLATION_RADIUS, pixel_size) * pixel_size;
+  raster->y = floor_div(grid.y - INTERPOLATION_RADIUS, pixel_size) * pixel_size;
+  raster->width =
+      (grid.x_max + INTERPOLATION_RADIUS - raster->x) / pixel_size + 1;
+  raster->height =
+      (grid.y_max + INTERPOLATION_RADIUS - raster->y) / pixel_size + 1;
+  raster->values.resize(static_cast<std::size_t>(raster->width) *
+                        raster->height);
+  return raster;
+}
+
+static int tile_count(const Valeronoi::state::InterpolatedRaster& raster) {
+  const int tiles_x =
+      (raster.width + INTERPOLATION_TILE_SIZE - 1) / INTERPOLATION_TILE_SIZE;
+  const int tiles_y =
+      (raster.height + INTERPOLATION_TILE_SIZE - 1) / INTERPOLATION_TILE_SIZE;
+  return tiles_x * tiles_y;
+}
+
+// Calls work(tile, scratch) for every tile on all threads of the global pool.
+// Every thread has its own Scratch. Returns false if cancelled.
+template <typename Scratch, typename Work>
+static bool run_tiles(int tiles, const std::function<bool()>& cancelled,
+                      const Work& work) {
+  // Tiles are handed out one by one, so threads that got cheap tiles (few
+  // sites nearby) simply take more of them
+  std::atomic_int next_tile{0};
+  std::atomic_bool aborted{false};
+  const auto worker = [&]() {
+    Scratch scratch;
+    for (int tile = next_tile++; tile < tiles && !aborted;
+         tile = next_tile++) {
+      if (cancelled && cancelled()) {
+        aborted = true;
+        return;
+      }
+      work(tile, scratch);
+    }
+  };
+
+  // The calling thread works on tiles as well, so this also finishes if all
+  // threads of the pool are busy
+  auto* pool = QThreadPool::globalInstance();
+  const int helpers = std::min(pool->maxThreadCount() - 1, tiles - 1);
+  QSemaphore finished;
+  for (int i = 0; i < helpers; i++) {
+    pool->start([&worker, &finished]() {
+      worker();
+      finished.release();
+    });
+  }
+  worker();
+  finished.acquire(std::max(helpers, 0));
+  return !aborted;
+}
+
+Valeronoi::state::InterpolatedRasterPtr interpolate(
+    const Valeronoi::state::MeasurementSnapshot& measurements, int pixel_size,
+    const std::function<bool()>& cancelled,
+    const Valeronoi::state::Layer* mask) {
+  if (measurements.empty() || pixel_size <= 0) {
+    return nullptr;
+  }
+
+  const SiteGrid grid(measurements);
+  auto raster = make_raster(grid, pixel_size);
+  const bool finished = run_tiles<TileSites>(
+      tile_count(*raster), cancelled, [&](int tile, TileSites& sites) {
+        interpolate_tile(grid, mask, *raster, tile, sites);
+      });
+  if (!finished) {
+    return nullptr;
+  }
+  return raster;
+}
+
+double Variogram::operator()(double h) const {
+  if (h <= 0.0) {
+    return 0.0;
+  }
+  return nugget + partial_sill * (1.0 - std::exp(-3.0 * h / range));
+}
+
+double Variogram::covariance(double h) const {
+  return nugget + partial_sill - (*this)(h);
+}
+
+Variogram fit_variogram(
+    const Valeronoi::state::MeasurementSnapshot& measurements) {
+  // Every n-th measurement, so the sample covers the whole recording
+  const std::size_t stride = std::max<std::size_t>(
+      1, (measurements.size() + VARIOGRAM_MAX_SITES - 1) / VARIOGRAM_MAX_SITES);
+  std::vector<double> xs, ys, zs;
+  double mean{0.0};
+  for (std::size_t i = 0; i < measurements.size(); i += stride) {
+    const auto& m = measurements[i];
+    xs.push_back(m.x);
+    ys.push_back(m.y);
+    zs.push_back(m.average);
+    mean += m.average;
+  }
+  Variogram fallback;
+  if (zs.size() < 3) {
+    return fallback;
+  }
+  mean /= static_cast<double>(zs.size());
+  double variance{0.0};
+  double x_min{xs[0]}, x_max{xs[0]}, y_min{ys[0]}, y_max{ys[0]};
+  for (std::size_t i = 0; i < zs.size(); i++) {
+    variance += (zs[i] - mean) * (zs[i] - mean);
+    x_min = std::min(x_min, xs[i]);
+    x_max = std::max(x_max, xs[i]);
+    y_min = std::min(y_min, ys[i]);
+    y_max = std::max(y_max, ys[i]);
+  }
+  variance /= static_cast<double>(zs.size() - 1);
+  fallback.partial_sill = std::max(variance, 1.0);
+
+  // Only short lags matter for the local kriging systems
+  const double max_lag =
+      std::clamp(std::hypot(x_max - x_min, y_max - y_min) / 2.0,
+                 static_cast<double>(INTERPOLATION_RADIUS),
+                 4.0 * INTERPOLATION_RADIUS);
+  const double bin_width = max_lag / VARIOGRAM_BINS;
+  std::vector<double> lag_sum(VARIOGRAM_BINS), gamma_sum(VARIOGRAM_BINS),
+      pairs(VARIOGRAM_BINS);
+  for (std::size_t i = 0; i < zs.size(); i++) {
+    for (std::size_t j = i + 1; j < zs.size(); j++) {
+      const double h = std::hypot(xs[i] - xs[j], ys[i] - ys[j]);
+      if (h >= max_lag) {
+        continue;
+      }
+      const auto bin = std::min(static_cast<std::size_t>(h / bin_width),
+                                lag_sum.size() - 1);
+      lag_sum[bin] += h;
+      gamma_sum[bin] += 0.5 * (zs[i] - zs[j]) * (zs[i] - zs[j]);
+      pairs[bin] += 1.0;
+    }
+  }
+  std::vector<double> lags, gammas, weights;
+  for (std::size_t bin = 0; bin < pairs.size(); bin++) {
+    // Bins with only a few pairs are mostly noise
+    if (pairs[bin] >= 10.0) {
+      lags.push_back(lag_sum[bin] / pairs[bin]);
+      gammas.push_back(gamma_sum[bin] / pairs[bin]);
+      weights.push_back(pairs[bin]);
+    }
+  }
+  if (lags.size() < 3) {
+    return fallback;
+  }
+
+  // For a given range the model is linear in nugget and partial sill, so
+  // those are solved for directly (weighted least squares, both >= 0) for a
+  // set of candidate ranges
+  constexpr int range_candidates{40};
+  Variogram best = fallback;
+  double best_error = std::numeric_limits<double>::infinity();
+  for (int step = 0; step < range_candidates; step++) {
+    const double exponent =
+        static_cast<double>(step) / (range_candidates - 1);
+    const double range =
+        bin_width * std::pow(3.0 * VARIOGRAM_BINS, exponent);
+    double w{0.0}, f{0.0}, g{0.0}, ff{0.0}, fg{0.0};
+    for (std::size_t k = 0; k < lags.size(); k++) {
+      const double shape = 1.0 - std::exp(-3.0 * lags[k] / range);
+      w += weights[k];
+      f += weights[k] * shape;
+      g += weights[k] * gammas[k];
+      ff += weights[k] * shape * shape;
+      fg += weights[k] * shape * gammas[k];
+    }
+    const double determinant = w * ff - f * f;
+    if (determinant <= 0.0) {
+      continue;
+    }
+    double partial_sill = (w * fg - f * g) / determinant;
+    double nugget = (g - partial_sill * f) / w;
+    if (partial_sill < 0.0) {
+      partial_sill = 0.0;
+      nugget = g / w;
+    } else if (nugget < 0.0) {
+      nugget = 0.0;
+      partial_sill = fg / ff;
+    }
+    double error{0.0};
+    for (std::size_t k = 0; k < lags.size(); k++) {
+      const double shape = 1.0 - std::exp(-3.0 * lags[k] / range);
+      const double residual = gammas[k] - nugget - partial_sill * shape;
+      error += weights[k] * residual * residual;
+    }
+    if (error < best_error) {
+      best_error = error;
+      best.nugget = nugget;
+      best.partial_sill = partial_sill;
+      best.range = range;
+    }
+  }
+  // A perfectly flat field still needs a solvable system
+  best.partial_sill = std::max(best.partial_sill, 1e-3);
+  return best;
+}
+
+namespace {
+
+// Covariances of a variogram up to twice the radius, the largest distance
+// between two sites within the radius of a pixel. Evaluating the exponential
+// dominates the kriging systems otherwise, and interpolating linearly between
+// 1/16 map units is far below the precision of the measurements.
+class CovarianceTable {
+ public:
+  explicit CovarianceTable(const Variogram& variogram)
+      : m_variogram{variogram} {
+    m_values.resize(2 * INTERPOLATION_RADIUS * STEPS_PER_UNIT + 2);
+    // Without the nugget, which only applies at a distance of exactly 0
+    m_values[0] = variogram.partial_sill;
+    for (std::size_t i = 1; i < m_values.size(); i++) {
+      m_values[i] = variogram.covariance(static_cast<double>(i) /
+                                         STEPS_PER_UNIT);
+    }
+  }
+
+  [[nodiscard]] double operator()(double h) const {
+    if (h <= 0.0) {
+      return m_variogram.covariance(0.0);
+    }
+    const double position = h * STEPS_PER_UNIT;
+    const auto index = static_cast<std::size_t>(position);
+    if (index + 1 >= m_values.size()) {
+      return m_variogram.covariance(h);
+    }
+    const double fraction = position - static_cast<double>(index);
+    return m_values[index] + fraction * (m_values[index + 1] - m_values[index]);
+  }
+
+ private:
+  static constexpr int STEPS_PER_UNIT{16};
+
+  Variogram m_variogram;
+  std::vector<double> m_values;
+};
+
+struct KrigingScratch {
+  TileSites sites;
+  std::vector<float> distances;
+  std::vector<std::size_t> neighbours;
+  // Neighbours the system was factored for, sorted
+  std::vector<std::size_t> factored;
+  bool factored_valid{false};
+  // Cholesky factor of the covariances between the neighbours
+  std::vector<double> matrix;
+  // C^-1 1 and its sum, which only depend on the neighbours
+  std::vector<double> ones;
+  double ones_sum{0.0};
+  std::vector<double> covariances, solution;
+};
+
+}  // namespace
+
+// In place Cholesky decomposition of the symmetric positive definite n x n
+// row major matrix, the lower triangle is replaced by L. Returns false if the
+// matrix is not positive definite.
+static bool cholesky_decompose(std::vector<double>& a, std::size_t n) {
+  for (std::size_t j = 0; j < n; j++) {
+    double diagonal = a[j * n + j];
+    for (std::size_t k = 0; k < j; k++) {
+      diagonal -= a[j * n + k] * a[j * n + k];
+    }
+    if (diagonal <= 1e-12) {
+      return false;
+    }
+    diagonal = std::sqrt(diagonal);
+    a[j * n + j] = diagonal;
+    for (std::size_t i = j + 1; i < n; i++) {
+      double value = a[i * n + j];
+      for (std::size_t k = 0; k < j; k++) {
+        value -= a[i * n + k] * a[j * n + k];
+      }
+      a[i * n + j] = value / diagonal;
+    }
+  }
+  return true;
+}
+
+// Solves L L^T x = b in place
+static void cholesky_solve(const std::vector<double>& l, std::size_t n,
+                           std::vector<double>& b) {
+  for (std::size_t i = 0; i < n; i++) {
+    for (std::size_t k = 0; k < i; k++) {
+      b[i] -= l[i * n + k] * b[k];
+    }
+    b[i] /= l[i * n + i];
+  }
+  for (std::size_t i = n; i-- > 0;) {
+    for (std::size_t k = i + 1; k < n; k++) {
+      b[i] -= l[k * n + i] * b[k];
+    }
+    b[i] /= l[i * n + i];
+  }
+}
+
+// Factors the covariances C between the neighbours. The ordinary kriging
+// system [C 1; 1^T 0] [w; mu] = [c; 1] is then solved per pixel through
+// a = C^-1 c and mu = (1^T a - 1) / (1^T C^-1 1), w = a - mu C^-1 1. Returns
+// false if it cannot be solved.
+static bool factor_system(const CovarianceTable& covariance, double sill,
+                          KrigingScratch& scratch) {
+  const auto& sites = scratch.sites;
+  const auto& neighbours = scratch.neighbours;
+  const std::size_t n = neighbours.size();
+  auto& matrix = scratch.matrix;
+  matrix.resize(n * n);
+  for (std::size_t i = 0; i < n; i++) {
+    const double x = sites.x[neighbours[i]];
+    const double y = sites.y[neighbours[i]];
+    for (std::size_t j = 0; j < i; j++) {
+      const double dx = x - sites.x[neighbours[j]];
+      const double dy = y - sites.y[neighbours[j]];
+      matrix[i * n + j] = covariance(std::sqrt(dx * dx + dy * dy));
+    }
+    // Keeps the system solvable if two measurements share a position
+    matrix[i * n + i] = sill + 1e-4 * sill;
+  }
+  if (!cholesky_decompose(matrix, n)) {
+    return false;
+  }
+  scratch.ones.assign(n, 1.0);
+  cholesky_solve(matrix, n, scratch.ones);
+  scratch.ones_sum = 0.0;
+  for (const auto value : scratch.ones) {
+    scratch.ones_sum += value;
+  }
+  return scratch.ones_sum > 0.0;
+}
+
+static void krige_tile(const SiteGrid& grid, const Variogram& variogram,
+                       const CovarianceTable& covariance,
+                       const Valeronoi::state::Layer* mask,
+                       Valeronoi::state::InterpolatedRaster& prediction,
+                       Valeronoi::state::InterpolatedRaster& variance,
+                       int index, KrigingScratch& scratch) {
+  const Tile tile(prediction, index);
+  const auto nan = std::numeric_limits<float>::quiet_NaN();
+  if (tile_masked(mask, prediction, tile)) {
+    fill_tile(prediction, tile, nan);
+    fill_tile(variance, tile, nan);
+    return;
+  }
+  auto& sites = scratch.sites;
+  gather_sites(grid, tile, sites);
+  if (sites.x.empty()) {
+    fill_tile(prediction, tile, nan);
+    fill_tile(variance, tile, nan);
+    return;
+  }
+  // Indices refer to the sites of the previous tile
+  scratch.factored.clear();
+  scratch.factored_valid = false;
+
+  constexpr float r2 =
+      static_cast<float>(INTERPOLATION_RADIUS * INTERPOLATION_RADIUS);
+  const double sill = variogram.nugget + variogram.partial_sill;
+  auto& distances = scratch.distances;
+  auto& neighbours = scratch.neighbours;
+  auto& covariances = scratch.covariances;
+  auto& solution = scratch.solution;
+  distances.resize(sites.x.size());
+  for (int row = tile.row_start; row < tile.row_end; row++) {
+    const auto offset = static_cast<std::size_t>(row) * prediction.width;
+    const auto py = pixel_center(prediction.y, row, prediction.pixel_size);
+    for (int column = tile.column_start; column < tile.column_end;
+         column++) {
+      const auto px =
+          pixel_center(prediction.x, column, prediction.pixel_size);
+      if (masked(mask, px, py)) {
+        prediction.values[offset + column] = nan;
+        variance.values[offset + column] = nan;
+        continue;
+      }
+      // Every pixel uses the KRIGING_NEIGHBOURS closest measurements within
+      // the radius. The tile contains all of them, so the result does not
+      // depend on the tile the pixel belongs to.
+      neighbours.clear();
+      for (std::size_t i = 0; i < sites.x.size(); i++) {
+        const float dx = sites.x[i] - px;
+        const float dy = sites.y[i] - py;
+        distances[i] = dx * dx + dy * dy;
+        if (distances[i] <= r2) {
+          neighbours.push_back(i);
+        }
+      }
+      // Same coverage as interpolate(), far away from all measurements
+      // kriging just predicts the mean
+      if (neighbours.empty()) {
+        prediction.values[offset + column] = nan;
+        variance.values[offset + column] = nan;
+        continue;
+      }
+      if (neighbours.size() > KRIGING_NEIGHBOURS) {
+        // Ties are broken by position, the order of the sites depends on
+        // the tile
+        std::nth_element(neighbours.begin(),
+                         neighbours.begin() + KRIGING_NEIGHBOURS,
+                         neighbours.end(), [&](std::size_t a, std::size_t b) {
+                           return std::tie(distances[a], sites.x[a],
+                                           sites.y[a]) <
+                                  std::tie(distances[b], sites.x[b],
+                                           sites.y[b]);
+                         });
+        neighbours.resize(KRIGING_NEIGHBOURS);
+      }
+      // Neighbouring pixels mostly share their neighbours, so the last
+      // factorization can usually be reused
+      std::sort(neighbours.begin(), neighbours.end());
+      if (neighbours != scratch.factored) {
+        scratch.factored = neighbours;
+        scratch.factored_valid = factor_system(covariance, sill, scratch);
+      }
+      if (!scratch.factored_valid) {
+        prediction.values[offset + column] = nan;
+        variance.values[offset + column] = nan;
+        continue;
+      }
+
+      const std::size_t n = neighbours.size();
+      covariances.resize(n);
+      for (std::size_t i = 0; i < n; i++) {
+        const auto distance = static_cast<double>(distances[neighbours[i]]);
+        covariances[i] = covariance(std::sqrt(distance));
+      }
+      solution = covariances;
+      cholesky_solve(scratch.matrix, n, solution);
+      double mu{-1.0};
+      for (const auto a : solution) {
+        mu += a;
+      }
+      mu /= scratch.ones_sum;
+
+      double value{0.0}, error{sill - mu};
+      for (std::size_t i = 0; i < n; i++) {
+        const double weight = solution[i] - mu * scratch.ones[i];
+        value += weight * sites.value[neighbours[i]];
+        error -= weight * covariances[i];
+      }
+      prediction.values[offset + column] = static_cast<float>(value);
+      variance.values[offset + column] =
+          static_cast<float>(std::max(error, 0.0));
+    }
+  }
+}
+
+KrigingResult krige(const Valeronoi::state::MeasurementSnapshot& measurements,
+                    int pixel_size, const std::function<bool()>& cancelled,
+                    const Valeronoi::state::Layer* mask) {
+  KrigingResult result;
+  if (measurements.empty() || pixel_size <= 0) {
+    return result;
+  }
+  result.variogram = fit_variogram(measurements);
+  if (cancelled && cancelled()) {
+    return result;
+  }
+
+  const SiteGrid grid(measurements);
+  const CovarianceTable covariance(result.variogram);
+  auto prediction = make_raster(grid, pixel_size);
+  auto variance = make_raster(grid, pixel_size);
+  const bool finished = run_tiles<KrigingScratch>(
+      tile_count(*prediction), cancelled,
+      [&](int tile, KrigingScratch& scratch) {
+        krige_tile(grid, result.variogram, covariance, mask, *prediction,
+                   *variance, tile, scratch);
+      });
+  if (finished) {
+    result.prediction = prediction;
+    result.variance = variance;
+  }
+  return result;
+}
+
+}  // namespace Valeronoi::util
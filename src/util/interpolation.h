@@ -0,0 +1,89 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_UTIL_INTERPOLATION_H
+#define VALERONOI_UTIL_INTERPOLATION_H
+
+#include <cstddef>
+#include <functional>
+
+#include "../state/state.h"
+
+namespace Valeronoi::util {
+
+// Measurements further away than this (in map units) do not influence a pixel
+constexpr int INTERPOLATION_RADIUS{200};
+// Pixels are interpolated in square tiles, which are distributed over threads
+constexpr int INTERPOLATION_TILE_SIZE{32};
+
+// Interpolates the averages of the measurements on a raster with the given
+// pixel size, using inverse distance weighting with a smooth falloff to zero
+// at INTERPOLATION_RADIUS. Pixels whose center is not part of mask are left
+// empty without being computed. Returns nullptr if there is nothing to
+// interpolate or cancelled returned true.
+Valeronoi::state::InterpolatedRasterPtr interpolate(
+    const Valeronoi::state::MeasurementSnapshot& measurements, int pixel_size,
+    const std::function<bool()>& cancelled = {},
+    const Valeronoi::state::Layer* mask = nullptr);
+
+// Number of closest measurements within INTERPOLATION_RADIUS used for the
+// kriging system of a pixel
+constexpr std::size_t KRIGING_NEIGHBOURS{16};
+// The empirical variogram is estimated from at most this many measurements
+constexpr std::size_t VARIOGRAM_MAX_SITES{2000};
+constexpr int VARIOGRAM_BINS{15};
+
+// Exponential variogram model, gamma(h) = nugget + partial_sill *
+// (1 - exp(-3h / range))
+struct Variogram {
+  double nugget{0.0};
+  double partial_sill{1.0};
+  // Practical range, where 95% of the sill is reached, in map units
+  double range{INTERPOLATION_RADIUS};
+
+  [[nodiscard]] double operator()(double h) const;
+
+  [[nodiscard]] double covariance(double h) const;
+};
+
+// Fits the variogram model to the empirical semivariances of (a sample of)
+// all measurement pairs
+Variogram fit_variogram(
+    const Valeronoi::state::MeasurementSnapshot& measurements);
+
+struct KrigingResult {
+  Valeronoi::state::InterpolatedRasterPtr prediction;
+  // Kriging variance in dB², high where more measurements would improve the
+  // prediction
+  Valeronoi::state::InterpolatedRasterPtr variance;
+  Variogram variogram;
+};
+
+// Ordinary kriging of the measurement averages on the same raster as
+// interpolate(). Every pixel solves a local system with its
+// KRIGING_NEIGHBOURS closest measurements, factorizations are shared by
+// neighbouring pixels with the same neighbourhood. Prediction and variance
+// come from the same systems. mask works as for interpolate(). Both rasters
+// are nullptr if there is nothing to interpolate or cancelled returned true.
+KrigingResult krige(const Valeronoi::state::MeasurementSnapshot& measurements,
+                    int pixel_size,
+                    const std::function<bool()>& cancelled = {},
+                    const Valeronoi::state::Layer* mask = nullptr);
+
+}  // namespace Valeronoi::util
+
+#endif
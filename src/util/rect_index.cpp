@@ -0,0 +1,87 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "rect_index.h"
+
+#include <algorithm>
+
+namespace Valeronoi::util {
+
+RectIndex::RectIndex(std::vector<QRect> rects, int bucket_size)
+    : m_rects{std::move(rects)}, m_bucket_size{std::max(bucket_size, 1)} {
+  for (const auto& rect : m_rects) {
+    m_bounds |= rect;
+  }
+  if (m_bounds.isEmpty()) {
+    return;
+  }
+  m_columns = (m_bounds.width() + m_bucket_size - 1) / m_bucket_size;
+  m_rows = (m_bounds.height() + m_bucket_size - 1) / m_bucket_size;
+  m_buckets.resize(static_cast<std::size_t>(m_columns) * m_rows);
+  for (int i = 0; i < static_cast<int>(m_rects.size()); i++) {
+    const auto& rect = m_rects[i];
+    if (rect.isEmpty()) {
+      continue;
+    }
+    const int column_start = (rect.left() - m_bounds.x()) / m_bucket_size;
+    const int column_end = (rect.right() - m_bounds.x()) / m_bucket_size;
+    const int row_start = (rect.top() - m_bounds.y()) / m_bucket_size;
+    const int row_end = (rect.bottom() - m_bounds.y()) / m_bucket_size;
+    for (int row = row_start; row <= row_end; row++) {
+      for (int column = column_start; column <= column_end; column++) {
+        m_buckets[static_cast<std::size_t>(row) * m_columns + column]
+            .push_back(i);
+      }
+    }
+  }
+}
+
+void RectIndex::query(const QRect& area, std::vector<int>& indices) const {
+  indices.clear();
+  const auto clamped = area & m_bounds;
+  if (clamped.isEmpty()) {
+    return;
+  }
+  if (clamped == m_bounds) {
+    // Everything is visible when zoomed out, skip the buckets
+    for (int i = 0; i < static_cast<int>(m_rects.size()); i++) {
+      if (!m_rects[i].isEmpty()) {
+        indices.push_back(i);
+      }
+    }
+    return;
+  }
+  const int column_start = (clamped.left() - m_bounds.x()) / m_bucket_size;
+  const int column_end = (clamped.right() - m_bounds.x()) / m_bucket_size;
+  const int row_start = (clamped.top() - m_bounds.y()) / m_bucket_size;
+  const int row_end = (clamped.bottom() - m_bounds.y()) / m_bucket_size;
+  for (int row = row_start; row <= row_end; row++) {
+    for (int column = column_start; column <= column_end; column++) {
+      for (const auto index :
+           m_buckets[static_cast<std::size_t>(row) * m_columns + column]) {
+        if (m_rects[index].intersects(area)) {
+          indices.push_back(index);
+        }
+      }
+    }
+  }
+  // Rects spanning several buckets are found more than once
+  std::sort(indices.begin(), indices.end());
+  indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+}
+
+}  // namespace Valeronoi::util
@@ -0,0 +1,58 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_UTIL_RECT_INDEX_H
+#define VALERONOI_UTIL_RECT_INDEX_H
+
+#include <QRect>
+#include <vector>
+
+namespace Valeronoi::util {
+
+// Default edge length of the buckets, in map units
+constexpr int RECT_INDEX_BUCKET_SIZE{256};
+
+// Rects sorted into a uniform grid of buckets by the area they cover, to
+// find the ones intersecting an area without looking at all of them
+class RectIndex {
+ public:
+  explicit RectIndex(std::vector<QRect> rects = {},
+                     int bucket_size = RECT_INDEX_BUCKET_SIZE);
+
+  // Indices of all rects intersecting area, in ascending order
+  void query(const QRect& area, std::vector<int>& indices) const;
+
+  [[nodiscard]] const QRect& rect(int index) const { return m_rects[index]; }
+
+  [[nodiscard]] int size() const { return static_cast<int>(m_rects.size()); }
+
+  [[nodiscard]] bool empty() const { return m_rects.empty(); }
+
+  // Bounding box of all rects
+  [[nodiscard]] const QRect& bounds() const { return m_bounds; }
+
+ private:
+  std::vector<QRect> m_rects;
+  QRect m_bounds;
+  int m_bucket_size;
+  int m_columns{0}, m_rows{0};
+  std::vector<std::vector<int>> m_buckets;
+};
+
+}  // namespace Valeronoi::util
+
+#endif
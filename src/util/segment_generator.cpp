@@ -18,35 +18,86 @@
 #include "segment_generator.h"
 
 #include <CGAL/Delaunay_triangulation_2.h>
-#include <CGAL/Delaunay_triangulation_adaptation_policies_2.h>
-#include <CGAL/Delaunay_triangulation_adaptation_traits_2.h>
 #include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
-#include <CGAL/Voronoi_diagram_2.h>
 
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
 #include <map>
+#include <set>
 #include <utility>
+#include <vector>
+
+#include "interpolation.h"
 
 typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
 typedef CGAL::Delaunay_triangulation_2<K> DT;
-typedef CGAL::Delaunay_triangulation_adaptation_traits_2<DT> AT;
-typedef CGAL::Delaunay_triangulation_caching_degeneracy_removal_policy_2<DT> AP;
-typedef CGAL::Voronoi_diagram_2<DT, AT, AP> VD;
-
-typedef AT::Site_2 Site_2;
-typedef AT::Point_2 Point_2;
-typedef VD::Locate_result Locate_result;
-typedef VD::Face_handle Face_handle;
-typedef VD::Halfedge_handle Halfedge_handle;
-typedef VD::Ccb_halfedge_circulator Ccb_halfedge_circulator;
-
-#if CGAL_VERSION_NR < CGAL_VERSION_NUMBER(6, 0, 0)
-#define GET_IF boost::get<Face_handle>
-#else
-#define GET_IF std::get_if<Face_handle>
-#endif
+
+typedef DT::Point Point_2;
+typedef DT::Vertex_handle Vertex_handle;
+typedef DT::Face_handle Face_handle;
+typedef DT::Face_circulator Face_circulator;
+typedef DT::Vertex_circulator Vertex_circulator;
 
 namespace Valeronoi::util {
 
+typedef std::pair<int, int> SitePosition;
+
+struct VoronoiCell {
+  Vertex_handle vertex;
+  QPolygon polygon;
+  // polygon clipped to the region of VoronoiState, if clipped is set
+  std::vector<QPolygon> parts;
+  bool clipped{false};
+  unsigned int generation{0};
+};
+
+struct SegmentGenerator::VoronoiState {
+  DT dt;
+  int simplify{0};
+  int wifi_id_filter{-1};
+  // New sites within this area can be inserted without a full rebuild. It is
+  // well inside the frame of dummy points, so all cells stay bounded.
+  int x_min{0}, x_max{0}, y_min{0}, y_max{0};
+  unsigned int generation{0};
+  std::map<SitePosition, VoronoiCell> cells;
+  // Region the parts of the cells are clipped to
+  std::shared_ptr<const Valeronoi::state::Layer> clip_floor;
+  int clip_point_distance{0};
+};
+
+// The Voronoi cell of a site is the dual of its Delaunay vertex: the
+// circumcenters of all incident faces in counterclockwise order.
+static QPolygon extract_cell(const DT& dt, Vertex_handle vertex) {
+  QPolygon polygon;
+  Face_circulator fc_start = dt.incident_faces(vertex);
+  if (fc_start == nullptr) {
+    return polygon;
+  }
+  Face_circulator fc = fc_start;
+  do {
+    const Face_handle face = fc;
+    if (dt.is_infinite(face)) {
+      // Unbounded cell, only happens for the dummy points
+      return {};
+    }
+    const auto center = dt.circumcenter(face);
+    const QPoint point(center.x(), center.y());
+    // Cocircular sites produce the same Voronoi vertex multiple times
+    if (polygon.isEmpty() || polygon.last() != point) {
+      polygon << point;
+    }
+  } while (++fc != fc_start);
+  if (polygon.size() > 1 && polygon.first() == polygon.last()) {
+    polygon.removeLast();
+  }
+  return polygon;
+}
+
+SegmentGenerator::SegmentGenerator(QObject* parent) : QThread(parent) {
+  m_pool.setThreadPriority(LowPriority);
+}
+
 SegmentGenerator::~SegmentGenerator() {
   m_mutex.lock();
   m_abort = true;
@@ -60,147 +111,536 @@ void SegmentGenerator::generate(
     const Valeronoi::state::RawMeasurements& measurements,
     Valeronoi::state::DISPLAY_MODE display_mode, int simplify,
     int wifi_id_filter) {
+  generate(Valeronoi::state::MeasurementSnapshot(measurements), display_mode,
+           simplify, wifi_id_filter);
+}
+
+void SegmentGenerator::generate(
+    const Valeronoi::state::MeasurementSnapshot& measurements,
+    Valeronoi::state::DISPLAY_MODE display_mode, int simplify,
+    int wifi_id_filter) {
   QMutexLocker locker(&m_mutex);
 
+  // The same inputs would only yield the same result again
+  if (m_requested && !m_inputs_changed &&
+      measurements.version() == m_measurements.version() &&
+      measurements.shares_data(m_measurements) &&
+      display_mode == m_display_mode && simplify == m_simplify &&
+      wifi_id_filter == m_wifi_id_filter) {
+    return;
+  }
+  m_requested = true;
+  m_inputs_changed = false;
   m_measurements = measurements;
   m_display_mode = display_mode;
   m_simplify = simplify;
   m_wifi_id_filter = wifi_id_filter;
+  if (!m_latency_timer.isValid()) {
+    m_latency_timer.start();
+  }
 
   if (!isRunning()) {
+    m_busy = true;
     start(LowPriority);
+  } else if (!m_busy) {
+    m_pending = true;
+    m_condition.wakeOne();
+  } else if (m_latency_timer.elapsed() >= m_max_latency.count()) {
+    // Overdue, so the current generation finishes and the new inputs are
+    // picked up right after it
+    m_pending = true;
   } else {
     m_restart = true;
-    m_condition.wakeOne();
+    m_restarts++;
+  }
+}
+
+bool SegmentGenerator::cancelled() const { return m_abort || m_restart; }
+
+void SegmentGenerator::wait_for_restart() {
+  m_mutex.lock();
+  if (!m_restart && !m_pending && !m_abort) {
+    m_busy = false;
+    m_condition.wait(&m_mutex);
   }
+  m_busy = true;
+  m_restart = false;
+  m_pending = false;
+  m_mutex.unlock();
+}
+
+void SegmentGenerator::set_pixel_size(int pixel_size) {
+  QMutexLocker locker(&m_mutex);
+  pixel_size = std::max(pixel_size, 1);
+  m_inputs_changed |= pixel_size != m_pixel_size;
+  m_pixel_size = pixel_size;
+}
+
+void SegmentGenerator::set_mask(
+    std::shared_ptr<const Valeronoi::state::Layer> mask) {
+  QMutexLocker locker(&m_mutex);
+  m_inputs_changed |= mask != m_mask;
+  m_mask = std::move(mask);
+}
+
+void SegmentGenerator::set_restrict_points(bool enabled) {
+  QMutexLocker locker(&m_mutex);
+  m_inputs_changed |= enabled != m_restrict_points;
+  m_restrict_points = enabled;
+}
+
+void SegmentGenerator::set_max_latency(std::chrono::milliseconds max_latency) {
+  QMutexLocker locker(&m_mutex);
+  m_max_latency = max_latency;
 }
 
 void SegmentGenerator::run() {
   while (true) {
     m_mutex.lock();
-    auto measurements = m_measurements;
-    const auto display_mode = m_display_mode;
-    const auto simplify = m_simplify;
-    const auto wifi_id_filter = m_wifi_id_filter;
+    // Only shares the measurement data, no samples are copied
+    const auto measurements = m_measurements;
+    // The raster resolution only matters for interpolation and the clip
+    // region only for modes that cover areas, so the other display modes are
+    // cached independently of them
+    const bool raster = state::is_raster_mode(m_display_mode);
+    const bool voronoi = m_display_mode == state::DISPLAY_MODE::Voronoi;
+    const CacheKey key{m_wifi_id_filter,
+                       m_simplify,
+                       m_display_mode,
+                       raster ? m_pixel_size : 0,
+                       raster || voronoi ? m_mask : nullptr,
+                       voronoi && m_restrict_points};
     m_mutex.unlock();
     if (m_abort) {
       return;
     }
 
-    Valeronoi::state::RawMeasurements processed_measurements;
-    if (simplify > 1 || wifi_id_filter != -1) {
-      std::map<std::pair<int, int>, Valeronoi::state::Measurement>
-          simplified_map;
-      for (const auto& m : measurements) {
-        if (m_abort || m_restart) {
-          break;
-        }
-        if (wifi_id_filter != -1 && m.wifi_id != wifi_id_filter) {
-          continue;  // Skip and probe next one
-        }
-
-        int x = m.x;
-        int y = m.y;
-        if (simplify > 1) {
-          x = (m.x / simplify) * simplify;
-          y = (m.y / simplify) * simplify;
-        }
+    if (!measurements.shares_data(m_cached_measurements)) {
+      invalidate_cache(measurements);
+      m_cached_measurements = measurements;
+      m_pyramid.update(measurements);
+    }
 
-        auto& sm = simplified_map[{x, y}];
-        if (sm.data.empty()) {
-          sm.x = x;
-          sm.y = y;
-          sm.wifi_id = m.wifi_id;
-        }
-        for (const auto d : m.data) {
-          sm.data.push_back(d);
-        }
-      }
+    const auto cached = m_cache.find(key);
+    if (cached != m_cache.end()) {
+      cached->second.last_used = ++m_cache_clock;
+      emit_generated(key, cached->second.generated);
+    } else {
+      generate_all(measurements, key);
+    }
+    if (m_abort) {
+      return;
+    }
+    wait_for_restart();
+  }
+}
 
-      if (m_abort || m_restart) {
-        m_mutex.lock();
-        if (!m_restart) {
-          m_condition.wait(&m_mutex);
-        }
-        m_restart = false;
-        m_mutex.unlock();
+// Adds the access points of all places that were added, removed or modified
+// between both snapshots to changed
+static void changed_wifi_ids(
+    const Valeronoi::state::MeasurementSnapshot& before,
+    const Valeronoi::state::MeasurementSnapshot& after,
+    std::set<int>& changed) {
+  const auto chunks = std::max(before.chunk_count(), after.chunk_count());
+  for (std::size_t i = 0; i < chunks; i++) {
+    const auto* old_chunk =
+        i < before.chunk_count() ? before.chunk(i).get() : nullptr;
+    const auto* new_chunk =
+        i < after.chunk_count() ? after.chunk(i).get() : nullptr;
+    // Shared chunks are unchanged, only modified ones are compared
+    if (old_chunk == new_chunk) {
+      continue;
+    }
+    const auto old_size = old_chunk ? old_chunk->size() : 0;
+    const auto new_size = new_chunk ? new_chunk->size() : 0;
+    for (std::size_t j = 0; j < std::max(old_size, new_size); j++) {
+      const auto* old_place = j < old_size ? &(*old_chunk)[j] : nullptr;
+      const auto* new_place = j < new_size ? &(*new_chunk)[j] : nullptr;
+      if (old_place && new_place && old_place->x == new_place->x &&
+          old_place->y == new_place->y &&
+          old_place->wifi_id == new_place->wifi_id &&
+          old_place->data == new_place->data) {
         continue;
       }
-
-      for (auto& [pos, sm] : simplified_map) {
-        double avg = 0;
-        for (const auto& d : sm.data) {
-          avg += d;
-        }
-        sm.average = avg / sm.data.size();
-        processed_measurements.push_back(std::move(sm));
+      if (old_place) {
+        changed.insert(old_place->wifi_id);
+      }
+      if (new_place) {
+        changed.insert(new_place->wifi_id);
       }
+    }
+  }
+}
+
+void SegmentGenerator::invalidate_cache(
+    const Valeronoi::state::MeasurementSnapshot& measurements) {
+  std::set<int> changed;
+  changed_wifi_ids(m_cached_measurements, measurements, changed);
+  if (changed.empty()) {
+    return;
+  }
+  for (auto it = m_cache.begin(); it != m_cache.end();) {
+    const auto wifi_id = it->first.wifi_id_filter;
+    if (wifi_id == -1 || changed.count(wifi_id) > 0) {
+      it = m_cache.erase(it);
     } else {
-      processed_measurements = std::move(measurements);
+      ++it;
     }
+  }
+}
 
-    if (m_abort || m_restart) {
-      m_mutex.lock();
-      if (!m_restart) {
-        m_condition.wait(&m_mutex);
-      }
-      m_restart = false;
-      m_mutex.unlock();
-      continue;
+void SegmentGenerator::cache(const CacheKey& key, Generated generated) {
+  if (generated.companion_raster) {
+    auto companion_key = key;
+    companion_key.display_mode =
+        key.display_mode == state::DISPLAY_MODE::Kriging
+            ? state::DISPLAY_MODE::KrigingVariance
+            : state::DISPLAY_MODE::Kriging;
+    Generated companion{generated.segments,
+                        std::move(generated.companion_raster), nullptr};
+    generated.companion_raster = nullptr;
+    cache(companion_key, std::move(companion));
+  }
+  auto& entry = m_cache[key];
+  entry.generated = std::move(generated);
+  entry.last_used = ++m_cache_clock;
+  while (m_cache.size() > SEGMENT_CACHE_SIZE) {
+    m_cache.erase(std::min_element(m_cache.begin(), m_cache.end(),
+                                   [](const auto& a, const auto& b) {
+                                     return a.second.last_used <
+                                            b.second.last_used;
+                                   }));
+  }
+}
+
+void SegmentGenerator::emit_generated(const CacheKey& key,
+                                      const Generated& generated) {
+  m_emitted_key = key;
+  m_emitted_sites =
+      generated.segments ? static_cast<std::size_t>(generated.segments->size())
+                         : 0;
+  qint64 latency{0};
+  int restarts{0};
+  {
+    QMutexLocker locker(&m_mutex);
+    latency = m_latency_timer.isValid() ? m_latency_timer.elapsed() : 0;
+    restarts = m_restarts;
+    m_restarts = 0;
+    // Inputs that arrived meanwhile are still waiting for their result
+    if (m_pending || m_restart) {
+      m_latency_timer.start();
+    } else {
+      m_latency_timer.invalidate();
     }
+  }
+  emit generated_raster(generated.raster);
+  emit generated_segments(generated.segments);
+  emit generated_statistics(latency, restarts);
+}
 
-    Valeronoi::state::DataSegments segments;
-
-    switch (display_mode) {
-      case state::DISPLAY_MODE::Voronoi:
-        generate_voronoi(processed_measurements, segments);
-        break;
-      case state::DISPLAY_MODE::DataPoints:
-        for (const auto& m : processed_measurements) {
-          Valeronoi::state::DataSegment s;
-          s.x = m.x;
-          s.y = m.y;
-          s.value = m.average;
-          segments.push_back(s);
-        }
-        break;
-      case state::DISPLAY_MODE::None:
-        break;
+void SegmentGenerator::emit_preview(
+    const CacheKey& key,
+    const Valeronoi::state::MeasurementSnapshot& measurements) {
+  // While recording, the last result of the same key is a better preview
+  // than the data points
+  if (measurements.size() < PREVIEW_MIN_SITES ||
+      (m_emitted_key == key && measurements.size() <= 2 * m_emitted_sites)) {
+    return;
+  }
+  auto segments = std::make_shared<Valeronoi::state::DataSegments>();
+  segments->preview = true;
+  segments->reserve(measurements.size());
+  for (const auto& m : measurements) {
+    segments->add(m.x, m.y, m.average);
+  }
+  m_emitted_key.reset();
+  emit generated_raster(nullptr);
+  emit generated_segments(segments);
+}
+
+void SegmentGenerator::generate_all(
+    const Valeronoi::state::MeasurementSnapshot& measurements,
+    const CacheKey& key) {
+  std::set<int> wifi_ids{-1};
+  for (const auto& m : measurements) {
+    wifi_ids.insert(m.wifi_id);
+  }
+  auto& levels = m_voronoi_simplify;
+  levels.erase(std::remove(levels.begin(), levels.end(), key.simplify),
+               levels.end());
+  levels.insert(levels.begin(), key.simplify);
+  if (levels.size() > VORONOI_SIMPLIFY_LEVELS) {
+    levels.resize(VORONOI_SIMPLIFY_LEVELS);
+  }
+  // Diagrams of access points that are gone would never be used again
+  for (auto it = m_voronoi.begin(); it != m_voronoi.end();) {
+    const auto [wifi_id, simplify] = it->first;
+    if ((wifi_id != key.wifi_id_filter && wifi_ids.count(wifi_id) == 0) ||
+        std::find(levels.begin(), levels.end(), simplify) == levels.end()) {
+      it = m_voronoi.erase(it);
+    } else {
+      ++it;
     }
+  }
 
-    if (m_abort || m_restart) {
-      m_mutex.lock();
-      if (!m_restart) {
-        m_condition.wait(&m_mutex);
-      }
-      m_restart = false;
-      m_mutex.unlock();
-      continue;
+  struct Job {
+    CacheKey key;
+    std::unique_ptr<VoronoiState>* voronoi;
+    Generated generated;
+    bool done{false};
+  };
+  std::vector<Job> jobs;
+  for (const auto wifi_id : wifi_ids) {
+    auto job_key = key;
+    job_key.wifi_id_filter = wifi_id;
+    if (wifi_id != key.wifi_id_filter && m_cache.count(job_key) == 0) {
+      jobs.push_back(
+          {job_key, &m_voronoi[{wifi_id, key.simplify}], {}, false});
     }
+  }
+  auto& voronoi = m_voronoi[{key.wifi_id_filter, key.simplify}];
 
-    emit generated_segments(segments);
+  // The requested access point is generated on this thread, so it is never
+  // queued behind the others
+  for (auto& job : jobs) {
+    m_pool.start([this, &job, &measurements]() {
+      job.done = generate_segments(measurements, job.key, *job.voronoi,
+                                   job.generated);
+    });
+  }
 
-    m_mutex.lock();
-    if (!m_restart) {
-      m_condition.wait(&m_mutex);
+  Generated generated;
+  const bool done = generate_segments(
+      measurements, key, voronoi, generated,
+      [this, &key](const Valeronoi::state::MeasurementSnapshot& processed) {
+        emit_preview(key, processed);
+      });
+  if (done) {
+    emit_generated(key, generated);
+  }
+
+  // Jobs reference locals of this function, so they have to be finished
+  // before returning, even if cancelled
+  m_pool.waitForDone();
+  for (auto& job : jobs) {
+    if (job.done) {
+      cache(job.key, std::move(job.generated));
     }
-    m_restart = false;
-    m_mutex.unlock();
   }
+  // Cached last, so the other access points cannot push it out
+  if (done) {
+    cache(key, std::move(generated));
+  }
+}
+
+bool SegmentGenerator::generate_segments(
+    const Valeronoi::state::MeasurementSnapshot& measurements,
+    const CacheKey& key, std::unique_ptr<VoronoiState>& voronoi,
+    Generated& generated,
+    const std::function<void(const Valeronoi::state::MeasurementSnapshot&)>&
+        preview) const {
+  Valeronoi::state::MeasurementSnapshot processed_measurements;
+  if (key.simplify > 1 || key.wifi_id_filter != -1) {
+    if (!simplify_measurements(key.simplify, key.wifi_id_filter,
+                               processed_measurements)) {
+      return false;
+    }
+  } else {
+    processed_measurements = measurements;
+  }
+
+  if (cancelled()) {
+    return false;
+  }
+  if (preview && (key.display_mode == state::DISPLAY_MODE::Voronoi ||
+                  state::is_raster_mode(key.display_mode))) {
+    preview(processed_measurements);
+  }
+
+  auto segments = std::make_shared<Valeronoi::state::DataSegments>();
+  switch (key.display_mode) {
+    case state::DISPLAY_MODE::Voronoi:
+      generate_voronoi(voronoi, processed_measurements, key, *segments);
+      break;
+    case state::DISPLAY_MODE::Interpolated:
+      generated.raster =
+          interpolate(processed_measurements, key.pixel_size,
+                      [this]() { return cancelled(); }, key.mask.get());
+      break;
+    case state::DISPLAY_MODE::Kriging:
+    case state::DISPLAY_MODE::KrigingVariance: {
+      auto result = krige(processed_measurements, key.pixel_size,
+                          [this]() { return cancelled(); }, key.mask.get());
+      if (key.display_mode == state::DISPLAY_MODE::Kriging) {
+        generated.raster = std::move(result.prediction);
+        generated.companion_raster = std::move(result.variance);
+      } else {
+        generated.raster = std::move(result.variance);
+        generated.companion_raster = std::move(result.prediction);
+      }
+      break;
+    }
+    case state::DISPLAY_MODE::DataPoints:
+    case state::DISPLAY_MODE::None:
+      break;
+  }
+
+  // Raster modes use the measured points for the legend and clipping
+  if (key.display_mode == state::DISPLAY_MODE::DataPoints ||
+      generated.raster) {
+    segments->reserve(processed_measurements.size());
+    for (const auto& m : processed_measurements) {
+      segments->add(m.x, m.y, m.average);
+    }
+  }
+  generated.segments = std::move(segments);
+  return !cancelled();
+}
+
+bool SegmentGenerator::simplify_measurements(
+    int simplify, int wifi_id_filter,
+    Valeronoi::state::MeasurementSnapshot& simplified) const {
+  if (cancelled()) {
+    return false;
+  }
+  simplified = Valeronoi::state::MeasurementSnapshot(
+      m_pyramid.simplify(simplify, wifi_id_filter));
+  return true;
+}
+
+Valeronoi::state::DataSegments SegmentGenerator::voronoi_segments(
+    const Valeronoi::state::RawMeasurements& measurements) {
+  Valeronoi::state::DataSegments segments;
+  if (measurements.size() >= 2) {
+    const Valeronoi::state::MeasurementSnapshot snapshot(measurements);
+    const auto state = build_voronoi(snapshot);
+    collect_segments(*state, snapshot, CellClipper(nullptr, {}, 0), segments);
+  }
+  return segments;
 }
 
 void SegmentGenerator::generate_voronoi(
-    const Valeronoi::state::RawMeasurements& measurements,
-    Valeronoi::state::DataSegments& segments) {
+    std::unique_ptr<VoronoiState>& voronoi,
+    const Valeronoi::state::MeasurementSnapshot& measurements,
+    const CacheKey& key, Valeronoi::state::DataSegments& segments) {
   if (measurements.size() < 2) {
+    voronoi.reset();
     return;
   }
-  VD vd;
+  const auto simplify = key.simplify;
+  const auto wifi_id_filter = key.wifi_id_filter;
+
+  // While recording, a run usually only adds one site to the last diagram.
+  // Insert new sites into the existing triangulation and only extract the
+  // cells that changed, unless the input changed in a way that requires a full
+  // rebuild.
+  bool rebuild = !voronoi || voronoi->simplify != simplify ||
+                 voronoi->wifi_id_filter != wifi_id_filter;
+  std::vector<SitePosition> new_sites;
+  if (!rebuild) {
+    const auto generation = ++voronoi->generation;
+    std::size_t known_sites{0};
+    for (const auto& m : measurements) {
+      const SitePosition site{m.x, m.y};
+      auto [it, inserted] = voronoi->cells.try_emplace(site);
+      if (inserted) {
+        if (m.x < voronoi->x_min || m.x > voronoi->x_max ||
+            m.y < voronoi->y_min || m.y > voronoi->y_max) {
+          rebuild = true;
+          break;
+        }
+        new_sites.push_back(site);
+      } else if (it->second.generation != generation) {
+        known_sites++;
+      }
+      it->second.generation = generation;
+    }
+    // Sites were removed, so this is a different data set. Many new sites
+    // are inserted faster in bulk.
+    rebuild = rebuild ||
+              known_sites + new_sites.size() != voronoi->cells.size() ||
+              new_sites.size() > known_sites / 2;
+  }
+
+  if (rebuild) {
+    voronoi = build_voronoi(measurements);
+    voronoi->simplify = simplify;
+    voronoi->wifi_id_filter = wifi_id_filter;
+  } else if (!new_sites.empty()) {
+    // Inserting a site only changes its own cell and the cells of its
+    // Delaunay neighbours
+    auto& dt = voronoi->dt;
+    std::vector<Vertex_handle> dirty_vertices;
+    for (const auto& site : new_sites) {
+      const auto vertex = dt.insert(Point_2(site.first, site.second));
+      voronoi->cells[site].vertex = vertex;
+      dirty_vertices.push_back(vertex);
+      Vertex_circulator vc_start = dt.incident_vertices(vertex);
+      Vertex_circulator vc = vc_start;
+      do {
+        const Vertex_handle neighbour = vc;
+        if (!dt.is_infinite(neighbour)) {
+          dirty_vertices.push_back(neighbour);
+        }
+      } while (++vc != vc_start);
+    }
+    for (const auto& vertex : dirty_vertices) {
+      const auto& point = vertex->point();
+      const auto it = voronoi->cells.find(
+          {static_cast<int>(point.x()), static_cast<int>(point.y())});
+      if (it != voronoi->cells.end()) {
+        // Not a dummy point
+        it->second.polygon = extract_cell(dt, vertex);
+        it->second.clipped = false;
+      }
+    }
+  }
+
+  std::vector<QPoint> sites;
+  sites.reserve(measurements.size());
+  for (const auto& m : measurements) {
+    sites.emplace_back(m.x, m.y);
+  }
+  const auto point_distance = key.restrict_points ? CLIP_POINT_DISTANCE : 0;
+  const CellClipper clipper(key.mask.get(), sites, point_distance);
+  if (voronoi->clip_floor != key.mask ||
+      voronoi->clip_point_distance != point_distance) {
+    voronoi->clip_floor = key.mask;
+    voronoi->clip_point_distance = point_distance;
+    for (auto& cell : voronoi->cells) {
+      cell.second.clipped = false;
+    }
+  } else if (point_distance > 0) {
+    // The surroundings of new sites extend into cells that did not change
+    const int reach = clipper.reach();
+    for (const auto& site : new_sites) {
+      for (auto it = voronoi->cells.lower_bound(
+               {site.first - reach, std::numeric_limits<int>::min()});
+           it != voronoi->cells.end() && it->first.first <= site.first + reach;
+           ++it) {
+        if (std::abs(it->first.second - site.second) <= reach) {
+          it->second.clipped = false;
+        }
+      }
+    }
+  }
+
+  collect_segments(*voronoi, measurements, clipper, segments);
+}
+
+std::unique_ptr<SegmentGenerator::VoronoiState> SegmentGenerator::build_voronoi(
+    const Valeronoi::state::MeasurementSnapshot& measurements) {
+  auto state = std::make_unique<VoronoiState>();
+
+  std::vector<Point_2> points;
+  points.reserve(measurements.size() + 8);
   int x_min{0}, x_max{0}, y_min{0}, y_max{0};
   bool first{true};
   for (const auto& m : measurements) {
-    Site_2 t(m.x, m.y);
-    vd.insert(t);
+    if (!state->cells.try_emplace({m.x, m.y}).second) {
+      continue;
+    }
+    points.emplace_back(m.x, m.y);
     if (first) {
       x_min = x_max = m.x;
       y_min = y_max = m.y;
@@ -223,35 +663,52 @@ void SegmentGenerator::generate_voronoi(
   for (int y = -1; y < 2; y++) {
     for (int x = -1; x < 2; x++) {
       if (x || y) {  // No center point
-        Site_2 t(x_center + x * (x_range * 10), y_center + y * (y_range * 10));
-        vd.insert(t);
+        points.emplace_back(x_center + x * (x_range * 10),
+                            y_center + y * (y_range * 10));
       }
     }
   }
+  state->x_min = x_min - x_range;
+  state->x_max = x_max + x_range;
+  state->y_min = y_min - y_range;
+  state->y_max = y_max + y_range;
 
-  if (!vd.is_valid()) {
-    return;
+  // Range insertion sorts the points along a space filling curve first, which
+  // keeps point location walks short
+  auto& dt = state->dt;
+  dt.insert(points.begin(), points.end());
+
+  for (auto it = dt.finite_vertices_begin(); it != dt.finite_vertices_end();
+       ++it) {
+    const Vertex_handle vertex = it;
+    const auto& point = vertex->point();
+    const auto cell = state->cells.find(
+        {static_cast<int>(point.x()), static_cast<int>(point.y())});
+    if (cell != state->cells.end()) {
+      cell->second.vertex = vertex;
+      cell->second.polygon = extract_cell(dt, vertex);
+    }
   }
+  return state;
+}
+
+void SegmentGenerator::collect_segments(
+    VoronoiState& state,
+    const Valeronoi::state::MeasurementSnapshot& measurements,
+    const CellClipper& clipper, Valeronoi::state::DataSegments& segments) {
+  segments.reserve(measurements.size());
   for (const auto& m : measurements) {
-    Point_2 p(m.x, m.y);
-    auto result = vd.locate(p);
-    if (auto* v = GET_IF(&result)) {
-      Valeronoi::state::DataSegment s;
-      s.x = m.x;
-      s.y = m.y;
-      Ccb_halfedge_circulator ec_start = (*v)->ccb();
-      Ccb_halfedge_circulator ec = ec_start;
-      do {
-        if (ec->has_source()) {
-          const auto point = ec->source()->point();
-          s.polygon << QPoint(point.x(), point.y());
-        }
-      } while (++ec != ec_start);
-      s.value = m.average;
-      segments.push_back(s);
-    } else {
-      // Point is not on a face
+    const auto it = state.cells.find({m.x, m.y});
+    if (it == state.cells.end() || it->second.polygon.isEmpty()) {
+      continue;
+    }
+    auto& cell = it->second;
+    if (!cell.clipped) {
+      cell.parts = clipper.clip(cell.polygon, QPoint(m.x, m.y));
+      cell.clipped = true;
     }
+    // Cells without parts are kept, their values are still part of the legend
+    segments.add(m.x, m.y, m.average, cell.parts);
   }
 }
 
@@ -18,44 +18,228 @@
 #ifndef VALERONOI_UTIL_SEGMENT_GENERATOR_H
 #define VALERONOI_UTIL_SEGMENT_GENERATOR_H
 
+#include <QElapsedTimer>
 #include <QMutex>
 #include <QObject>
 #include <QSize>
 #include <QThread>
+#include <QThreadPool>
 #include <QWaitCondition>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "../state/state.h"
+#include "cell_clipper.h"
+#include "simplify_pyramid.h"
 
 namespace Valeronoi::util {
 
+// Slow display modes first emit a preview of this many sites or more
+constexpr std::size_t PREVIEW_MIN_SITES{2000};
+// Voronoi diagrams are kept for this many simplify levels, so going back to
+// a recent level while recording is incremental again
+constexpr std::size_t VORONOI_SIMPLIFY_LEVELS{4};
+// Results kept for other access points and settings, the least recently used
+// ones are dropped first
+constexpr std::size_t SEGMENT_CACHE_SIZE{64};
+
+// Generates the segments of the requested access point and, in parallel, of
+// all other access points in the measurements. Results are cached until the
+// measurements of their access point change, so switching between access
+// points is instant, even while recording.
 class SegmentGenerator : public QThread {
   Q_OBJECT
  public:
+  explicit SegmentGenerator(QObject* parent = nullptr);
+
   ~SegmentGenerator() override;
 
+  // Computes the Voronoi cells of all measurements in one go, without
+  // threading or state
+  static Valeronoi::state::DataSegments voronoi_segments(
+      const Valeronoi::state::RawMeasurements& measurements);
+
+  // Cancels the generation in progress, unless the inputs did not change at
+  // all or its result is already overdue
+  void generate(const Valeronoi::state::MeasurementSnapshot& measurements,
+                Valeronoi::state::DISPLAY_MODE display_mode, int simplify,
+                int wifi_id_filter = -1);
+
   void generate(const Valeronoi::state::RawMeasurements& measurements,
                 Valeronoi::state::DISPLAY_MODE display_mode, int simplify,
                 int wifi_id_filter = -1);
 
+  // Raster resolution of the interpolating display modes, in map units
+  void set_pixel_size(int pixel_size);
+
+  // Voronoi cells are clipped to and interpolating display modes only compute
+  // pixels on this layer, nothing is restricted if nullptr. Takes effect with
+  // the next generate().
+  void set_mask(std::shared_ptr<const Valeronoi::state::Layer> mask);
+
+  // Whether Voronoi cells are clipped to the surroundings of the
+  // measurements. Takes effect with the next generate().
+  void set_restrict_points(bool enabled);
+
+  // Once the oldest unanswered generate() is this old, further calls no
+  // longer cancel the generation in progress, so a result arrives even if
+  // generate() is called more often than a generation takes
+  void set_max_latency(std::chrono::milliseconds max_latency);
+
  signals:
-  void generated_segments(const Valeronoi::state::DataSegments& segments);
+  // Emitted before generated_segments, nullptr if the display mode does not
+  // use a raster
+  void generated_raster(const Valeronoi::state::InterpolatedRasterPtr& raster);
+
+  void generated_segments(const Valeronoi::state::DataSegmentsPtr& segments);
+
+  // Emitted after generated_segments with the time since the oldest
+  // generate() it answers and how many generations were cancelled meanwhile
+  void generated_statistics(qint64 latency_ms, int restarts);
 
  protected:
   void run() override;
 
  private:
+  struct VoronoiState;
+
+  struct CacheKey {
+    int wifi_id_filter;
+    int simplify;
+    Valeronoi::state::DISPLAY_MODE display_mode;
+    int pixel_size;
+    // Holding the layer keeps its address from being reused
+    std::shared_ptr<const Valeronoi::state::Layer> mask;
+    bool restrict_points;
+
+    bool operator<(const CacheKey& other) const {
+      return std::tie(wifi_id_filter, simplify, display_mode, pixel_size, mask,
+                      restrict_points) <
+             std::tie(other.wifi_id_filter, other.simplify,
+                      other.display_mode, other.pixel_size, other.mask,
+                      other.restrict_points);
+    }
+
+    bool operator==(const CacheKey& other) const {
+      return !(*this < other) && !(other < *this);
+    }
+  };
+
+  struct Generated {
+    Valeronoi::state::DataSegmentsPtr segments;
+    Valeronoi::state::InterpolatedRasterPtr raster;
+    // The kriging variance when kriging and the other way around. Both come
+    // out of the same systems, so the other mode is cached along.
+    Valeronoi::state::InterpolatedRasterPtr companion_raster;
+  };
+
+  struct CacheEntry {
+    Generated generated;
+    std::uint64_t last_used{0};
+  };
+
+  void emit_generated(const CacheKey& key, const Generated& generated);
+
+  // Stores a result and its companion, dropping the least recently used ones
+  // beyond SEGMENT_CACHE_SIZE
+  void cache(const CacheKey& key, Generated generated);
+
+  // Drops the results of the access points whose measurements differ
+  // between m_cached_measurements and measurements, and all results that
+  // combine access points
+  void invalidate_cache(
+      const Valeronoi::state::MeasurementSnapshot& measurements);
+
+  // Emits the data points of a slow display mode, unless a result of the
+  // same key with a similar number of sites is already shown
+  void emit_preview(const CacheKey& key,
+                    const Valeronoi::state::MeasurementSnapshot& measurements);
+
+  [[nodiscard]] bool cancelled() const;
+
+  // Blocks until generate() is called again
+  void wait_for_restart();
+
+  // Emits the segments of wifi_id_filter as soon as they are available and
+  // fills the cache for all other access points
+  void generate_all(const Valeronoi::state::MeasurementSnapshot& measurements,
+                    const CacheKey& key);
+
+  // Returns false if the generation was cancelled. preview is called with
+  // the simplified measurements of the slow display modes.
+  bool generate_segments(
+      const Valeronoi::state::MeasurementSnapshot& measurements,
+      const CacheKey& key, std::unique_ptr<VoronoiState>& voronoi,
+      Generated& generated,
+      const std::function<
+          void(const Valeronoi::state::MeasurementSnapshot&)>& preview =
+          {}) const;
+
+  // Served from m_pyramid, which has to match the measurements of the run
+  bool simplify_measurements(
+      int simplify, int wifi_id_filter,
+      Valeronoi::state::MeasurementSnapshot& simplified) const;
+
   static void generate_voronoi(
-      const Valeronoi::state::RawMeasurements& measurements,
-      Valeronoi::state::DataSegments& segments);
+      std::unique_ptr<VoronoiState>& voronoi,
+      const Valeronoi::state::MeasurementSnapshot& measurements,
+      const CacheKey& key, Valeronoi::state::DataSegments& segments);
+
+  static std::unique_ptr<VoronoiState> build_voronoi(
+      const Valeronoi::state::MeasurementSnapshot& measurements);
+
+  // Clips the cells that are not clipped yet
+  static void collect_segments(
+      VoronoiState& state,
+      const Valeronoi::state::MeasurementSnapshot& measurements,
+      const CellClipper& clipper, Valeronoi::state::DataSegments& segments);
+
+  // Voronoi diagram of the last run per access point and simplify level, for
+  // the last VORONOI_SIMPLIFY_LEVELS levels. The generator thread creates the
+  // entries, each is then only used by a single worker.
+  std::map<std::pair<int, int>, std::unique_ptr<VoronoiState>> m_voronoi;
+  std::vector<int> m_voronoi_simplify;
+
+  // Only accessed from the generator thread
+  std::map<CacheKey, CacheEntry> m_cache;
+  std::uint64_t m_cache_clock{0};
+  std::optional<CacheKey> m_emitted_key;
+  std::size_t m_emitted_sites{0};
+  Valeronoi::state::MeasurementSnapshot m_cached_measurements{};
+  // Matches m_cached_measurements, read by all workers
+  SimplifyPyramid m_pyramid;
+
+  QThreadPool m_pool;
 
-  bool m_abort{false}, m_restart{false};
+  std::atomic_bool m_abort{false}, m_restart{false};
   QMutex m_mutex;
   QWaitCondition m_condition;
+  // Whether the generator thread is working, as opposed to waiting
+  bool m_busy{false};
+  // New inputs arrived that did not cancel the work in progress
+  bool m_pending{false};
+  // Set once generate() was called and whenever a setter changed an input
+  bool m_requested{false}, m_inputs_changed{true};
+  std::chrono::milliseconds m_max_latency{std::chrono::milliseconds::max()};
+  QElapsedTimer m_latency_timer;
+  int m_restarts{0};
 
-  Valeronoi::state::RawMeasurements m_measurements{};
+  Valeronoi::state::MeasurementSnapshot m_measurements{};
   Valeronoi::state::DISPLAY_MODE m_display_mode{};
   int m_simplify{};
   int m_wifi_id_filter{};
+  int m_pixel_size{5};
+  std::shared_ptr<const Valeronoi::state::Layer> m_mask;
+  bool m_restrict_points{true};
 };
 
 }  // namespace Valeronoi::util
@@ -0,0 +1,160 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "simplify_pyramid.h"
+
+#include <algorithm>
+#include <tuple>
+
+namespace Valeronoi::util {
+
+// Rounds down to a multiple of size, also for negative values
+static int floor_to(int value, int size) {
+  const int quotient = value / size;
+  return (value % size < 0 ? quotient - 1 : quotient) * size;
+}
+
+int SimplifyPyramid::level_for(int simplify) {
+  // Sizes are ascending, the last one that divides simplify is the largest
+  int level = 0;
+  for (int i = 1; i < SIMPLIFY_PYRAMID_LEVELS && simplify > 1; i++) {
+    if (simplify % SIMPLIFY_PYRAMID_SIZES[i] == 0) {
+      level = i;
+    }
+  }
+  return level;
+}
+
+std::size_t SimplifyPyramid::cell_count(int level) const {
+  return m_levels[level].size();
+}
+
+void SimplifyPyramid::update(
+    const Valeronoi::state::MeasurementSnapshot& measurements) {
+  const auto old_chunks = m_measurements.chunk_count();
+  const auto new_chunks = measurements.chunk_count();
+  std::size_t shared{0};
+  for (std::size_t i = 0; i < std::min(old_chunks, new_chunks); i++) {
+    if (m_measurements.chunk(i) == measurements.chunk(i)) {
+      shared++;
+    }
+  }
+  if (shared == 0) {
+    // A different data set, removing all old places would only take longer
+    for (auto& level : m_levels) {
+      level.clear();
+    }
+    for (std::size_t i = 0; i < new_chunks; i++) {
+      add(*measurements.chunk(i));
+    }
+  } else {
+    for (std::size_t i = 0; i < std::max(old_chunks, new_chunks); i++) {
+      if (i < old_chunks && i < new_chunks &&
+          m_measurements.chunk(i) == measurements.chunk(i)) {
+        continue;
+      }
+      if (i < old_chunks) {
+        remove(*m_measurements.chunk(i));
+      }
+      if (i < new_chunks) {
+        add(*measurements.chunk(i));
+      }
+    }
+  }
+  m_measurements = measurements;
+}
+
+void SimplifyPyramid::add(const Valeronoi::state::RawMeasurements& places) {
+  for (int level = 0; level < SIMPLIFY_PYRAMID_LEVELS; level++) {
+    const int size = SIMPLIFY_PYRAMID_SIZES[level];
+    auto& cells = m_levels[level];
+    for (const auto& m : places) {
+      auto& cell =
+          cells[{floor_to(m.x, size), floor_to(m.y, size), m.wifi_id}];
+      cell.sum += m.average * static_cast<double>(m.data.size());
+      cell.count += m.data.size();
+    }
+  }
+}
+
+void SimplifyPyramid::remove(const Valeronoi::state::RawMeasurements& places) {
+  for (int level = 0; level < SIMPLIFY_PYRAMID_LEVELS; level++) {
+    const int size = SIMPLIFY_PYRAMID_SIZES[level];
+    auto& cells = m_levels[level];
+    for (const auto& m : places) {
+      const auto cell =
+          cells.find({floor_to(m.x, size), floor_to(m.y, size), m.wifi_id});
+      if (cell == cells.end()) {
+        continue;
+      }
+      cell->second.count -= std::min(cell->second.count, m.data.size());
+      // Erasing empty cells also drops the rounding errors of their sum
+      if (cell->second.count == 0) {
+        cells.erase(cell);
+      } else {
+        cell->second.sum -= m.average * static_cast<double>(m.data.size());
+      }
+    }
+  }
+}
+
+Valeronoi::state::RawMeasurements SimplifyPyramid::simplify(
+    int simplify, int wifi_id_filter) const {
+  simplify = std::max(simplify, 1);
+  const auto& cells = m_levels[level_for(simplify)];
+  struct Bin {
+    int wifi_id{0};
+    double sum{0.0};
+    std::size_t count{0};
+  };
+  std::unordered_map<Valeronoi::state::MeasurementKey, Bin,
+                     Valeronoi::state::MeasurementKeyHash>
+      bins;
+  bins.reserve(cells.size());
+  for (const auto& [key, cell] : cells) {
+    if (wifi_id_filter != -1 && key.wifi_id != wifi_id_filter) {
+      continue;
+    }
+    auto& bin = bins[{floor_to(key.x, simplify), floor_to(key.y, simplify), 0}];
+    // The lowest one, so the result does not depend on the hash order
+    bin.wifi_id =
+        bin.count == 0 ? key.wifi_id : std::min(bin.wifi_id, key.wifi_id);
+    bin.sum += cell.sum;
+    bin.count += cell.count;
+  }
+
+  Valeronoi::state::RawMeasurements places;
+  places.reserve(bins.size());
+  for (const auto& [key, bin] : bins) {
+    if (bin.count == 0) {
+      continue;
+    }
+    Valeronoi::state::Measurement m{};
+    m.x = key.x;
+    m.y = key.y;
+    m.wifi_id = bin.wifi_id;
+    m.sum = bin.sum;
+    m.average = bin.sum / static_cast<double>(bin.count);
+    places.push_back(std::move(m));
+  }
+  std::sort(places.begin(), places.end(), [](const auto& a, const auto& b) {
+    return std::tie(a.x, a.y) < std::tie(b.x, b.y);
+  });
+  return places;
+}
+
+}  // namespace Valeronoi::util
@@ -0,0 +1,82 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef VALERONOI_UTIL_SIMPLIFY_PYRAMID_H
+#define VALERONOI_UTIL_SIMPLIFY_PYRAMID_H
+
+#include <array>
+#include <cstddef>
+#include <unordered_map>
+
+#include "../state/measurements.h"
+#include "../state/state.h"
+
+namespace Valeronoi::util {
+
+// Cell sizes in map units: 1 and every prime power up to 20, the maximum of
+// the simplify slider. Each simplify value is a multiple of its largest prime
+// power factor, so every slider position above 1 has a level with cells
+// larger than one map unit that fit into its squares.
+constexpr std::array<int, 13> SIMPLIFY_PYRAMID_SIZES{1, 2,  3,  4,  5,  7, 8,
+                                                     9, 11, 13, 16, 17, 19};
+constexpr int SIMPLIFY_PYRAMID_LEVELS{
+    static_cast<int>(SIMPLIFY_PYRAMID_SIZES.size())};
+
+// Sample sums of the places of one access point in a grid cell at every size
+// of SIMPLIFY_PYRAMID_SIZES. Simplifying then only bins the cells of one
+// level instead of every place.
+class SimplifyPyramid {
+ public:
+  // Brings the pyramid to the state of measurements. Only chunks that are
+  // not shared with the previous measurements are looked at.
+  void update(const Valeronoi::state::MeasurementSnapshot& measurements);
+
+  // Averages of the places within the same square of simplify map units,
+  // optionally only of one access point, ordered by position. Squares start
+  // at multiples of simplify and a square's position is its top left corner.
+  [[nodiscard]] Valeronoi::state::RawMeasurements simplify(
+      int simplify, int wifi_id_filter = -1) const;
+
+  // The coarsest level whose cells fit into squares of simplify map units.
+  // Level 0 is only left for 1 and for values above 20 that have no factor
+  // in SIMPLIFY_PYRAMID_SIZES, e.g. 23.
+  [[nodiscard]] static int level_for(int simplify);
+
+  [[nodiscard]] std::size_t cell_count(int level) const;
+
+ private:
+  struct Cell {
+    double sum{0.0};
+    std::size_t count{0};
+  };
+
+  // Keyed by the top left corner of the cell and the access point
+  typedef std::unordered_map<Valeronoi::state::MeasurementKey, Cell,
+                             Valeronoi::state::MeasurementKeyHash>
+      Level;
+
+  void add(const Valeronoi::state::RawMeasurements& places);
+
+  void remove(const Valeronoi::state::RawMeasurements& places);
+
+  std::array<Level, SIMPLIFY_PYRAMID_LEVELS> m_levels;
+  Valeronoi::state::MeasurementSnapshot m_measurements;
+};
+
+}  // namespace Valeronoi::util
+
+#endif
@@ -51,6 +51,9 @@ ValeronoiWindow::ValeronoiWindow(QWidget* parent)
   QSettings settings;
   const auto start_count = settings.value("app/startCount", 0).toInt();
   settings.setValue("app/startCount", start_count + 1);
+  // Map updates of a busy robot are coalesced, only the newest one is drawn
+  m_robot.set_map_min_interval(std::chrono::milliseconds(
+      settings.value("robot/mapMinInterval", 0).toInt()));
 
   qDebug() << "Setting up UI";
   ui->setupUi(this);
@@ -190,18 +193,13 @@ bool ValeronoiWindow::maybe_save() {
 }
 
 bool ValeronoiWindow::save() {
-  QFile file(m_current_file);
-  if (!file.open(QIODevice::WriteOnly)) {
+  QString error;
+  if (!Valeronoi::state::ProjectFile::save(
+          m_current_file, FILE_FORMAT_VERSION, m_robot_map.get_map_json(),
+          m_wifi_collection.get_json(), m_wifi_measurements, &error)) {
+    qDebug() << "Could not save" << m_current_file << error;
     return false;
   }
-  auto object = QJsonObject();
-  object.insert("map", m_robot_map.get_map_json());
-  object.insert("measurements", m_wifi_measurements.get_json());
-  object.insert("wifis", m_wifi_collection.get_json());
-  object.insert("version", FILE_FORMAT_VERSION);
-  auto document = QJsonDocument(object);
-  file.write(document.toJson(QJsonDocument::Compact));
-  file.close();
   set_modified(false);
   return true;
 }
@@ -323,35 +321,16 @@ bool ValeronoiWindow::load_file(const QString& path) {
     QMessageBox::warning(nullptr, "Error", tr("File does not exist"));
     return false;
   }
-  // If load file here
-  QFile file(path);
-  if (!file.open(QIODevice::ReadOnly)) {
-    QMessageBox::warning(nullptr, "Error", tr("Could not open file"));
-    return false;
-  }
-  QJsonParseError error;
-  auto json_document = QJsonDocument::fromJson(file.readAll(), &error);
-  file.close();
-  if (json_document.isNull() || json_document.isEmpty()) {
-    QMessageBox::warning(
-        nullptr, "Error",
-        tr("Error parsing file:\n%1").arg(error.errorString()));
-    return false;
-  }
-  if (json_document.object()["version"].toInt() != FILE_FORMAT_VERSION) {
-    QMessageBox::warning(nullptr, "Error",
-                         tr("File is incompatible with this version"));
-    return false;
-  }
-  if (!json_document.object()["map"].isObject() ||
-      !json_document.object()["measurements"].isArray()) {
-    QMessageBox::warning(nullptr, "Error", tr("File is corrupted"));
+  // Version 1 (JSON) and version 2 (binary) files are both supported
+  Valeronoi::state::ProjectFile project;
+  if (!project.load(path)) {
+    QMessageBox::warning(nullptr, "Error", project.error());
     return false;
   }
 
   ui->wifiInfoGroup->setChecked(false);
-  if (json_document.object().contains("wifis")) {
-    m_wifi_collection.set_json(json_document.object()["wifis"].toArray());
+  if (project.wifis()) {
+    m_wifi_collection.set_json(*project.wifis());
   } else {
     // add dummy WiFi for Import.
     m_wifi_collection.clear();
@@ -359,10 +338,9 @@ bool ValeronoiWindow::load_file(const QString& path) {
         m_wifi_collection.get_or_create_wifi_id(
             Valeronoi::robot::WifiInformation());
   }
-  m_robot_map.update_map_json(json_document.object()["map"].toObject());
+  m_robot_map.update_map_json(project.map());
 
-  m_wifi_measurements.set_json(
-      json_document.object()["measurements"].toArray());
+  project.apply_measurements(m_wifi_measurements);
 
   set_open_save_dir(info.absoluteDir().absolutePath());
   m_current_file = info.absoluteFilePath();
@@ -695,7 +673,7 @@ void ValeronoiWindow::connect_robot_signals() {
           });
 
   connect(&m_robot, &Valeronoi::robot::Robot::signal_map_updated, this, [=]() {
-    m_robot_map.update_map_json(m_robot.get_map_data());
+    m_robot_map.update_map_json_async(m_robot.get_map_data());
     set_modified(true);
   });
   connect(ui->recordingInterval,
@@ -36,6 +36,7 @@
 #include "robot/connection_configuration.h"
 #include "robot/robot.h"
 #include "state/measurements.h"
+#include "state/project_file.h"
 #include "state/robot_map.h"
 #include "state/wifi_collection.h"
 #include "util/colormap.h"
@@ -43,7 +44,7 @@
 
 namespace Valeronoi {
 constexpr auto VALERONOI_FILE_EXTENSION = "vwm";  // Valeronoi WiFi Map
-constexpr int FILE_FORMAT_VERSION = 1;
+constexpr int FILE_FORMAT_VERSION = Valeronoi::state::PROJECT_FORMAT_BINARY;
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
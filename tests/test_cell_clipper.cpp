@@ -0,0 +1,89 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <catch2/catch_amalgamated.hpp>
+#include <cstdlib>
+
+#include "src/util/cell_clipper.h"
+
+using Valeronoi::util::CellClipper;
+
+static long long area(const std::vector<QPolygon>& parts) {
+  long long twice_area{0};
+  for (const auto& polygon : parts) {
+    long long part{0};
+    for (int i = 0; i < polygon.size(); i++) {
+      const auto& a = polygon[i];
+      const auto& b = polygon[(i + 1) % polygon.size()];
+      part += static_cast<long long>(a.x()) * b.y() -
+              static_cast<long long>(b.x()) * a.y();
+    }
+    twice_area += std::abs(part);
+  }
+  return twice_area / 2;
+}
+
+static Valeronoi::state::Layer floor_layer(std::vector<QRect> rects) {
+  Valeronoi::state::Layer layer;
+  layer.rects = std::move(rects);
+  for (const auto& rect : layer.rects) {
+    layer.bounds |= rect;
+  }
+  return layer;
+}
+
+static const QPolygon square_cell(
+    {QPoint(0, 0), QPoint(100, 0), QPoint(100, 100), QPoint(0, 100)});
+
+TEST_CASE("CellClipper without restrictions keeps the cell", "[util]") {
+  const CellClipper clipper(nullptr, {QPoint(50, 50)}, 0);
+  CHECK(!clipper.restricted());
+  const auto parts = clipper.clip(square_cell, QPoint(50, 50));
+  REQUIRE(parts.size() == 1);
+  CHECK(parts[0] == square_cell);
+}
+
+TEST_CASE("CellClipper clips to the floor", "[util]") {
+  const auto floor = floor_layer({QRect(0, 0, 50, 100), QRect(50, 50, 50, 50),
+                                  QRect(500, 500, 10, 10)});
+  const CellClipper clipper(&floor, {QPoint(50, 50)}, 0);
+  CHECK(clipper.restricted());
+  const auto parts = clipper.clip(square_cell, QPoint(50, 50));
+  CHECK(parts.size() == 2);
+  CHECK(area(parts) == 50 * 100 + 50 * 50);
+
+  // Cells off the floor vanish
+  const QPolygon outside(
+      {QPoint(200, 200), QPoint(300, 200), QPoint(250, 300)});
+  CHECK(clipper.clip(outside, QPoint(250, 250)).empty());
+}
+
+TEST_CASE("CellClipper clips to the surroundings of the sites", "[util]") {
+  const CellClipper clipper(nullptr, {QPoint(50, 50), QPoint(1000, 1000)},
+                            35);
+  const auto parts = clipper.clip(square_cell, QPoint(50, 50));
+  REQUIRE(parts.size() == 1);
+  CHECK(area(parts) == 70 * 70);
+  CHECK(parts[0].boundingRect() == QRect(15, 15, 71, 71));
+  CHECK(clipper.reach() >= 35 + 50);
+}
+
+TEST_CASE("CellClipper combines floor and surroundings", "[util]") {
+  const auto floor =
+      floor_layer({QRect(0, 0, 50, 100), QRect(50, 0, 50, 100)});
+  const CellClipper clipper(&floor, {QPoint(50, 50)}, 35);
+  // The parts have to stay within the cell
+  const QPolygon triangle({QPoint(0, 0), QPoint(100, 0), QPoint(0, 100)});
+  const auto parts = clipper.clip(triangle, QPoint(30, 30));
+  CHECK(parts.size() == 2);
+  for (const auto& part : parts) {
+    for (const auto& point : part) {
+      CHECK(point.x() >= 15);
+      CHECK(point.y() >= 15);
+      CHECK(point.x() + point.y() <= 100);
+    }
+  }
+  // The diagonal of the triangle halves the 70x70 square
+  CHECK(area(parts) == 70 * 70 / 2);
+}
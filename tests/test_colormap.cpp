@@ -17,6 +17,8 @@
  */
 #include <array>
 #include <catch2/catch_amalgamated.hpp>
+#include <cmath>
+#include <cstdint>
 #include <vector>
 
 #include "src/util/colormap.h"
@@ -76,3 +78,72 @@ TEST_CASE("ColorMap works with multiple colors", "[colormap]") {
   assert_color(c, 0.999999999, 0.6, 1.0, 0.5);
   assert_color(c, 1.0, 0.6, 1.0, 0.5);
 }
+
+TEST_CASE("ColorMap lookup table matches the interpolated colors",
+          "[colormap]") {
+  std::vector<std::array<double, 3>> colors;
+  colors.push_back({0.0, 0.0, 1.0});
+  colors.push_back({0.0, 1.0, 0.0});
+  colors.push_back({1.0, 0.0, 0.0});
+  auto const c = Valeronoi::util::RGBColorMap("Foo", colors);
+  for (int i = 0; i <= 100; i++) {
+    const double f = i / 100.0;
+    const auto expected = c.get_color(f);
+    const auto rgb = c.get_rgb(f);
+    CHECK(rgb >> 24 == 0xffu);
+    // One table entry covers 2 / 1023 of a color step here
+    CHECK(((rgb >> 16) & 0xffu) == Approx(255 * expected[0]).margin(2));
+    CHECK(((rgb >> 8) & 0xffu) == Approx(255 * expected[1]).margin(2));
+    CHECK((rgb & 0xffu) == Approx(255 * expected[2]).margin(2));
+  }
+  CHECK(c.get_rgb(-1.0) == 0xff0000ffu);
+  CHECK(c.get_rgb(2.0) == 0xffff0000u);
+}
+
+TEST_CASE("ColorMap maps values in batches", "[colormap]") {
+  std::vector<std::array<double, 3>> colors;
+  colors.push_back({0.0, 0.0, 1.0});
+  colors.push_back({1.0, 0.0, 0.0});
+  auto const c = Valeronoi::util::RGBColorMap("Foo", colors);
+  const std::vector<float> values{-90.0f, -80.0f, -60.0f, -40.0f,
+                                  std::nanf(""), -10.0f};
+  std::vector<std::uint32_t> mapped(values.size());
+  c.map_values(values.data(), mapped.data(), values.size(), -80.0, -40.0);
+  CHECK(mapped[0] == 0xff0000ffu);
+  CHECK(mapped[1] == 0xff0000ffu);
+  CHECK(mapped[2] == c.get_rgb(0.5));
+  CHECK(mapped[3] == 0xffff0000u);
+  CHECK(mapped[4] == 0u);
+  CHECK(mapped[5] == 0xffff0000u);
+
+  // Without a range everything gets the first color
+  c.map_values(values.data(), mapped.data(), values.size(), -50.0, -50.0);
+  CHECK(mapped[2] == 0xff0000ffu);
+}
+
+// Hidden by default, run with: valeronoi-tests "[benchmark]"
+TEST_CASE("ColorMap benchmark", "[.][benchmark]") {
+  std::vector<std::array<double, 3>> colors;
+  for (int i = 0; i < 256; i++) {
+    colors.push_back({i / 255.0, 1.0 - i / 255.0, 0.5});
+  }
+  auto const c = Valeronoi::util::RGBColorMap("Foo", colors);
+  std::vector<double> values(100000);
+  for (std::size_t i = 0; i < values.size(); i++) {
+    values[i] = -90.0 + 60.0 * static_cast<double>(i % 1000) / 1000.0;
+  }
+  std::vector<std::uint32_t> mapped(values.size());
+
+  BENCHMARK("get_color (100k values)") {
+    double sum{0.0};
+    for (const auto value : values) {
+      sum += c.get_color((value + 90.0) / 60.0)[0];
+    }
+    return sum;
+  };
+
+  BENCHMARK("map_values (100k values)") {
+    c.map_values(values.data(), mapped.data(), values.size(), -90.0, -30.0);
+    return mapped[0];
+  };
+}
@@ -0,0 +1,62 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QThread>
+#include <catch2/catch_amalgamated.hpp>
+#include <chrono>
+
+#include "src/util/generation_scheduler.h"
+#include "tests/test_helpers.h"
+
+using namespace std::chrono_literals;
+using Valeronoi::util::GenerationScheduler;
+
+TEST_CASE("GenerationScheduler coalesces requests", "[util]") {
+  ensure_application();
+  GenerationScheduler scheduler;
+  scheduler.set_delay(50ms);
+  scheduler.set_max_latency(5000ms);
+  QSignalSpy spy(&scheduler, &GenerationScheduler::signal_generate);
+
+  for (int i = 0; i < 10; i++) {
+    scheduler.request();
+  }
+  CHECK(scheduler.is_pending());
+  CHECK(spy.count() == 0);
+  REQUIRE(spy.wait(2000));
+  CHECK(spy.count() == 1);
+  CHECK(!scheduler.is_pending());
+  CHECK(!spy.wait(200));
+
+  // Immediate requests replace the pending one
+  scheduler.request();
+  scheduler.request_now();
+  CHECK(spy.count() == 2);
+  CHECK(!scheduler.is_pending());
+  CHECK(!spy.wait(200));
+  CHECK(spy.count() == 2);
+}
+
+TEST_CASE("GenerationScheduler keeps the latency budget", "[util]") {
+  ensure_application();
+  GenerationScheduler scheduler;
+  scheduler.set_delay(200ms);
+  scheduler.set_max_latency(400ms);
+  QSignalSpy spy(&scheduler, &GenerationScheduler::signal_generate);
+
+  // Requests keep arriving faster than the delay, yet one is passed on
+  QElapsedTimer timer;
+  timer.start();
+  while (spy.count() == 0 && timer.elapsed() < 5000) {
+    scheduler.request();
+    QCoreApplication::processEvents();
+    QThread::msleep(20);
+  }
+  REQUIRE(spy.count() == 1);
+  CHECK(timer.elapsed() >= 400);
+  CHECK(timer.elapsed() < 2000);
+}
@@ -0,0 +1,22 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#ifndef VALERONOI_TESTS_TEST_HELPERS_H
+#define VALERONOI_TESTS_TEST_HELPERS_H
+
+#include <QCoreApplication>
+
+// Timers, queued signals and thread pools need an application object. It is
+// created by the first test that needs it and kept for all others.
+inline void ensure_application() {
+  // QCoreApplication keeps references to both
+  static int argc = 1;
+  static char name[] = "valeronoi-tests";
+  static char* argv[] = {name, nullptr};
+  if (!QCoreApplication::instance()) {
+    new QCoreApplication(argc, argv);
+  }
+}
+
+#endif
@@ -0,0 +1,225 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch_amalgamated.hpp>
+#include <cmath>
+#include <random>
+#include <string>
+
+#include "src/util/interpolation.h"
+
+using Catch::Approx;
+using Valeronoi::util::INTERPOLATION_RADIUS;
+
+static Valeronoi::state::MeasurementSnapshot random_measurements(int count) {
+  std::mt19937 generator(4711);
+  // Roughly the density of a slow recording in a 100 m² apartment
+  const int size = static_cast<int>(std::sqrt(count) * 40.0);
+  std::uniform_int_distribution<int> position(0, size);
+  std::uniform_real_distribution<double> signal(-90.0, -30.0);
+  Valeronoi::state::RawMeasurements measurements;
+  for (int i = 0; i < count; i++) {
+    const double value = signal(generator);
+    measurements.push_back(
+        {position(generator), position(generator), 0, {value}, value});
+  }
+  return Valeronoi::state::MeasurementSnapshot(std::move(measurements));
+}
+
+static float value_at(const Valeronoi::state::InterpolatedRaster& raster,
+                      int x, int y) {
+  const int column = (x - raster.x) / raster.pixel_size;
+  const int row = (y - raster.y) / raster.pixel_size;
+  return raster.values[static_cast<std::size_t>(row) * raster.width + column];
+}
+
+TEST_CASE("Interpolation of a single measurement", "[util]") {
+  const Valeronoi::state::MeasurementSnapshot measurements(
+      Valeronoi::state::RawMeasurements{{1000, 1000, 0, {-50.0}, -50.0}});
+  const auto raster = Valeronoi::util::interpolate(measurements, 5);
+  REQUIRE(raster);
+  CHECK(raster->pixel_size == 5);
+  CHECK(raster->x <= 1000 - INTERPOLATION_RADIUS);
+  CHECK(raster->y <= 1000 - INTERPOLATION_RADIUS);
+  REQUIRE(raster->values.size() ==
+          static_cast<std::size_t>(raster->width) * raster->height);
+
+  CHECK(value_at(*raster, 1000, 1000) == Approx(-50.0));
+  CHECK(value_at(*raster, 1000 + INTERPOLATION_RADIUS / 2, 1000) ==
+        Approx(-50.0));
+  // Outside the radius there is no data
+  CHECK(std::isnan(raster->values.front()));
+  CHECK(std::isnan(raster->values.back()));
+}
+
+TEST_CASE("Interpolation stays within the measured values", "[util]") {
+  const Valeronoi::state::MeasurementSnapshot measurements(
+      Valeronoi::state::RawMeasurements{{0, 0, 0, {-40.0}, -40.0},
+                                        {95, 0, 0, {-80.0}, -80.0}});
+  const auto raster = Valeronoi::util::interpolate(measurements, 5);
+  REQUIRE(raster);
+
+  // Close to a site, its value dominates
+  CHECK(value_at(*raster, 0, 0) == Approx(-40.0).margin(1.0));
+  CHECK(value_at(*raster, 95, 0) == Approx(-80.0).margin(1.0));
+  // The pixel centered between both sites weights them equally
+  CHECK(value_at(*raster, 47, 0) == Approx(-60.0));
+
+  for (const auto value : raster->values) {
+    if (!std::isnan(value)) {
+      CHECK(value >= -80.001f);
+      CHECK(value <= -39.999f);
+    }
+  }
+}
+
+TEST_CASE("Interpolation only fills pixels on the mask", "[util]") {
+  const Valeronoi::state::MeasurementSnapshot measurements(
+      Valeronoi::state::RawMeasurements{{1000, 1000, 0, {-50.0}, -50.0}});
+  Valeronoi::state::Layer mask;
+  mask.rects = {QRect(950, 950, 50, 100)};
+  mask.bounds = mask.rects[0];
+  mask.grid = std::make_shared<const Valeronoi::state::OccupancyGrid>(
+      mask.rects, mask.bounds, 5);
+  const auto raster =
+      Valeronoi::util::interpolate(measurements, 5, {}, &mask);
+  REQUIRE(raster);
+  CHECK(value_at(*raster, 960, 1000) == Approx(-50.0));
+  CHECK(value_at(*raster, 995, 1040) == Approx(-50.0));
+  CHECK(std::isnan(value_at(*raster, 1000, 1000)));
+  CHECK(std::isnan(value_at(*raster, 960, 940)));
+}
+
+TEST_CASE("Interpolation can be cancelled", "[util]") {
+  const auto measurements = random_measurements(1000);
+  std::atomic_int calls{0};
+  const auto raster = Valeronoi::util::interpolate(
+      measurements, 5, [&calls]() { return ++calls > 3; });
+  CHECK(!raster);
+  CHECK(!Valeronoi::util::interpolate({}, 5));
+}
+
+// Smooth signal on a regular grid of sites, 100 map units apart
+static Valeronoi::state::MeasurementSnapshot smooth_field() {
+  Valeronoi::state::RawMeasurements measurements;
+  for (int y = 0; y <= 1000; y += 100) {
+    for (int x = 0; x <= 1000; x += 100) {
+      const double value =
+          -60.0 + 10.0 * std::sin(x / 300.0) * std::cos(y / 300.0);
+      measurements.push_back({x, y, 0, {value}, value});
+    }
+  }
+  return Valeronoi::state::MeasurementSnapshot(std::move(measurements));
+}
+
+TEST_CASE("Variogram fit", "[util]") {
+  const auto variogram = Valeronoi::util::fit_variogram(smooth_field());
+  CHECK(variogram.nugget >= 0.0);
+  CHECK(variogram.partial_sill > 0.0);
+  CHECK(variogram.range > 0.0);
+  CHECK(variogram(0.0) == 0.0);
+  // Semivariance grows with distance
+  CHECK(variogram(100.0) < variogram(500.0));
+  CHECK(variogram.covariance(0.0) ==
+        Approx(variogram.nugget + variogram.partial_sill));
+}
+
+TEST_CASE("Kriging predicts values and variance", "[util]") {
+  const auto measurements = smooth_field();
+  const auto result = Valeronoi::util::krige(measurements, 5);
+  REQUIRE(result.prediction);
+  REQUIRE(result.variance);
+  CHECK(result.prediction->width == result.variance->width);
+  CHECK(result.prediction->height == result.variance->height);
+
+  for (const auto& m : measurements) {
+    CHECK(value_at(*result.prediction, m.x, m.y) ==
+          Approx(m.average).margin(1.0));
+  }
+  // Uncertainty is lowest close to measurements
+  CHECK(value_at(*result.variance, 500, 500) <
+        value_at(*result.variance, 550, 550));
+  CHECK(value_at(*result.variance, 550, 550) >= 0.0f);
+  // Beyond the radius around all measurements there is no prediction
+  CHECK(std::isnan(result.prediction->values.front()));
+  CHECK(std::isnan(result.variance->values.front()));
+}
+
+TEST_CASE("Kriging of a constant field", "[util]") {
+  Valeronoi::state::RawMeasurements raw;
+  for (int i = 0; i < 20; i++) {
+    raw.push_back({(i % 5) * 60, (i / 5) * 60, 0, {-55.0}, -55.0});
+  }
+  // Two measurements at the same position must not break the system
+  raw.push_back({0, 0, 1, {-55.0}, -55.0});
+  const auto result = Valeronoi::util::krige(
+      Valeronoi::state::MeasurementSnapshot(std::move(raw)), 5);
+  REQUIRE(result.prediction);
+  std::size_t predicted{0};
+  for (const auto value : result.prediction->values) {
+    if (!std::isnan(value)) {
+      CHECK(value == Approx(-55.0).margin(0.01));
+      predicted++;
+    }
+  }
+  CHECK(predicted > 0);
+}
+
+TEST_CASE("Kriging does not depend on the tiling", "[util]") {
+  // Dense enough that pixels have more than KRIGING_NEIGHBOURS candidates
+  Valeronoi::state::RawMeasurements raw;
+  for (int y = 0; y <= 1200; y += 50) {
+    for (int x = 0; x <= 1200; x += 50) {
+      const double value =
+          -60.0 + 10.0 * std::sin(x / 170.0) * std::cos(y / 230.0);
+      raw.push_back({x, y, 0, {value}, value});
+    }
+  }
+  const auto result =
+      Valeronoi::util::krige(Valeronoi::state::MeasurementSnapshot(raw), 10);
+  // A far away measurement moves the origin of the raster, so the tile
+  // borders end up elsewhere, without changing the variogram
+  raw.push_back({-2137, -2137, 0, {-90.0}, -90.0});
+  const auto shifted =
+      Valeronoi::util::krige(Valeronoi::state::MeasurementSnapshot(raw), 10);
+  REQUIRE(result.prediction);
+  REQUIRE(shifted.prediction);
+  REQUIRE(result.variogram.range == shifted.variogram.range);
+  REQUIRE((shifted.prediction->x - result.prediction->x) / 10 %
+              Valeronoi::util::INTERPOLATION_TILE_SIZE !=
+          0);
+
+  float prediction_difference{0.0f}, variance_difference{0.0f};
+  for (int y = 5; y < 1200; y += 10) {
+    for (int x = 5; x < 1200; x += 10) {
+      prediction_difference =
+          std::max(prediction_difference,
+                   std::abs(value_at(*shifted.prediction, x, y) -
+                            value_at(*result.prediction, x, y)));
+      variance_difference = std::max(
+          variance_difference, std::abs(value_at(*shifted.variance, x, y) -
+                                        value_at(*result.variance, x, y)));
+    }
+  }
+  CHECK(prediction_difference < 1e-3f);
+  CHECK(variance_difference < 1e-3f);
+}
+
+// Hidden by default, run with: valeronoi-tests "[benchmark]"
+TEST_CASE("Interpolation benchmark", "[.][benchmark]") {
+  for (const int count : {1000, 10000, 50000}) {
+    const auto measurements = random_measurements(count);
+    const auto suffix = " (" + std::to_string(count) + " sites)";
+
+    BENCHMARK("Inverse distance weighting" + suffix) {
+      return Valeronoi::util::interpolate(measurements, 5);
+    };
+
+    BENCHMARK("Ordinary kriging" + suffix) {
+      return Valeronoi::util::krige(measurements, 5);
+    };
+  }
+}
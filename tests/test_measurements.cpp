@@ -6,6 +6,7 @@
 #include <QJsonObject>
 #include <QSignalSpy>
 #include <catch2/catch_amalgamated.hpp>
+#include <vector>
 
 #include "src/state/measurements.h"
 #include "src/state/robot_map.h"
@@ -147,3 +148,158 @@ TEST_CASE("Measurements basic functionality", "[state]") {
     }
   }
 }
+
+TEST_CASE("Measurements aggregation matches full re-averaging", "[state]") {
+  Measurements measurements;
+
+  // Interleave samples of several places and access points, as a long
+  // recording would
+  QJsonArray json;
+  for (int i = 0; i < 300; i++) {
+    QJsonObject m;
+    m.insert("x", (i % 7) * 10);
+    m.insert("y", (i % 5) * 10);
+    m.insert("wifi", i % 3);
+    m.insert("data", QJsonArray({-40.0 - (i * 37 % 23) - 0.1 * (i % 10),
+                                 -60.0 + 0.3 * (i % 11)}));
+    json.append(m);
+  }
+  measurements.set_json(json);
+
+  const auto& data = measurements.get_measurements();
+  CHECK(data.size() == 7 * 5 * 3);
+  int total = 0;
+  for (const auto& m : data) {
+    REQUIRE(!m.data.empty());
+    double avg = 0;
+    for (const auto& d : m.data) {
+      avg += d;
+    }
+    avg = avg / m.data.size();
+    // Bit-identical to summing the whole vector
+    CHECK(m.average == avg);
+
+    double variance = 0;
+    for (const auto& d : m.data) {
+      variance += (d - avg) * (d - avg);
+    }
+    variance = m.data.size() > 1 ? variance / (m.data.size() - 1) : 0.0;
+    CHECK(m.variance() == Catch::Approx(variance).margin(1e-9));
+    total += static_cast<int>(m.data.size());
+  }
+  CHECK(total == 600);
+  CHECK(measurements.get_statistics().measurements == 600);
+  CHECK(measurements.get_statistics().unique_places == 7 * 5 * 3);
+}
+
+TEST_CASE("Measurement snapshots are not affected by later changes",
+          "[state]") {
+  RobotMap map;
+  QJsonObject map_json;
+  map_json.insert("__class", "ValetudoMap");
+  map_json.insert("metaData", QJsonObject({{"version", 2}}));
+  QJsonObject robot;
+  robot.insert("__class", "PointMapEntity");
+  robot.insert("type", "robot_position");
+  robot.insert("points", QJsonArray({500, 600}));
+  map_json.insert("entities", QJsonArray({robot}));
+  map.update_map_json(map_json);
+  REQUIRE(map.is_valid());
+  const auto position = map.get_robot_position();
+  REQUIRE(position.has_value());
+
+  Measurements measurements;
+  measurements.set_map(map);
+
+  // The first place is where the robot is, so new samples go to chunk 0
+  QJsonArray json;
+  for (int i = 0; i < 600; i++) {
+    QJsonObject m;
+    m.insert("x", position->x + i);
+    m.insert("y", position->y);
+    m.insert("data", QJsonArray({-50.0}));
+    json.append(m);
+  }
+  measurements.set_json(json);
+
+  const auto snapshot = measurements.get_measurements();
+  REQUIRE(snapshot.size() == 600);
+  REQUIRE(snapshot.chunk_count() == 3);
+
+  measurements.slot_add_measurement(-70.0, measurements.unknown_wifi_id);
+
+  CHECK(snapshot.size() == 600);
+  CHECK(snapshot[0].data.size() == 1);
+  CHECK(snapshot[0].average == -50.0);
+  CHECK(snapshot[599].x == position->x + 599);
+
+  const auto updated = measurements.get_measurements();
+  CHECK(updated.size() == 600);
+  CHECK(updated[0].data.size() == 2);
+  CHECK(updated[0].average == Catch::Approx(-60.0));
+  CHECK(updated.version() != snapshot.version());
+  // Only the modified chunk was copied
+  CHECK(updated.chunk(0) != snapshot.chunk(0));
+  CHECK(updated.chunk(1) == snapshot.chunk(1));
+  CHECK(updated.chunk(2) == snapshot.chunk(2));
+
+  // The copy is now shared with updated and is copied again
+  measurements.slot_add_measurement(-90.0, measurements.unknown_wifi_id);
+  const auto latest = measurements.get_measurements();
+  CHECK(latest.chunk(0) != updated.chunk(0));
+  CHECK(updated[0].data.size() == 2);
+  CHECK(latest[0].data.size() == 3);
+  CHECK(latest[0].average == Catch::Approx(-70.0));
+
+  std::size_t count = 0;
+  for (const auto& measurement : latest) {
+    CHECK(!measurement.data.empty());
+    count++;
+  }
+  CHECK(count == latest.size());
+}
+
+TEST_CASE("Measurements loads columns", "[state]") {
+  // Place 0 appears twice, as in a replayed journal
+  const std::vector<qint32> x{0, 10, 0, 20};
+  const std::vector<qint32> y{0, 0, 0, 5};
+  const std::vector<qint32> wifi_id{1, 1, 1, 2};
+  const std::vector<quint32> sample_count{2, 1, 3, 1};
+  const std::vector<double> values{-50.0, -52.5, -60.0, -41.0,
+                                   -47.0, -58.0, -70.0};
+  MeasurementColumns columns;
+  columns.places = x.size();
+  columns.samples = values.size();
+  columns.x = x.data();
+  columns.y = y.data();
+  columns.wifi_id = wifi_id.data();
+  columns.sample_count = sample_count.data();
+  columns.sample_values = values.data();
+
+  Measurements measurements;
+  QSignalSpy spy(&measurements, &Measurements::signal_measurements_updated);
+  measurements.set_columns(columns);
+  CHECK(spy.count() == 1);
+
+  const auto snapshot = measurements.get_measurements();
+  REQUIRE(snapshot.size() == 3);
+  CHECK(measurements.get_statistics().measurements == 7);
+
+  // Same aggregates as adding the samples one by one
+  Measurement expected{};
+  for (double value : {-50.0, -52.5, -41.0, -47.0, -58.0}) {
+    expected.add_sample(value);
+  }
+  const auto& merged = snapshot[0];
+  CHECK(merged.x == 0);
+  CHECK(merged.wifi_id == 1);
+  CHECK(merged.data == expected.data);
+  CHECK(merged.average == expected.average);
+  CHECK(merged.variance() == Catch::Approx(expected.variance()));
+  CHECK(snapshot[1].x == 10);
+  CHECK(snapshot[1].average == -60.0);
+  CHECK(snapshot[1].variance() == 0.0);
+  CHECK(snapshot[2].wifi_id == 2);
+  CHECK(snapshot[2].average == -70.0);
+
+}
@@ -0,0 +1,119 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <catch2/catch_amalgamated.hpp>
+
+#include "src/state/occupancy_grid.h"
+#include "src/state/state.h"
+
+using namespace Valeronoi::state;
+
+TEST_CASE("OccupancyGrid answers point queries", "[state]") {
+  // Two rects in map units with a pixel size of 5, the second one spanning
+  // more than one word
+  const std::vector<QRect> rects{QRect(100, 200, 10, 5),
+                                 QRect(400, 210, 350, 10)};
+  QRect bounds;
+  for (const auto& rect : rects) {
+    bounds |= rect;
+  }
+  const OccupancyGrid grid(rects, bounds, 5);
+  CHECK(grid.x() == 100);
+  CHECK(grid.y() == 200);
+  CHECK(grid.columns() == 130);
+  CHECK(grid.rows() == 4);
+
+  CHECK(grid.contains(100, 200));
+  CHECK(grid.contains(109, 204));
+  CHECK(!grid.contains(110, 200));
+  CHECK(!grid.contains(100, 205));
+  CHECK(grid.contains(400, 210));
+  CHECK(grid.contains(749, 219));
+  CHECK(!grid.contains(750, 219));
+  CHECK(!grid.contains(399, 210));
+
+  // Outside of the grid
+  CHECK(!grid.contains(99, 200));
+  CHECK(!grid.contains(100, 199));
+  CHECK(!grid.contains(-100, -200));
+  CHECK(!grid.contains(10000, 210));
+  CHECK(!grid.contains(400, 10000));
+
+  CHECK(grid.cell(0, 0));
+  CHECK(grid.cell(1, 0));
+  CHECK(!grid.cell(2, 0));
+  CHECK(grid.cell(60, 2));
+  CHECK(grid.cell(129, 3));
+}
+
+TEST_CASE("OccupancyGrid counts cells", "[state]") {
+  const std::vector<QRect> rects{QRect(0, 0, 5, 5), QRect(300, 0, 350, 10)};
+  QRect bounds;
+  for (const auto& rect : rects) {
+    bounds |= rect;
+  }
+  const OccupancyGrid grid(rects, bounds, 5);
+  REQUIRE(grid.columns() == 130);
+  CHECK(grid.count() == 1 + 70 * 2);
+
+  CHECK(grid.count_row(0, 0, grid.columns()) == 71);
+  CHECK(grid.count_row(1, 0, grid.columns()) == 70);
+  // Ranges crossing word boundaries
+  CHECK(grid.count_row(1, 60, 130) == 70);
+  CHECK(grid.count_row(1, 63, 65) == 2);
+  CHECK(grid.count_row(1, 64, 128) == 64);
+  CHECK(grid.count_row(1, 100, 101) == 1);
+  CHECK(grid.count_row(0, 0, 60) == 1);
+
+  // Out of range arguments are clamped
+  CHECK(grid.count_row(0, -10, 1000) == 71);
+  CHECK(grid.count_row(-1, 0, 130) == 0);
+  CHECK(grid.count_row(2, 0, 130) == 0);
+  CHECK(grid.count_row(0, 80, 70) == 0);
+}
+
+TEST_CASE("OccupancyGrid of an empty layer", "[state]") {
+  const OccupancyGrid grid({}, QRect(), 5);
+  CHECK(grid.columns() == 0);
+  CHECK(grid.rows() == 0);
+  CHECK(grid.count() == 0);
+  CHECK(!grid.contains(0, 0));
+  CHECK(grid.count_row(0, 0, 10) == 0);
+
+  Layer layer;
+  CHECK(!layer.contains(0, 0));
+}
+
+TEST_CASE("Layer queries its grid in cropped coordinates", "[state]") {
+  Layer layer;
+  layer.rects = {QRect(100, 100, 20, 10)};
+  layer.bounds = layer.rects[0];
+  layer.grid = std::make_shared<const OccupancyGrid>(layer.rects,
+                                                     layer.bounds, 5);
+  CHECK(layer.contains(100, 100));
+  CHECK(!layer.contains(0, 0));
+
+  auto cropped = layer;
+  cropped.crop_x = 100;
+  cropped.crop_y = 100;
+  for (auto& rect : cropped.rects) {
+    rect.translate(-100, -100);
+  }
+  CHECK(cropped.grid == layer.grid);
+  CHECK(cropped.contains(0, 0));
+  CHECK(cropped.contains(19, 9));
+  CHECK(!cropped.contains(20, 0));
+  CHECK(!cropped.contains(100, 100));
+
+  Map map;
+  map.layers["floor"] = std::make_shared<const Layer>(cropped);
+  auto wall = cropped;
+  wall.rects = {QRect(0, 0, 5, 10)};
+  wall.grid = std::make_shared<const OccupancyGrid>(
+      std::vector<QRect>{QRect(100, 100, 5, 10)}, QRect(100, 100, 5, 10), 5);
+  map.layers["wall"] = std::make_shared<const Layer>(wall);
+  CHECK(map.cell_type(0, 0) == CELL_TYPE::Wall);
+  CHECK(map.cell_type(10, 0) == CELL_TYPE::Floor);
+  CHECK(map.cell_type(30, 0) == CELL_TYPE::Unknown);
+}
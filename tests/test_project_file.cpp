@@ -0,0 +1,172 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <catch2/catch_amalgamated.hpp>
+
+#include "src/state/measurements.h"
+#include "src/state/project_file.h"
+
+using namespace Valeronoi::state;
+
+static QJsonObject test_map() {
+  QJsonObject map;
+  map.insert("__class", "ValetudoMap");
+  map.insert("pixelSize", 5);
+  QJsonObject meta_data;
+  meta_data.insert("version", 2);
+  map.insert("metaData", meta_data);
+  return map;
+}
+
+static QJsonArray test_measurements() {
+  QJsonArray json;
+  for (int i = 0; i < 50; i++) {
+    QJsonObject m;
+    m.insert("x", i * 10);
+    m.insert("y", 1000 - i);
+    m.insert("wifi", i % 2);
+    m.insert("data", QJsonArray({-40.5 - i, -60.25}));
+    json.append(m);
+  }
+  return json;
+}
+
+static void check_measurements(const Measurements& measurements) {
+  const auto snapshot = measurements.get_measurements();
+  REQUIRE(snapshot.size() == 50);
+  for (std::size_t i = 0; i < snapshot.size(); i++) {
+    const auto& m = snapshot[i];
+    CHECK(m.x == static_cast<int>(i) * 10);
+    CHECK(m.y == 1000 - static_cast<int>(i));
+    CHECK(m.wifi_id == static_cast<int>(i) % 2);
+    REQUIRE(m.data.size() == 2);
+    CHECK(m.data[0] == -40.5 - static_cast<double>(i));
+    CHECK(m.data[1] == -60.25);
+  }
+}
+
+TEST_CASE("ProjectFile round trip", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+
+  Measurements measurements;
+  measurements.set_json(test_measurements());
+  QJsonArray wifis;
+  QJsonObject wifi;
+  wifi.insert("ssid", "Test");
+  wifis.append(wifi);
+
+  for (const int format : {PROJECT_FORMAT_JSON, PROJECT_FORMAT_BINARY}) {
+    const auto path = dir.filePath(QString("test_%1.vwm").arg(format));
+    REQUIRE(ProjectFile::save(path, format, test_map(), wifis, measurements));
+
+    ProjectFile project;
+    REQUIRE(project.load(path));
+    CHECK(project.version() == format);
+    CHECK(project.map() == test_map());
+    REQUIRE(project.wifis().has_value());
+    CHECK(*project.wifis() == wifis);
+
+    Measurements loaded;
+    project.apply_measurements(loaded);
+    check_measurements(loaded);
+  }
+}
+
+TEST_CASE("ProjectFile converts between formats", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+
+  // A version 1 file as written by older versions, without wifi table
+  QJsonObject root;
+  root.insert("map", test_map());
+  root.insert("measurements", test_measurements());
+  root.insert("version", 1);
+  const auto json_path = dir.filePath("old.vwm");
+  QFile file(json_path);
+  REQUIRE(file.open(QIODevice::WriteOnly));
+  file.write(QJsonDocument(root).toJson());
+  file.close();
+
+  const auto binary_path = dir.filePath("binary.vwm");
+  const auto back_path = dir.filePath("back.vwm");
+  REQUIRE(ProjectFile::convert(json_path, binary_path, PROJECT_FORMAT_BINARY));
+  REQUIRE(ProjectFile::convert(binary_path, back_path, PROJECT_FORMAT_JSON));
+
+  ProjectFile binary;
+  REQUIRE(binary.load(binary_path));
+  CHECK(binary.version() == PROJECT_FORMAT_BINARY);
+  CHECK(!binary.wifis().has_value());
+  Measurements binary_measurements;
+  binary.apply_measurements(binary_measurements);
+  check_measurements(binary_measurements);
+
+  ProjectFile back;
+  REQUIRE(back.load(back_path));
+  CHECK(back.version() == PROJECT_FORMAT_JSON);
+  CHECK(back.map() == test_map());
+  Measurements back_measurements;
+  back.apply_measurements(back_measurements);
+  check_measurements(back_measurements);
+}
+
+TEST_CASE("ProjectFile rejects broken files", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+
+  Measurements measurements;
+  measurements.set_json(test_measurements());
+  const auto path = dir.filePath("truncated.vwm");
+  REQUIRE(ProjectFile::save(path, PROJECT_FORMAT_BINARY, test_map(),
+                            std::nullopt, measurements));
+  QFile file(path);
+  REQUIRE(file.open(QIODevice::ReadWrite));
+  REQUIRE(file.resize(file.size() / 2));
+  file.close();
+
+  ProjectFile project;
+  CHECK(!project.load(path));
+  CHECK(!project.error().isEmpty());
+
+  CHECK(!project.load(dir.filePath("does_not_exist.vwm")));
+}
+
+TEST_CASE("ProjectFile rejects corrupted chunks", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+
+  Measurements measurements;
+  measurements.set_json(test_measurements());
+  QJsonArray wifis;
+  wifis.append(QJsonObject({{"ssid", "Test"}}));
+
+  // Chunks are written in the order measurements, wifis and map
+  for (int chunk : {1, 2}) {
+    const auto path = dir.filePath(QString("chunk_%1.vwm").arg(chunk));
+    REQUIRE(ProjectFile::save(path, PROJECT_FORMAT_BINARY, test_map(), wifis,
+                              measurements));
+    ProjectFile intact;
+    REQUIRE(intact.load(path));
+
+    QFile file(path);
+    REQUIRE(file.open(QIODevice::ReadWrite));
+    const auto data = file.readAll();
+    const auto offset =
+        qFromLittleEndian<quint64>(data.constData() + 16 + chunk * 24 + 8);
+    // A CBOR break code is not valid at the start of an item
+    REQUIRE(file.seek(static_cast<qint64>(offset)));
+    REQUIRE(file.write("\xff", 1) == 1);
+    file.close();
+
+    ProjectFile project;
+    CHECK(!project.load(path));
+    CHECK(!project.error().isEmpty());
+  }
+}
@@ -0,0 +1,182 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTemporaryDir>
+#include <catch2/catch_amalgamated.hpp>
+
+#include "src/state/measurements.h"
+#include "src/state/recording_journal.h"
+
+using namespace Valeronoi::state;
+
+static QJsonObject test_map(int layers) {
+  QJsonObject map;
+  map.insert("__class", "ValetudoMap");
+  map.insert("layers", QJsonArray({layers}));
+  return map;
+}
+
+TEST_CASE("RecordingJournal replays all records", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+  const auto path = RecordingJournal::journal_path(dir.filePath("out.vwm"));
+
+  QJsonArray wifis;
+  QJsonObject wifi;
+  wifi.insert("ssid", "Test");
+  wifis.append(wifi);
+  {
+    RecordingJournal journal;
+    REQUIRE(journal.open(path));
+    journal.set_wifis(wifis);
+    journal.set_map(QJsonDocument(test_map(1)).toJson(), 1);
+    for (int i = 0; i < 1000; i++) {
+      journal.append_measurement(i % 10, i % 7, -40.0 - i, 0);
+    }
+    journal.flush();
+  }
+
+  Measurements measurements;
+  QJsonObject map;
+  std::optional<QJsonArray> loaded_wifis;
+  REQUIRE(RecordingJournal::replay(path, measurements, map, loaded_wifis));
+  CHECK(map == test_map(1));
+  REQUIRE(loaded_wifis.has_value());
+  CHECK(*loaded_wifis == wifis);
+
+  const auto snapshot = measurements.get_measurements();
+  CHECK(snapshot.size() == 70);
+  std::size_t samples = 0;
+  for (const auto& m : snapshot) {
+    samples += m.data.size();
+  }
+  CHECK(samples == 1000);
+  CHECK(snapshot[0].x == 0);
+  CHECK(snapshot[0].y == 0);
+  CHECK(snapshot[0].data[0] == -40.0);
+}
+
+TEST_CASE("RecordingJournal skips maps with unchanged layers", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+  const auto path = RecordingJournal::journal_path(dir.filePath("out.vwm"));
+  {
+    RecordingJournal journal;
+    REQUIRE(journal.open(path));
+    journal.set_map(QJsonDocument(test_map(1)).toJson(), 1);
+    // Only the layers hash is compared, not the JSON
+    journal.set_map(QJsonDocument(test_map(2)).toJson(), 1);
+    journal.flush();
+  }
+
+  Measurements measurements;
+  QJsonObject map;
+  std::optional<QJsonArray> wifis;
+  REQUIRE(RecordingJournal::replay(path, measurements, map, wifis));
+  CHECK(map == test_map(1));
+}
+
+TEST_CASE("RecordingJournal survives a torn write", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+  const auto path = RecordingJournal::journal_path(dir.filePath("out.vwm"));
+  {
+    RecordingJournal journal;
+    REQUIRE(journal.open(path));
+    for (int i = 0; i < 10; i++) {
+      journal.append_measurement(i, i, -50.0, 0);
+    }
+    journal.flush();
+  }
+  // Cut the last record in half, as a crash during the write would
+  QFile file(path);
+  REQUIRE(file.open(QIODevice::ReadWrite));
+  REQUIRE(file.resize(file.size() - 10));
+  file.close();
+
+  Measurements measurements;
+  QJsonObject map;
+  std::optional<QJsonArray> wifis;
+  REQUIRE(RecordingJournal::replay(path, measurements, map, wifis));
+  CHECK(measurements.get_measurements().size() == 9);
+  CHECK(map.isEmpty());
+  CHECK(!wifis.has_value());
+}
+
+TEST_CASE("RecordingJournal keeps a journal it could not replay", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+  const auto path = RecordingJournal::journal_path(dir.filePath("out.vwm"));
+  const QByteArray old_bytes("not a journal, but maybe recoverable by hand");
+  {
+    QFile file(path);
+    REQUIRE(file.open(QIODevice::WriteOnly));
+    file.write(old_bytes);
+  }
+  Measurements measurements;
+  QJsonObject map;
+  std::optional<QJsonArray> wifis;
+  REQUIRE(!RecordingJournal::replay(path, measurements, map, wifis));
+
+  // Starting the next recording must not truncate it
+  {
+    RecordingJournal journal;
+    REQUIRE(journal.open(path));
+    journal.append_measurement(1, 2, -60.0, 0);
+    journal.flush();
+  }
+  const auto kept = QDir(dir.path()).entryList({"out.vwm.journal.*"});
+  REQUIRE(kept.size() == 1);
+  QFile kept_file(dir.filePath(kept[0]));
+  REQUIRE(kept_file.open(QIODevice::ReadOnly));
+  CHECK(kept_file.readAll() == old_bytes);
+
+  REQUIRE(RecordingJournal::replay(path, measurements, map, wifis));
+  CHECK(measurements.get_measurements().size() == 1);
+
+  // Moving aside never replaces an earlier kept journal
+  const auto second = RecordingJournal::move_aside(path);
+  REQUIRE(!second.isEmpty());
+  CHECK(QDir(dir.path()).entryList({"out.vwm.journal.*"}).size() == 2);
+  CHECK(!QFile::exists(path));
+}
+
+TEST_CASE("RecordingJournal never replaces a recovered file", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+  const auto output = dir.filePath("out.vwm");
+  CHECK(RecordingJournal::recovered_path(output) ==
+        dir.filePath("out-recovered.vwm"));
+  for (const auto* name : {"out-recovered.vwm", "out-recovered-2.vwm"}) {
+    QFile file(dir.filePath(name));
+    REQUIRE(file.open(QIODevice::WriteOnly));
+  }
+  CHECK(RecordingJournal::recovered_path(output) ==
+        dir.filePath("out-recovered-3.vwm"));
+}
+
+TEST_CASE("RecordingJournal is removed after saving", "[state]") {
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+  const auto path = RecordingJournal::journal_path(dir.filePath("out.vwm"));
+
+  RecordingJournal journal;
+  REQUIRE(journal.open(path));
+  journal.append_measurement(1, 2, -60.0, 0);
+  journal.flush();
+  CHECK(QFile::exists(path));
+  journal.remove();
+  CHECK(!journal.is_open());
+  CHECK(!QFile::exists(path));
+
+  Measurements measurements;
+  QJsonObject map;
+  std::optional<QJsonArray> wifis;
+  CHECK(!RecordingJournal::replay(path, measurements, map, wifis));
+}
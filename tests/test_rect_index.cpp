@@ -0,0 +1,60 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <algorithm>
+#include <catch2/catch_amalgamated.hpp>
+#include <random>
+
+#include "src/util/rect_index.h"
+
+using Valeronoi::util::RectIndex;
+
+TEST_CASE("RectIndex finds the same rects as a full scan", "[util]") {
+  std::mt19937 generator(4711);
+  std::uniform_int_distribution<int> position(-2000, 2000);
+  std::uniform_int_distribution<int> size(1, 600);
+  std::vector<QRect> rects;
+  for (int i = 0; i < 1000; i++) {
+    rects.emplace_back(position(generator), position(generator),
+                       size(generator), size(generator));
+  }
+  const RectIndex index(rects, 100);
+  REQUIRE(index.size() == 1000);
+
+  std::vector<int> found;
+  for (int i = 0; i < 200; i++) {
+    const QRect area(position(generator), position(generator),
+                     size(generator), size(generator));
+    std::vector<int> expected;
+    for (int j = 0; j < static_cast<int>(rects.size()); j++) {
+      if (rects[j].intersects(area)) {
+        expected.push_back(j);
+      }
+    }
+    index.query(area, found);
+    CHECK(found == expected);
+  }
+
+  // Areas covering everything return all rects in order
+  index.query(index.bounds().adjusted(-10, -10, 10, 10), found);
+  REQUIRE(found.size() == rects.size());
+  CHECK(std::is_sorted(found.begin(), found.end()));
+}
+
+TEST_CASE("RectIndex edge cases", "[util]") {
+  std::vector<int> found{1, 2, 3};
+  const RectIndex empty;
+  CHECK(empty.empty());
+  empty.query(QRect(0, 0, 100, 100), found);
+  CHECK(found.empty());
+
+  // Rects cover [x, x + width), touching ones do not intersect
+  const RectIndex index({QRect(0, 0, 10, 10), QRect(10, 0, 10, 10)});
+  index.query(QRect(10, 0, 1, 1), found);
+  CHECK(found == std::vector<int>{1});
+  index.query(QRect(9, 9, 2, 2), found);
+  CHECK(found == std::vector<int>{0, 1});
+  index.query(QRect(20, 0, 5, 5), found);
+  CHECK(found.empty());
+}
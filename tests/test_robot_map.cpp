@@ -1,8 +1,20 @@
+#include <QCoreApplication>
 #include <QJsonArray>
+#include <QJsonDocument>
 #include <QJsonObject>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QThread>
 #include <catch2/catch_amalgamated.hpp>
+#include <iostream>
+#include <random>
+#include <vector>
 
+#include "src/state/measurements.h"
+#include "src/state/project_file.h"
+#include "src/state/recording_journal.h"
 #include "src/state/robot_map.h"
+#include "tests/test_helpers.h"
 
 using namespace Valeronoi::state;
 
@@ -42,3 +54,391 @@ TEST_CASE("RobotMap basic functionality", "[state]") {
     CHECK(m.crop_y == 1000);
   }
 }
+
+static QByteArray floor_map_json(int x) {
+  QJsonObject map_json;
+  map_json.insert("__class", "ValetudoMap");
+  map_json.insert("metaData", QJsonObject({{"version", 2}}));
+  map_json.insert("pixelSize", 5);
+  QJsonObject floor;
+  floor.insert("type", "floor");
+  floor.insert("compressedPixels", QJsonArray({x, 10, 4}));
+  map_json.insert("layers", QJsonArray({floor}));
+  return QJsonDocument(map_json).toJson();
+}
+
+TEST_CASE("RobotMap decodes in the background", "[state]") {
+  ensure_application();
+
+  RobotMap map;
+  QSignalSpy spy(&map, &RobotMap::signal_map_updated);
+
+  // Only the last of several quick updates may end up in the map
+  for (int i = 1; i <= 20; i++) {
+    map.update_map_json_async(floor_map_json(i * 10));
+  }
+  int attempts = 0;
+  while (!map.is_valid() && attempts < 50) {
+    QCoreApplication::processEvents();
+    QThread::msleep(100);
+    attempts++;
+  }
+  REQUIRE(map.is_valid());
+  CHECK(map.get_map().crop_x == 200 * 5);
+  CHECK(map.get_map().size_x == 4 * 5);
+  CHECK(spy.count() == 1);
+
+  SECTION("A synchronous update supersedes pending results") {
+    map.update_map_json_async(floor_map_json(1));
+    map.update_map_json(floor_map_json(2));
+    QThread::msleep(200);
+    QCoreApplication::processEvents();
+    CHECK(map.get_map().crop_x == 2 * 5);
+  }
+
+  SECTION("Errors keep the last valid map") {
+    map.update_map_json_async("{broken");
+    attempts = 0;
+    while (map.is_valid() && attempts < 50) {
+      QCoreApplication::processEvents();
+      QThread::msleep(100);
+      attempts++;
+    }
+    CHECK(!map.is_valid());
+    CHECK(!map.error_msg().isEmpty());
+    CHECK(map.get_map().crop_x == 200 * 5);
+    CHECK(!map.get_map_json().isEmpty());
+  }
+}
+
+TEST_CASE("RobotMap reuses unchanged layers", "[state]") {
+  const auto robot_at = [](int x, int y) {
+    QJsonObject robot;
+    robot.insert("__class", "PointMapEntity");
+    robot.insert("type", "robot_position");
+    robot.insert("points", QJsonArray({x, y}));
+    return robot;
+  };
+  QJsonObject map_json;
+  map_json.insert("__class", "ValetudoMap");
+  map_json.insert("metaData", QJsonObject({{"version", 2}}));
+  map_json.insert("pixelSize", 5);
+  QJsonObject floor;
+  floor.insert("type", "floor");
+  floor.insert("compressedPixels", QJsonArray({20, 20, 4, 20, 21, 4}));
+  map_json.insert("layers", QJsonArray({floor}));
+  map_json.insert("entities", QJsonArray({robot_at(110, 110)}));
+
+  const auto first = MapParser::decode(map_json);
+  REQUIRE(first->valid);
+  const auto first_floor = first->map.layers.at("floor");
+  // Both rows have the same span and are merged into one rect
+  REQUIRE(first_floor->rects.size() == 1);
+  CHECK(first_floor->rects[0] == QRect(0, 0, 20, 10));
+
+  // Only the robot moved
+  map_json.insert("entities", QJsonArray({robot_at(105, 110)}));
+  const auto moved = MapParser::decode(map_json, first);
+  REQUIRE(moved->valid);
+  CHECK(moved->map.layers.at("floor") == first_floor);
+  CHECK(moved->map.get_robot_position()->x == 5);
+
+  // The robot left the floor, which changes the crop of all layers
+  map_json.insert("entities", QJsonArray({robot_at(90, 110)}));
+  const auto cropped = MapParser::decode(map_json, moved);
+  REQUIRE(cropped->valid);
+  const auto& cropped_floor = cropped->map.layers.at("floor");
+  CHECK(cropped_floor != first_floor);
+  CHECK(cropped->map.crop_x == 90);
+  CHECK(cropped_floor->rects[0] == QRect(10, 0, 20, 10));
+
+  // Changed pixel data is decoded again
+  floor.insert("compressedPixels", QJsonArray({20, 20, 5}));
+  map_json.insert("layers", QJsonArray({floor}));
+  const auto changed = MapParser::decode(map_json, cropped);
+  REQUIRE(changed->valid);
+  CHECK(changed->map.layers.at("floor")->hash != first_floor->hash);
+  CHECK(changed->map.layers.at("floor")->rects.size() == 1);
+}
+
+TEST_CASE("RobotMap decodes layers lazily", "[state]") {
+  QJsonObject map_json;
+  map_json.insert("__class", "ValetudoMap");
+  map_json.insert("metaData", QJsonObject({{"version", 2}}));
+  map_json.insert("pixelSize", 5);
+  QJsonObject floor;
+  floor.insert("type", "floor");
+  floor.insert("compressedPixels", QJsonArray({20, 20, 4, 18, 21, 0}));
+  QJsonObject wall;
+  wall.insert("type", "wall");
+  wall.insert("compressedPixels", QJsonArray({19, 19, 6}));
+  map_json.insert("layers", QJsonArray({floor, wall}));
+  QJsonObject robot;
+  robot.insert("__class", "PointMapEntity");
+  robot.insert("type", "robot_position");
+  robot.insert("points", QJsonArray({112, 103}));
+  map_json.insert("entities", QJsonArray({robot}));
+  const auto json = QJsonDocument(map_json).toJson();
+
+  const auto lazy = MapParser::decode(json, {}, false);
+  const auto complete = MapParser::decode(json);
+  REQUIRE(lazy->valid);
+  CHECK(!lazy->layers_decoded);
+  CHECK(lazy->map.layers.empty());
+  CHECK(lazy->map.crop_x == complete->map.crop_x);
+  CHECK(lazy->map.crop_y == complete->map.crop_y);
+  CHECK(lazy->map.size_x == complete->map.size_x);
+  CHECK(lazy->map.size_y == complete->map.size_y);
+
+  RobotMap map;
+  map.update_map_json_lazy(json);
+  REQUIRE(map.is_valid());
+  const auto position = map.get_robot_position();
+  REQUIRE(position.has_value());
+  CHECK(position->x == 112 - 95);
+  CHECK(position->y == 103 - 95);
+  // The first access decodes the layers
+  CHECK(map.get_map_json() == map_json);
+  CHECK(map.get_map().layers.size() == 2);
+  CHECK(map.get_map().crop_x == 95);
+}
+
+TEST_CASE("RobotMap saves and journals lazy maps undecoded", "[state]") {
+  QJsonObject map_json;
+  map_json.insert("__class", "ValetudoMap");
+  map_json.insert("metaData", QJsonObject({{"version", 2}}));
+  map_json.insert("pixelSize", 5);
+  QJsonObject floor;
+  floor.insert("type", "floor");
+  floor.insert("compressedPixels", QJsonArray({20, 20, 4}));
+  map_json.insert("layers", QJsonArray({floor}));
+  QJsonObject robot;
+  robot.insert("__class", "PointMapEntity");
+  robot.insert("type", "robot_position");
+  robot.insert("points", QJsonArray({105, 102}));
+  map_json.insert("entities", QJsonArray({robot}));
+
+  RobotMap map;
+  map.update_map_json_lazy(QJsonDocument(map_json).toJson());
+  REQUIRE(map.is_valid());
+  CHECK(!map.has_decoded_layers());
+
+  // What the headless recorder journals and saves
+  QTemporaryDir dir;
+  REQUIRE(dir.isValid());
+  const auto output = dir.filePath("out.vwm");
+  const auto journal_path = RecordingJournal::journal_path(output);
+  Measurements measurements;
+  {
+    RecordingJournal journal;
+    REQUIRE(journal.open(journal_path));
+    journal.set_map(map.get_map_source(), map.get_layers_hash());
+    journal.flush();
+  }
+  REQUIRE(ProjectFile::save(
+      output, PROJECT_FORMAT_BINARY,
+      QJsonDocument::fromJson(map.get_map_source()).object(), std::nullopt,
+      measurements));
+  CHECK(!map.has_decoded_layers());
+
+  ProjectFile project;
+  REQUIRE(project.load(output));
+  CHECK(project.map() == map_json);
+  QJsonObject journaled;
+  std::optional<QJsonArray> wifis;
+  REQUIRE(RecordingJournal::replay(journal_path, measurements, journaled,
+                                   wifis));
+  CHECK(journaled == map_json);
+
+  CHECK(map.get_map().layers.size() == 1);
+  CHECK(map.has_decoded_layers());
+}
+
+TEST_CASE("RobotMap skips unchanged layers of lazy updates", "[state]") {
+  const auto robot_at = [](int x, int y) {
+    QJsonObject robot;
+    robot.insert("__class", "PointMapEntity");
+    robot.insert("type", "robot_position");
+    robot.insert("points", QJsonArray({x, y}));
+    // Strings may contain anything that looks like JSON structure
+    robot.insert("metaData", QJsonObject({{"name", "\"layers\": [}"}}));
+    return robot;
+  };
+  QJsonObject map_json;
+  map_json.insert("__class", "ValetudoMap");
+  map_json.insert("metaData", QJsonObject({{"version", 2}}));
+  map_json.insert("pixelSize", 5);
+  QJsonObject floor;
+  floor.insert("type", "floor");
+  floor.insert("compressedPixels", QJsonArray({20, 20, 4}));
+  map_json.insert("layers", QJsonArray({floor}));
+  map_json.insert("entities", QJsonArray({robot_at(110, 105)}));
+
+  const auto first =
+      MapParser::decode(QJsonDocument(map_json).toJson(), {}, false);
+  REQUIRE(first->valid);
+  CHECK(first->json["layers"].toArray().isEmpty());
+  CHECK(first->layers_hash != 0);
+  CHECK(first->layers_bounds == QRect(100, 100, 20, 5));
+  CHECK(first->map.crop_x == 100);
+
+  // The robot moved, the bounds of the layers are taken over
+  map_json.insert("entities", QJsonArray({robot_at(90, 105)}));
+  const auto moved =
+      MapParser::decode(QJsonDocument(map_json).toJson(), first, false);
+  REQUIRE(moved->valid);
+  CHECK(moved->layers_hash == first->layers_hash);
+  CHECK(moved->map.crop_x == 90);
+  CHECK(moved->map.get_robot_position()->x == 0);
+  const auto complete = MapParser::decode(QJsonDocument(map_json).toJson());
+  CHECK(complete->layers_hash == moved->layers_hash);
+  CHECK(complete->map.crop_x == moved->map.crop_x);
+  CHECK(complete->map.size_x == moved->map.size_x);
+
+  // Changed layers are scanned for their bounds again
+  floor.insert("compressedPixels", QJsonArray({10, 20, 4}));
+  map_json.insert("layers", QJsonArray({floor}));
+  const auto changed =
+      MapParser::decode(QJsonDocument(map_json).toJson(), moved, false);
+  REQUIRE(changed->valid);
+  CHECK(changed->layers_hash != moved->layers_hash);
+  CHECK(changed->layers_bounds == QRect(50, 100, 20, 5));
+  CHECK(changed->map.crop_x == 50);
+}
+
+// A map of about the size of a large apartment, mostly made of layer pixels
+static QByteArray large_map(int robot_x) {
+  QJsonArray floor_pixels, wall_pixels;
+  for (int y = 0; y < 800; y++) {
+    for (int x = 0; x < 800; x += 10) {
+      floor_pixels.append(x);
+      floor_pixels.append(y);
+      floor_pixels.append(8);
+      wall_pixels.append(x + 8);
+      wall_pixels.append(y);
+      wall_pixels.append(2);
+    }
+  }
+  QJsonObject floor, wall, robot;
+  floor.insert("type", "floor");
+  floor.insert("compressedPixels", floor_pixels);
+  wall.insert("type", "wall");
+  wall.insert("compressedPixels", wall_pixels);
+  robot.insert("__class", "PointMapEntity");
+  robot.insert("type", "robot_position");
+  robot.insert("points", QJsonArray({robot_x, 2000}));
+  QJsonObject map_json;
+  map_json.insert("__class", "ValetudoMap");
+  map_json.insert("metaData", QJsonObject({{"version", 2}}));
+  map_json.insert("pixelSize", 5);
+  map_json.insert("layers", QJsonArray({floor, wall}));
+  map_json.insert("entities", QJsonArray({robot}));
+  return QJsonDocument(map_json).toJson(QJsonDocument::Compact);
+}
+
+// Hidden by default, run with: valeronoi-tests "[benchmark]"
+TEST_CASE("Map decoding benchmark", "[.][benchmark]") {
+  const auto json = large_map(2000);
+  const auto moved = large_map(2005);
+  const auto complete = MapParser::decode(json);
+  const auto lazy = MapParser::decode(json, {}, false);
+
+  BENCHMARK("Complete decode") { return MapParser::decode(moved); };
+
+  BENCHMARK("Complete decode, unchanged layers") {
+    return MapParser::decode(moved, complete);
+  };
+
+  BENCHMARK("Lazy decode") { return MapParser::decode(moved, {}, false); };
+
+  BENCHMARK("Lazy decode, unchanged layers") {
+    return MapParser::decode(moved, lazy, false);
+  };
+}
+
+// Floor plan of rooms with straight walls and a few ragged rows, as pixel
+// runs in compressedPixels format
+static QJsonArray floor_plan(int size, unsigned seed,
+                             std::vector<std::vector<bool>>* grid = nullptr) {
+  std::mt19937 rng(seed);
+  std::uniform_int_distribution<int> ragged(0, 9), jitter(0, 3);
+  QJsonArray pixels;
+  if (grid) {
+    grid->assign(size, std::vector<bool>(size, false));
+  }
+  for (int y = 0; y < size; y++) {
+    const bool ragged_row = ragged(rng) == 0;
+    // A wall every 100 pixels splits the row into rooms
+    for (int room = 0; room + 100 <= size; room += 100) {
+      const int start = room + 1 + (ragged_row ? jitter(rng) : 0);
+      const int end = room + 98 - (ragged_row ? jitter(rng) : 0);
+      const int count = end - start + 1;
+      pixels.append(start);
+      pixels.append(y);
+      pixels.append(count);
+      if (grid) {
+        for (int x = start; x < start + count; x++) {
+          (*grid)[y][x] = true;
+        }
+      }
+    }
+  }
+  return pixels;
+}
+
+static QJsonObject floor_map(const QJsonArray& pixels) {
+  QJsonObject map_json;
+  map_json.insert("__class", "ValetudoMap");
+  map_json.insert("metaData", QJsonObject({{"version", 2}}));
+  map_json.insert("pixelSize", 1);
+  QJsonObject floor;
+  floor.insert("type", "floor");
+  floor.insert("compressedPixels", pixels);
+  map_json.insert("layers", QJsonArray({floor}));
+  return map_json;
+}
+
+TEST_CASE("RobotMap merges rows into maximal rects", "[state]") {
+  std::vector<std::vector<bool>> grid;
+  const auto decoded = MapParser::decode(floor_map(floor_plan(300, 1, &grid)));
+  REQUIRE(decoded->valid);
+  const auto& map = decoded->map;
+  const auto& rects = map.layers.at("floor")->rects;
+  // 3 rooms with 300 rows each, mostly straight
+  CHECK(rects.size() < 300);
+
+  // The rects cover exactly the floor pixels, without overlapping
+  std::vector<std::vector<int>> covered(300, std::vector<int>(300, 0));
+  for (const auto& rect : rects) {
+    for (int y = rect.top(); y <= rect.bottom(); y++) {
+      for (int x = rect.left(); x <= rect.right(); x++) {
+        covered[y + map.crop_y][x + map.crop_x]++;
+      }
+    }
+  }
+  for (int y = 0; y < 300; y++) {
+    for (int x = 0; x < 300; x++) {
+      REQUIRE(covered[y][x] == (grid[y][x] ? 1 : 0));
+    }
+  }
+}
+
+// Hidden by default, run with: valeronoi-tests "[benchmark]"
+TEST_CASE("RobotMap layer benchmark", "[.][benchmark]") {
+  for (const int size : {1000, 3000}) {
+    const auto pixels = floor_plan(size, 2);
+    const auto map_json = floor_map(pixels);
+    const auto spans = static_cast<std::size_t>(pixels.size() / 3);
+    const auto rects =
+        MapParser::decode(map_json)->map.layers.at("floor")->rects.size();
+    std::cout << size << "x" << size << " floor: " << spans
+              << " row spans (" << spans * sizeof(QRect) / 1024
+              << " KiB) merged into " << rects << " rects ("
+              << rects * sizeof(QRect) / 1024 << " KiB)" << std::endl;
+
+    BENCHMARK("Decode " + std::to_string(size) + "x" + std::to_string(size) +
+              " floor") {
+      return MapParser::decode(map_json);
+    };
+  }
+}
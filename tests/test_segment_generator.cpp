@@ -6,17 +6,18 @@
 #include <QDebug>
 #include <QSignalSpy>
 #include <catch2/catch_amalgamated.hpp>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
 
 #include "src/util/segment_generator.h"
+#include "tests/test_helpers.h"
 
 using Catch::Approx;
 
 TEST_CASE("SegmentGenerator thread safety and responsiveness", "[util]") {
-  // We need a QCoreApplication for signals/slots to work if they are
-  // cross-thread
-  int argc = 1;
-  char* argv[] = {(char*)"test"};
-  QCoreApplication app(argc, argv);
+  ensure_application();
 
   Valeronoi::util::SegmentGenerator generator;
   QSignalSpy spy(&generator,
@@ -59,12 +60,7 @@ TEST_CASE("SegmentGenerator thread safety and responsiveness", "[util]") {
 }
 
 TEST_CASE("SegmentGenerator simplification logic", "[util]") {
-  // We need a QCoreApplication
-  if (!QCoreApplication::instance()) {
-    int argc = 1;
-    char* argv[] = {(char*)"test"};
-    new QCoreApplication(argc, argv);
-  }
+  ensure_application();
 
   Valeronoi::util::SegmentGenerator generator;
   QSignalSpy spy(&generator,
@@ -87,9 +83,336 @@ TEST_CASE("SegmentGenerator simplification logic", "[util]") {
   }
 
   REQUIRE(spy.count() > 0);
-  auto segments = spy.takeFirst().at(0).value<Valeronoi::state::DataSegments>();
-  CHECK(segments.size() == 1);
-  CHECK(segments[0].x == 10);
-  CHECK(segments[0].y == 10);
-  CHECK(segments[0].value == Approx(-55.0));
+  const auto segments =
+      spy.takeFirst().at(0).value<Valeronoi::state::DataSegmentsPtr>();
+  REQUIRE(segments);
+  CHECK(segments->size() == 1);
+  CHECK(segments->positions[0] == QPoint(10, 10));
+  CHECK(segments->values[0] == Approx(-55.0));
+}
+
+TEST_CASE("SegmentGenerator generates all access points", "[util]") {
+  ensure_application();
+
+  Valeronoi::util::SegmentGenerator generator;
+  QSignalSpy spy(&generator,
+                 &Valeronoi::util::SegmentGenerator::generated_segments);
+
+  Valeronoi::state::RawMeasurements measurements;
+  for (int i = 0; i < 30; ++i) {
+    const double value = -40.0 - i;
+    measurements.push_back({i * 10, i * 5, i % 3, {value}, value});
+  }
+  const Valeronoi::state::MeasurementSnapshot snapshot(measurements);
+
+  const auto wait_for_segments = [&spy]() {
+    int attempts = 0;
+    while (spy.count() == 0 && attempts < 50) {
+      QCoreApplication::processEvents();
+      QThread::msleep(100);
+      attempts++;
+    }
+    REQUIRE(spy.count() > 0);
+    return spy.takeFirst().at(0).value<Valeronoi::state::DataSegmentsPtr>();
+  };
+
+  // The first run also fills the cache for the other access points, which
+  // must yield the same result as generating them directly
+  for (const int wifi_id : {0, 1, 2, -1, 1}) {
+    generator.generate(snapshot, Valeronoi::state::DISPLAY_MODE::DataPoints, 1,
+                       wifi_id);
+    const auto segments = wait_for_segments();
+    REQUIRE(segments);
+    CHECK(segments->size() == (wifi_id == -1 ? 30 : 10));
+    CHECK(segments->part_count() == 0);
+    for (int j = 0; j < segments->size(); j++) {
+      const int i = segments->positions[j].x() / 10;
+      CHECK((wifi_id == -1 || i % 3 == wifi_id));
+      CHECK(segments->values[j] == Approx(-40.0 - i));
+    }
+  }
+}
+
+TEST_CASE("SegmentGenerator keeps results of unchanged access points",
+          "[util]") {
+  ensure_application();
+
+  Valeronoi::util::SegmentGenerator generator;
+  QSignalSpy spy(&generator,
+                 &Valeronoi::util::SegmentGenerator::generated_segments);
+  const auto generate = [&](const Valeronoi::state::RawMeasurements& raw,
+                            int wifi_id) {
+    generator.generate(raw, Valeronoi::state::DISPLAY_MODE::DataPoints, 1,
+                       wifi_id);
+    REQUIRE(spy.wait(5000));
+    return spy.takeLast().at(0).value<Valeronoi::state::DataSegmentsPtr>();
+  };
+
+  Valeronoi::state::RawMeasurements measurements;
+  for (int i = 0; i < 20; ++i) {
+    const double value = -40.0 - i;
+    measurements.push_back({i * 10, 0, i % 2, {value}, value});
+  }
+  const auto first = generate(measurements, 0);
+  const auto other = generate(measurements, 1);
+  REQUIRE(first);
+  REQUIRE(other);
+  CHECK(other->size() == 10);
+
+  // A new sample of access point 0 only invalidates its own result and the
+  // combined one
+  measurements[0].data.push_back(-80.0);
+  measurements[0].average = -60.0;
+  CHECK(generate(measurements, 1) == other);
+  const auto updated = generate(measurements, 0);
+  REQUIRE(updated);
+  CHECK(updated != first);
+  CHECK(updated->values[0] == Approx(-60.0));
+  const auto all = generate(measurements, -1);
+  REQUIRE(all);
+  CHECK(all->size() == 20);
+  CHECK(all->values[0] == Approx(-60.0));
+
+  // As does a new place
+  measurements.push_back({500, 0, 1, {-90.0}, -90.0});
+  const auto extended = generate(measurements, 1);
+  REQUIRE(extended);
+  CHECK(extended != other);
+  CHECK(extended->size() == 11);
+}
+
+TEST_CASE("SegmentGenerator skips unchanged inputs", "[util]") {
+  ensure_application();
+
+  Valeronoi::util::SegmentGenerator generator;
+  QSignalSpy spy(&generator,
+                 &Valeronoi::util::SegmentGenerator::generated_segments);
+  QSignalSpy statistics(
+      &generator, &Valeronoi::util::SegmentGenerator::generated_statistics);
+
+  Valeronoi::state::RawMeasurements measurements;
+  for (int i = 0; i < 10; ++i) {
+    const double value = -40.0 - i;
+    measurements.push_back({i * 10, i * 5, 0, {value}, value});
+  }
+  const Valeronoi::state::MeasurementSnapshot snapshot(measurements);
+
+  generator.generate(snapshot, Valeronoi::state::DISPLAY_MODE::DataPoints, 1);
+  REQUIRE(spy.wait(5000));
+  REQUIRE(statistics.count() == 1);
+  CHECK(statistics.at(0).at(0).toLongLong() >= 0);
+  CHECK(statistics.at(0).at(1).toInt() == 0);
+
+  // Nothing changed, so nothing is generated or emitted
+  generator.generate(snapshot, Valeronoi::state::DISPLAY_MODE::DataPoints, 1);
+  CHECK(!spy.wait(300));
+  CHECK(spy.count() == 1);
+
+  // A changed setting is a changed input, even with the same measurements
+  generator.set_restrict_points(false);
+  generator.generate(snapshot, Valeronoi::state::DISPLAY_MODE::DataPoints, 1);
+  REQUIRE(spy.wait(5000));
+  CHECK(spy.count() == 2);
+  CHECK(statistics.count() == 2);
+}
+
+TEST_CASE("SegmentGenerator previews slow display modes", "[util]") {
+  ensure_application();
+
+  Valeronoi::util::SegmentGenerator generator;
+  QSignalSpy spy(&generator,
+                 &Valeronoi::util::SegmentGenerator::generated_segments);
+  const auto next_segments = [&spy]() {
+    if (spy.count() == 0) {
+      REQUIRE(spy.wait(10000));
+    }
+    return spy.takeFirst().at(0).value<Valeronoi::state::DataSegmentsPtr>();
+  };
+
+  Valeronoi::state::RawMeasurements measurements;
+  const int columns = 50;
+  const int count = static_cast<int>(Valeronoi::util::PREVIEW_MIN_SITES);
+  for (int i = 0; i < count; ++i) {
+    const double value = -40.0 - i % 50;
+    measurements.push_back(
+        {(i % columns) * 10, (i / columns) * 10, 0, {value}, value});
+  }
+  Valeronoi::state::MeasurementSnapshot snapshot(measurements);
+
+  generator.generate(snapshot, Valeronoi::state::DISPLAY_MODE::Voronoi, 1);
+  const auto preview = next_segments();
+  REQUIRE(preview);
+  CHECK(preview->preview);
+  CHECK(preview->size() == count);
+  CHECK(preview->part_count() == 0);
+  const auto full = next_segments();
+  REQUIRE(full);
+  CHECK(!full->preview);
+  CHECK(full->size() == count);
+  CHECK(full->part_count() > 0);
+
+  // One more site is not worth a preview, the last result is good enough
+  measurements.push_back({5, 5, 0, {-80.0}, -80.0});
+  snapshot = Valeronoi::state::MeasurementSnapshot(measurements);
+  generator.generate(snapshot, Valeronoi::state::DISPLAY_MODE::Voronoi, 1);
+  const auto update = next_segments();
+  REQUIRE(update);
+  CHECK(!update->preview);
+  CHECK(update->size() == count + 1);
+
+  // Neither are small diagrams
+  generator.generate(
+      Valeronoi::state::RawMeasurements(measurements.begin(),
+                                        measurements.begin() + 10),
+      Valeronoi::state::DISPLAY_MODE::Voronoi, 1);
+  const auto small = next_segments();
+  REQUIRE(small);
+  CHECK(!small->preview);
+  CHECK(small->size() == 10);
+}
+
+static Valeronoi::state::DataSegmentsPtr voronoi_of(
+    Valeronoi::util::SegmentGenerator& generator,
+    const Valeronoi::state::RawMeasurements& measurements) {
+  QSignalSpy spy(&generator,
+                 &Valeronoi::util::SegmentGenerator::generated_segments);
+  generator.generate(measurements, Valeronoi::state::DISPLAY_MODE::Voronoi, 1);
+  REQUIRE(spy.wait(10000));
+  return spy.takeLast().at(0).value<Valeronoi::state::DataSegmentsPtr>();
+}
+
+// Every vertex of the parts of segment i of a is at most one map unit away
+// from a vertex of the parts of segment i of b. Voronoi vertices are rounded,
+// and the same circumcenter may round differently depending on the order of
+// the vertices of its face.
+static bool parts_close(const Valeronoi::state::DataSegments& a,
+                        const Valeronoi::state::DataSegments& b, int i) {
+  for (int j = a.first_part[i]; j < a.first_part[i + 1]; j++) {
+    const auto part = a.part(j);
+    for (int v = 0; v < part.size; v++) {
+      bool found{false};
+      for (int k = b.first_vertex[b.first_part[i]];
+           k < b.first_vertex[b.first_part[i + 1]] && !found; k++) {
+        const auto difference = b.vertices[k] - part.points[v];
+        found = std::abs(difference.x()) <= 1 && std::abs(difference.y()) <= 1;
+      }
+      if (!found) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+TEST_CASE("SegmentGenerator grows Voronoi diagrams like it builds them",
+          "[util]") {
+  ensure_application();
+
+  // A jittered grid, the corners fix the bounding box and with it the frame
+  // of dummy points
+  std::mt19937 gen(2024);
+  std::uniform_int_distribution<int> jitter(-3, 3);
+  Valeronoi::state::RawMeasurements measurements;
+  const auto add = [](Valeronoi::state::RawMeasurements& m, int x, int y) {
+    const double value = -40.0 - (x + y) % 40;
+    m.push_back({x, y, 0, {value}, value});
+  };
+  for (int y = 1; y < 12; y++) {
+    for (int x = 1; x < 12; x++) {
+      add(measurements, x * 25 + jitter(gen), y * 25 + jitter(gen));
+    }
+  }
+  for (const auto& corner : {QPoint(0, 0), QPoint(300, 0), QPoint(0, 300),
+                             QPoint(300, 300)}) {
+    add(measurements, corner.x(), corner.y());
+  }
+
+  const auto floor = std::make_shared<Valeronoi::state::Layer>();
+  floor->rects = {QRect(-10, -10, 200, 320), QRect(190, -10, 220, 320)};
+  for (const auto& rect : floor->rects) {
+    floor->bounds |= rect;
+  }
+
+  struct Growth {
+    const char* name;
+    std::vector<QPoint> sites;
+    // Sites outside the bounding box keep the old frame of dummy points, so
+    // only cells clipped well inside it match a fresh build
+    bool needs_clipping;
+  };
+  const std::vector<Growth> growths{
+      {"one site", {QPoint(137, 162)}, false},
+      {"a few sites, some on the frame",
+       {QPoint(137, 162), QPoint(60, 211), QPoint(249, 88), QPoint(300, 151),
+        QPoint(2, 298)},
+       false},
+      {"a site outside the bounding box", {QPoint(380, 150)}, true},
+      // Beyond the area new sites can be inserted in, so this is rebuilt
+      {"a site far outside", {QPoint(2000, 150)}, false},
+  };
+
+  for (const auto& growth : growths) {
+    for (const bool use_floor : {false, true}) {
+      for (const bool restrict_points : {false, true}) {
+        if (growth.needs_clipping && !use_floor && !restrict_points) {
+          continue;
+        }
+        DYNAMIC_SECTION(growth.name << ", floor " << use_floor
+                                    << ", restrict points "
+                                    << restrict_points) {
+          auto grown = measurements;
+          for (const auto& site : growth.sites) {
+            add(grown, site.x(), site.y());
+          }
+
+          Valeronoi::util::SegmentGenerator incremental, fresh;
+          for (auto* generator : {&incremental, &fresh}) {
+            generator->set_mask(use_floor ? floor : nullptr);
+            generator->set_restrict_points(restrict_points);
+          }
+          REQUIRE(voronoi_of(incremental, measurements));
+          const auto expected = voronoi_of(fresh, grown);
+          const auto actual = voronoi_of(incremental, grown);
+          REQUIRE(expected);
+          REQUIRE(actual);
+
+          REQUIRE(actual->size() == expected->size());
+          CHECK(actual->part_count() == expected->part_count());
+          for (int i = 0; i < actual->size(); i++) {
+            INFO("Site " << actual->positions[i].x() << ", "
+                         << actual->positions[i].y());
+            REQUIRE(actual->positions[i] == expected->positions[i]);
+            CHECK(actual->first_part[i + 1] - actual->first_part[i] ==
+                  expected->first_part[i + 1] - expected->first_part[i]);
+            CHECK(parts_close(*actual, *expected, i));
+            CHECK(parts_close(*expected, *actual, i));
+          }
+        }
+      }
+    }
+  }
+}
+
+TEST_CASE("DataSegments keeps all parts in one vertex array", "[state]") {
+  Valeronoi::state::DataSegments segments;
+  const QPolygon triangle({QPoint(0, 0), QPoint(10, 0), QPoint(0, 10)});
+  const QPolygon square(QRect(20, 20, 5, 5));
+  segments.add(1, 1, -50.0, {triangle, square});
+  segments.add(30, 30, -60.0);
+  segments.add(2, 2, -70.0, {triangle});
+
+  REQUIRE(segments.size() == 3);
+  CHECK(segments.part_count() == 3);
+  CHECK(segments.vertices.size() == 10);
+  CHECK(segments.first_part == std::vector<int>{0, 2, 2, 3});
+  CHECK(segments.values == std::vector<double>{-50.0, -60.0, -70.0});
+  CHECK(segments.positions[1] == QPoint(30, 30));
+
+  CHECK(segments.part(0).to_polygon() == triangle);
+  CHECK(segments.part(1).to_polygon() == square);
+  CHECK(segments.part(1).bounding_rect() == square.boundingRect());
+  CHECK(segments.part(2).points ==
+        segments.vertices.data() + triangle.size() + square.size());
+  CHECK(segments.part(2).bounding_rect() == QRect(0, 0, 11, 11));
+  CHECK(Valeronoi::state::PolygonView().bounding_rect().isNull());
 }
@@ -0,0 +1,176 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <catch2/catch_amalgamated.hpp>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "src/util/simplify_pyramid.h"
+
+using Catch::Approx;
+using Valeronoi::state::MeasurementSnapshot;
+using Valeronoi::state::RawMeasurements;
+using Valeronoi::util::SIMPLIFY_PYRAMID_SIZES;
+using Valeronoi::util::SimplifyPyramid;
+
+typedef std::vector<std::shared_ptr<const RawMeasurements>> Chunks;
+
+static std::shared_ptr<const RawMeasurements> random_chunk(std::mt19937& gen,
+                                                           int places) {
+  std::uniform_int_distribution<int> position(-50, 500);
+  std::uniform_int_distribution<int> wifi_id(0, 2);
+  std::uniform_int_distribution<int> samples(1, 3);
+  std::uniform_real_distribution<double> signal(-90.0, -30.0);
+  auto chunk = std::make_shared<RawMeasurements>();
+  for (int i = 0; i < places; i++) {
+    Valeronoi::state::Measurement m{};
+    m.x = position(gen);
+    m.y = position(gen);
+    m.wifi_id = wifi_id(gen);
+    for (int j = samples(gen); j > 0; j--) {
+      m.add_sample(signal(gen));
+    }
+    chunk->push_back(std::move(m));
+  }
+  return chunk;
+}
+
+static MeasurementSnapshot snapshot(const Chunks& chunks) {
+  std::size_t size{0};
+  for (const auto& chunk : chunks) {
+    size += chunk->size();
+  }
+  return MeasurementSnapshot(chunks, 32, size, 0);
+}
+
+// Bins every place, the way simplifying worked before the pyramid
+static RawMeasurements reference(const MeasurementSnapshot& measurements,
+                                 int simplify, int wifi_id_filter) {
+  const auto floor_to = [simplify](int value) {
+    return static_cast<int>(
+               std::floor(static_cast<double>(value) / simplify)) *
+           simplify;
+  };
+  std::map<std::pair<int, int>, std::pair<double, std::size_t>> bins;
+  std::map<std::pair<int, int>, int> wifi_ids;
+  for (const auto& m : measurements) {
+    if (wifi_id_filter != -1 && m.wifi_id != wifi_id_filter) {
+      continue;
+    }
+    const std::pair<int, int> bin{floor_to(m.x), floor_to(m.y)};
+    auto& sum = bins[bin];
+    sum.first += m.average * static_cast<double>(m.data.size());
+    sum.second += m.data.size();
+    const auto wifi_id = wifi_ids.find(bin);
+    if (wifi_id == wifi_ids.end() || m.wifi_id < wifi_id->second) {
+      wifi_ids[bin] = m.wifi_id;
+    }
+  }
+  RawMeasurements places;
+  for (const auto& [bin, sum] : bins) {
+    Valeronoi::state::Measurement m{};
+    m.x = bin.first;
+    m.y = bin.second;
+    m.wifi_id = wifi_ids[bin];
+    m.average = sum.first / static_cast<double>(sum.second);
+    places.push_back(std::move(m));
+  }
+  return places;
+}
+
+static void check_simplify(const SimplifyPyramid& pyramid,
+                           const MeasurementSnapshot& measurements) {
+  for (const int simplify : {1, 2, 3, 4, 5, 6, 8, 9, 10, 16, 18, 19, 20, 32}) {
+    for (const int wifi_id_filter : {-1, 0, 2}) {
+      const auto expected =
+          reference(measurements, simplify, wifi_id_filter);
+      const auto places = pyramid.simplify(simplify, wifi_id_filter);
+      REQUIRE(places.size() == expected.size());
+      for (std::size_t i = 0; i < places.size(); i++) {
+        CHECK(places[i].x == expected[i].x);
+        CHECK(places[i].y == expected[i].y);
+        CHECK(places[i].wifi_id == expected[i].wifi_id);
+        CHECK(places[i].average == Approx(expected[i].average));
+      }
+    }
+  }
+}
+
+TEST_CASE("SimplifyPyramid picks the coarsest fitting level", "[util]") {
+  const auto cell_size = [](int simplify) {
+    return SIMPLIFY_PYRAMID_SIZES[SimplifyPyramid::level_for(simplify)];
+  };
+  CHECK(cell_size(0) == 1);
+  CHECK(cell_size(1) == 1);
+  CHECK(cell_size(2) == 2);
+  CHECK(cell_size(3) == 3);
+  CHECK(cell_size(12) == 4);
+  CHECK(cell_size(16) == 16);
+  CHECK(cell_size(18) == 9);
+  CHECK(cell_size(20) == 5);
+  CHECK(cell_size(23) == 1);
+  CHECK(cell_size(64) == 16);
+  // Every position of the simplify slider is served from aggregated cells
+  for (int simplify = 2; simplify <= 20; simplify++) {
+    CHECK(cell_size(simplify) > 1);
+  }
+}
+
+TEST_CASE("SimplifyPyramid matches binning every place", "[util]") {
+  std::mt19937 gen(4711);
+  const Chunks chunks{random_chunk(gen, 32), random_chunk(gen, 32),
+                      random_chunk(gen, 20)};
+  const auto measurements = snapshot(chunks);
+  SimplifyPyramid pyramid;
+  pyramid.update(measurements);
+  CHECK(pyramid.cell_count(SimplifyPyramid::level_for(1)) >=
+        pyramid.cell_count(SimplifyPyramid::level_for(2)));
+  CHECK(pyramid.cell_count(SimplifyPyramid::level_for(8)) >=
+        pyramid.cell_count(SimplifyPyramid::level_for(16)));
+  check_simplify(pyramid, measurements);
+}
+
+TEST_CASE("SimplifyPyramid only updates changed chunks", "[util]") {
+  std::mt19937 gen(42);
+  Chunks chunks{random_chunk(gen, 32), random_chunk(gen, 32),
+                random_chunk(gen, 10)};
+  SimplifyPyramid pyramid;
+  pyramid.update(snapshot(chunks));
+
+  // A new sample in the first chunk and new places in the last one
+  auto first = std::make_shared<RawMeasurements>(*chunks[0]);
+  (*first)[3].add_sample(-20.0);
+  chunks[0] = first;
+  chunks[2] = std::make_shared<RawMeasurements>(*random_chunk(gen, 32));
+  chunks.push_back(random_chunk(gen, 5));
+  const auto grown = snapshot(chunks);
+  pyramid.update(grown);
+  check_simplify(pyramid, grown);
+
+  SimplifyPyramid fresh;
+  fresh.update(grown);
+  for (int level = 0; level < Valeronoi::util::SIMPLIFY_PYRAMID_LEVELS;
+       level++) {
+    CHECK(pyramid.cell_count(level) == fresh.cell_count(level));
+  }
+
+  // Fewer chunks, e.g. after undoing a recording
+  chunks.resize(1);
+  const auto shrunk = snapshot(chunks);
+  pyramid.update(shrunk);
+  check_simplify(pyramid, shrunk);
+
+  // A different data set
+  const auto other = snapshot({random_chunk(gen, 16)});
+  pyramid.update(other);
+  check_simplify(pyramid, other);
+
+  pyramid.update(MeasurementSnapshot());
+  CHECK(pyramid.simplify(4).empty());
+  CHECK(pyramid.cell_count(0) == 0);
+}
@@ -0,0 +1,84 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QTest>
+#include <catch2/catch_amalgamated.hpp>
+
+#include "src/robot/api/sse.h"
+#include "tests/test_helpers.h"
+
+using namespace Valeronoi::robot::api;
+
+static QByteArray map_event(const QByteArray& data) {
+  return "event: MapUpdated\ndata: " + data + "\n\n";
+}
+
+TEST_CASE("SSEConnection coalesces buffered events", "[robot]") {
+  ensure_application();
+
+  SSEConnection connection;
+  connection.set_event("MapUpdated");
+  QSignalSpy spy(&connection, &SSEConnection::signal_data_updated);
+
+  connection.process(map_event("1") + map_event("2") + map_event("3"));
+  // The signal waits for the event loop, so the whole segment is parsed first
+  CHECK(spy.count() == 0);
+  REQUIRE(spy.wait(1000));
+  QTest::qWait(50);
+  CHECK(spy.count() == 1);
+  CHECK(connection.current_data() == "3");
+
+  const auto statistics = connection.statistics();
+  CHECK(statistics.received == 3);
+  CHECK(statistics.processed == 1);
+  CHECK(statistics.dropped == 2);
+}
+
+TEST_CASE("SSEConnection ignores other events", "[robot]") {
+  ensure_application();
+
+  SSEConnection connection;
+  connection.set_event("MapUpdated");
+  QSignalSpy spy(&connection, &SSEConnection::signal_data_updated);
+
+  connection.process("event: StateUpdated\ndata: 1\n\n");
+  CHECK_FALSE(spy.wait(100));
+  CHECK(connection.current_data().isEmpty());
+  CHECK(connection.statistics().received == 0);
+}
+
+TEST_CASE("SSEConnection honours the minimum interval", "[robot]") {
+  ensure_application();
+
+  SSEConnection connection;
+  connection.set_event("MapUpdated");
+  connection.set_min_interval(std::chrono::milliseconds(300));
+  QSignalSpy spy(&connection, &SSEConnection::signal_data_updated);
+
+  // The first event is not delayed
+  connection.process(map_event("1"));
+  REQUIRE(spy.wait(200));
+  CHECK(connection.current_data() == "1");
+
+  QElapsedTimer timer;
+  timer.start();
+  connection.process(map_event("2"));
+  QTest::qWait(50);
+  connection.process(map_event("3"));
+  CHECK(spy.count() == 1);
+
+  // Both events arrived within the interval, only the newest one is handed on
+  REQUIRE(spy.wait(2000));
+  CHECK(timer.elapsed() >= 200);
+  CHECK(spy.count() == 2);
+  CHECK(connection.current_data() == "3");
+
+  const auto statistics = connection.statistics();
+  CHECK(statistics.received == 3);
+  CHECK(statistics.processed == 2);
+  CHECK(statistics.dropped == 1);
+}
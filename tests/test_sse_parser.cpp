@@ -0,0 +1,120 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <QByteArray>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <catch2/catch_amalgamated.hpp>
+#include <vector>
+
+#include "src/robot/api/sse_parser.h"
+
+using namespace Valeronoi::robot::api;
+
+static std::vector<SSEEvent> parse_chunked(const QByteArray& stream,
+                                           qsizetype chunk_size) {
+  SSEParser parser;
+  std::vector<SSEEvent> events;
+  for (qsizetype i = 0; i < stream.size(); i += chunk_size) {
+    parser.feed(QByteArrayView(stream).sliced(
+                    i, std::min(chunk_size, stream.size() - i)),
+                [&](const SSEEvent& event) { events.push_back(event); });
+  }
+  return events;
+}
+
+// A stream as sent by Valetudo, with a large map as payload
+static QByteArray recorded_stream(int events, int pixels) {
+  QByteArray stream{": keep-alive\n\n"};
+  for (int e = 0; e < events; e++) {
+    QJsonArray compressed_pixels;
+    for (int i = 0; i < pixels; i++) {
+      compressed_pixels.append(i % 1000);
+      compressed_pixels.append(i / 1000);
+      compressed_pixels.append(1 + e);
+    }
+    QJsonObject floor;
+    floor.insert("type", "floor");
+    floor.insert("compressedPixels", compressed_pixels);
+    QJsonObject map;
+    map.insert("__class", "ValetudoMap");
+    map.insert("layers", QJsonArray({floor}));
+    stream += "event: MapUpdated\ndata: ";
+    stream += QJsonDocument(map).toJson(QJsonDocument::Compact);
+    stream += "\n\n";
+  }
+  return stream;
+}
+
+TEST_CASE("SSEParser handles chunk boundaries", "[robot]") {
+  const QByteArray stream{
+      "\xEF\xBB\xBF: comment\r\n"
+      "event: MapUpdated\r\n"
+      "data: {\"a\":\r\n"
+      "data:1}\r\n"
+      "id: 42\r\n"
+      "\r\n"
+      "retry: 1500\r"
+      "data\r"
+      "\r"
+      "event: ignored\n"
+      "\n"
+      "event: Other\n"
+      "data: last\n"
+      "\n"
+      "data: unfinished\n"};
+
+  // Every possible split, including between CR and LF
+  for (qsizetype chunk_size = 1; chunk_size <= stream.size(); chunk_size++) {
+    const auto events = parse_chunked(stream, chunk_size);
+    REQUIRE(events.size() == 3);
+    CHECK(events[0].type == "MapUpdated");
+    CHECK(events[0].data == "{\"a\":\n1}");
+    CHECK(events[0].id == "42");
+    CHECK(events[1].type == "message");
+    CHECK(events[1].data.isEmpty());
+    CHECK(events[1].id == "42");
+    CHECK(events[2].type == "Other");
+    CHECK(events[2].data == "last");
+  }
+
+  SSEParser parser;
+  parser.feed(stream, [](const SSEEvent&) {});
+  REQUIRE(parser.retry().has_value());
+  CHECK(parser.retry()->count() == 1500);
+  CHECK(parser.last_event_id() == "42");
+
+  // A new stream discards the unfinished event, but keeps the ID
+  int count{0};
+  parser.reset();
+  parser.feed("\n", [&](const SSEEvent&) { count++; });
+  CHECK(count == 0);
+  CHECK(parser.last_event_id() == "42");
+}
+
+TEST_CASE("SSEParser keeps large payloads intact", "[robot]") {
+  const auto stream = recorded_stream(3, 20000);
+  const auto events = parse_chunked(stream, 16 * 1024);
+  REQUIRE(events.size() == 3);
+  for (const auto& event : events) {
+    CHECK(event.type == "MapUpdated");
+    QJsonParseError error;
+    const auto document = QJsonDocument::fromJson(event.data, &error);
+    CHECK(error.error == QJsonParseError::NoError);
+    CHECK(document.object().value("__class").toString() == "ValetudoMap");
+  }
+}
+
+// Hidden by default, run with: valeronoi-tests "[benchmark]"
+TEST_CASE("SSEParser benchmark", "[.][benchmark]") {
+  const auto stream = recorded_stream(10, 100000);
+  for (const qsizetype chunk_size : {1024, 16 * 1024, 256 * 1024}) {
+    BENCHMARK(std::to_string(stream.size() / 1024) + " KiB in " +
+              std::to_string(chunk_size) + " byte chunks") {
+      return parse_chunked(stream, chunk_size).size();
+    };
+  }
+}
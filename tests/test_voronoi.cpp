@@ -0,0 +1,168 @@
+/**
+ * Valeronoi is an app for generating WiFi signal strength maps
+ * Copyright (C) 2021-2026 Christian Friedrich Coors <me@ccoors.de>
+ */
+#include <CGAL/Delaunay_triangulation_2.h>
+#include <CGAL/Delaunay_triangulation_adaptation_policies_2.h>
+#include <CGAL/Delaunay_triangulation_adaptation_traits_2.h>
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/Voronoi_diagram_2.h>
+
+#include <algorithm>
+#include <catch2/catch_amalgamated.hpp>
+#include <cstdlib>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "src/util/segment_generator.h"
+
+typedef CGAL::Exact_predicates_inexact_constructions_kernel K;
+typedef CGAL::Delaunay_triangulation_2<K> DT;
+typedef CGAL::Delaunay_triangulation_adaptation_traits_2<DT> AT;
+typedef CGAL::Delaunay_triangulation_caching_degeneracy_removal_policy_2<DT> AP;
+typedef CGAL::Voronoi_diagram_2<DT, AT, AP> VD;
+
+#if CGAL_VERSION_NR < CGAL_VERSION_NUMBER(6, 0, 0)
+#define GET_IF boost::get<VD::Face_handle>
+#else
+#define GET_IF std::get_if<VD::Face_handle>
+#endif
+
+struct LegacySegment {
+  int x{0}, y{0};
+  double value{0.0};
+  QPolygon polygon;
+};
+
+// The previous implementation: one insert per site through the
+// Voronoi_diagram_2 adaptor and one point location per measurement
+static std::vector<LegacySegment> legacy_voronoi(
+    const Valeronoi::state::RawMeasurements& measurements) {
+  std::vector<LegacySegment> segments;
+  if (measurements.size() < 2) {
+    return segments;
+  }
+  VD vd;
+  int x_min{0}, x_max{0}, y_min{0}, y_max{0};
+  bool first{true};
+  for (const auto& m : measurements) {
+    vd.insert(AT::Site_2(m.x, m.y));
+    if (first) {
+      x_min = x_max = m.x;
+      y_min = y_max = m.y;
+      first = false;
+    } else {
+      x_min = std::min(x_min, m.x);
+      x_max = std::max(x_max, m.x);
+      y_min = std::min(y_min, m.y);
+      y_max = std::max(y_max, m.y);
+    }
+  }
+  const int x_center{(x_max + x_min) / 2};
+  const int y_center{(y_max + y_min) / 2};
+  const int x_range{std::max(100, x_max - x_min)};
+  const int y_range{std::max(100, y_max - y_min)};
+  for (int y = -1; y < 2; y++) {
+    for (int x = -1; x < 2; x++) {
+      if (x || y) {
+        vd.insert(AT::Site_2(x_center + x * (x_range * 10),
+                             y_center + y * (y_range * 10)));
+      }
+    }
+  }
+  if (!vd.is_valid()) {
+    return segments;
+  }
+  for (const auto& m : measurements) {
+    auto result = vd.locate(AT::Point_2(m.x, m.y));
+    if (auto* v = GET_IF(&result)) {
+      LegacySegment s;
+      s.x = m.x;
+      s.y = m.y;
+      VD::Ccb_halfedge_circulator ec_start = (*v)->ccb();
+      VD::Ccb_halfedge_circulator ec = ec_start;
+      do {
+        if (ec->has_source()) {
+          const auto point = ec->source()->point();
+          s.polygon << QPoint(point.x(), point.y());
+        }
+      } while (++ec != ec_start);
+      s.value = m.average;
+      segments.push_back(s);
+    }
+  }
+  return segments;
+}
+
+static Valeronoi::state::RawMeasurements random_measurements(int count) {
+  std::mt19937 gen(4711);
+  // Roughly a 20 x 20 meter apartment in map coordinates
+  std::uniform_int_distribution<int> position(0, 2000 + count / 10);
+  std::uniform_real_distribution<double> signal(-90.0, -30.0);
+  std::set<std::pair<int, int>> used;
+  Valeronoi::state::RawMeasurements measurements;
+  measurements.reserve(count);
+  while (static_cast<int>(measurements.size()) < count) {
+    const int x = position(gen);
+    const int y = position(gen);
+    if (!used.emplace(x, y).second) {
+      continue;
+    }
+    Valeronoi::state::Measurement m{};
+    m.x = x;
+    m.y = y;
+    m.wifi_id = 0;
+    m.add_sample(signal(gen));
+    measurements.push_back(m);
+  }
+  return measurements;
+}
+
+TEST_CASE("Voronoi cells match the Voronoi_diagram_2 implementation",
+          "[util]") {
+  const auto measurements = random_measurements(500);
+  const auto expected = legacy_voronoi(measurements);
+  const auto segments =
+      Valeronoi::util::SegmentGenerator::voronoi_segments(measurements);
+
+  REQUIRE(segments.size() == static_cast<int>(expected.size()));
+  // Nothing to clip against, so every cell is a single part
+  REQUIRE(segments.part_count() == segments.size());
+  for (int i = 0; i < segments.size(); i++) {
+    CHECK(segments.positions[i] == QPoint(expected[i].x, expected[i].y));
+    CHECK(segments.values[i] == expected[i].value);
+    REQUIRE(segments.first_part[i] == i);
+    const auto polygon = segments.part(i).to_polygon();
+    // Voronoi vertices that round to the same point are merged
+    CHECK(polygon.size() >= 3);
+    CHECK(polygon.size() <= expected[i].polygon.size());
+    const auto rect = segments.part(i).bounding_rect();
+    CHECK(rect == polygon.boundingRect());
+    const auto expected_rect = expected[i].polygon.boundingRect();
+    CHECK(std::abs(rect.left() - expected_rect.left()) <= 1);
+    CHECK(std::abs(rect.top() - expected_rect.top()) <= 1);
+    CHECK(std::abs(rect.right() - expected_rect.right()) <= 1);
+    CHECK(std::abs(rect.bottom() - expected_rect.bottom()) <= 1);
+    CHECK(polygon.containsPoint(segments.positions[i], Qt::OddEvenFill));
+  }
+}
+
+// Hidden by default, run with: valeronoi-tests "[benchmark]"
+// Add --benchmark-samples 5 to keep the 100k runs reasonably short.
+TEST_CASE("Voronoi construction benchmark", "[.][benchmark]") {
+  for (const int count : {1000, 10000, 100000}) {
+    const auto measurements = random_measurements(count);
+    const auto suffix = " (" + std::to_string(count) + " sites)";
+
+    BENCHMARK("Voronoi_diagram_2 with locate" + suffix) {
+      return legacy_voronoi(measurements);
+    };
+
+    BENCHMARK("Bulk Delaunay with dual extraction" + suffix) {
+      return Valeronoi::util::SegmentGenerator::voronoi_segments(measurements);
+    };
+  }
+}